@@ -28,6 +28,8 @@ extern "C" {
  ******************************************************************************/
 
 #define DD_SERVER_TICK_SPEED 50
+#define DD_DEFAULT_SNAPSHOT_CACHE 32               // snapshots kept by demo_r_get_snapshot_at()
+#define DD_DEFAULT_REVERSE_BUDGET (4 * 1024 * 1024) // bytes of snapshots kept by demo_r_prev_tick()
 #define DD_MAX_TIMELINE_MARKERS 64
 #define DD_MAX_SNAPSHOT_ITEMS 1024
 #define DD_MAX_SNAPSHOT_SIZE (DD_MAX_SNAPSHOT_ITEMS * 256) // Increased size for safety
@@ -105,6 +107,7 @@ typedef struct {
 
 static inline int *dd_snap_offsets(const dd_snapshot *snap) { return (int *)(snap + 1); }
 static inline char *dd_snap_data_start(const dd_snapshot *snap) { return (char *)(dd_snap_offsets(snap) + snap->num_items); }
+static inline int dd_snap_size(const dd_snapshot *snap) { return (int)(sizeof(dd_snapshot) + sizeof(int) * snap->num_items) + snap->data_size; }
 static inline const dd_snap_item *dd_snap_get_item(const dd_snapshot *snap, int index) {
   if (index < 0 || index >= snap->num_items) return NULL;
   return (const dd_snap_item *)(dd_snap_data_start(snap) + dd_snap_offsets(snap)[index]);
@@ -112,6 +115,14 @@ static inline const dd_snap_item *dd_snap_get_item(const dd_snapshot *snap, int
 int dd_snap_get_item_size(const dd_snapshot *snap, int index);
 const dd_snap_item *dd_snap_find_item(const dd_snapshot *snap, int type, int id);
 
+/*
+ * Sorted snapshots keep their items in ascending type_and_id order (the order upstream DDNet uses).
+ * The wire layout has no room for a flag, so sortedness is checked once per snapshot with dd_snap_is_sorted()
+ * and the result is used to pick binary search / linear merges over the linear lookups.
+ */
+bool dd_snap_is_sorted(const dd_snapshot *snap);
+const dd_snap_item *dd_snap_find_item_sorted(const dd_snapshot *snap, int type, int id);
+
 /******************************************************************************
  *
  * 0.6 & 0.7 PROTOCOL DEFINITIONS (although we don't support 0.7 demos yet)
@@ -730,7 +741,7 @@ typedef struct {
 
 /******************************************************************************
  *
- * NETWORK MESSAGE STRUCTURES (NOT USED BY LIBRARY, FOR REFERENCE ONLY)
+ * NETWORK MESSAGE STRUCTURES (filled by the typed message decoders)
  *
  ******************************************************************************/
 typedef struct {
@@ -846,6 +857,22 @@ typedef struct {
 typedef struct {
   int m_Show;
 } dd_netmsg_cl_show_others_legacy;
+typedef struct {
+  int m_Time;
+  int m_Check;
+  int m_Finish;
+} dd_netmsg_sv_ddrace_time;
+typedef struct {
+  int m_Team;
+  int m_First;
+} dd_netmsg_sv_killmsg_team;
+typedef struct {
+  int m_ClientId;
+  int m_Time;
+  int m_Diff;
+  int m_RecordPersonal;
+  int m_RecordServer;
+} dd_netmsg_sv_race_finish;
 
 /******************************************************************************
  *
@@ -856,17 +883,50 @@ typedef struct {
 typedef struct dd_demo_writer dd_demo_writer;
 typedef struct dd_demo_reader dd_demo_reader;
 typedef struct dd_snapshot_builder dd_snapshot_builder;
+typedef struct dd_incremental_builder dd_incremental_builder;
+typedef struct dd_snap_history dd_snap_history;
+
+/*
+ * Netobj Type Registry
+ * Shared by all readers and writers: type id, UUID (extended types only), payload size and name. Types below
+ * DD_MAX_NETOBJSIZES with a size are written without the per-item size field in deltas. Extended types always keep
+ * it, because stock clients expect it and DDNet grows some of them between versions; their size is informational.
+ * Register mod types before creating readers and writers. `name` has to stay valid, it is not copied.
+ * The registry is filled on first use and not locked: make the first call (any reader, writer or registry function)
+ * and all registrations on one thread before others use the library.
+ */
+typedef struct {
+  int type_id;
+  int size; // payload size in bytes, 0 if variable
+  const char *name;
+  uint8_t uuid[16];
+} dd_netobj_type_info;
+
+bool dd_register_netobj_type(int type_id, const uint8_t uuid[16], int size, const char *name);
+const dd_netobj_type_info *dd_get_netobj_type(int type_id); // NULL if not registered
 
 /* Demo Writer API */
 dd_demo_writer *demo_w_create();
 void demo_w_destroy(dd_demo_writer **dw_ptr);
 bool demo_w_begin(dd_demo_writer *dw, FILE *f, const char *map_name, uint32_t map_crc, const char *type);
-bool demo_w_write_map(dd_demo_writer *dw, const uint8_t map_sha256[32], const uint8_t *map_data, uint32_t map_size);
+bool demo_w_write_map(dd_demo_writer *dw, const uint8_t map_sha256[32], const uint8_t *map_data, uint32_t map_size); // sha256 may be NULL
 bool demo_w_write_snap(dd_demo_writer *dw, int tick, const void *data, int size);
 bool demo_w_write_msg(dd_demo_writer *dw, int tick, const void *data, int size);
+bool demo_w_write_incremental(dd_demo_writer *dw, int tick, dd_incremental_builder *ib);
+bool demo_w_write_raw_chunk(dd_demo_writer *dw, const dd_demo_chunk *chunk); // from demo_r_next_raw_chunk, see below
+void demo_w_set_keyframe_interval(dd_demo_writer *dw, int ticks); // keyframe once more than `ticks` passed (default 250), 0: first only
 void demo_w_add_marker(dd_demo_writer *dw, int tick);
 bool demo_w_finish(dd_demo_writer *dw);
 
+/*
+ * Segments: a writer started with demo_w_begin_segment() writes only chunks, beginning with a keyframe. Segments can
+ * be encoded independently (e.g. on several threads) and appended in tick order to a demo once they are finished.
+ * demo_w_begin_from() starts a demo with the header fields and the map of the reader's demo.
+ */
+bool demo_w_begin_segment(dd_demo_writer *dw, FILE *f);
+bool demo_w_append_segment(dd_demo_writer *dw, const dd_demo_writer *segment, FILE *segment_file);
+bool demo_w_begin_from(dd_demo_writer *dw, FILE *f, dd_demo_reader *dr);
+
 /* Demo Reader API */
 dd_demo_reader *demo_r_create();
 void demo_r_destroy(dd_demo_reader **dr_ptr);
@@ -875,12 +935,437 @@ const dd_demo_info *demo_r_get_info(const dd_demo_reader *dr);
 bool demo_r_next_chunk(dd_demo_reader *dr, dd_demo_chunk *chunk);
 int demo_r_unpack_delta(dd_demo_reader *dr, const void *delta_data, int delta_size, void *unpacked_snap);
 
+/*
+ * Raw chunks: demo_r_next_raw_chunk() returns chunks still compressed (`data` / `size` are the compressed payload), to
+ * be copied with demo_w_write_raw_chunk(). Nothing is decoded, so the reader loses track of the current snapshot until
+ * the next keyframe or demo_r_get_snapshot_at(); the writer writes its next snapshot as a keyframe.
+ * demo_r_read_map() reads the embedded map (info->map_size bytes).
+ */
+bool demo_r_next_raw_chunk(dd_demo_reader *dr, dd_demo_chunk *chunk);
+bool demo_r_read_map(dd_demo_reader *dr, void *map_data);
+
+/*
+ * Selective projection: with a subscription the reader only keeps items of the listed public types (plus the
+ * DD_NETOBJTYPE_EX items naming extended types). Keyframes are filtered as they are read and delta payloads of other
+ * types are skipped, so every snapshot the reader hands out is projected. NULL subscribes to everything again.
+ * Change the subscription before reading or right before a keyframe, deltas can't bring back items they don't carry.
+ */
+void demo_r_subscribe_types(dd_demo_reader *dr, const int *types, int num_types);
+
+/*
+ * Typed access: item types as the writer passed them, with extended types mapped back from their internal 0x7fff - n
+ * types. The mapping is cached per reader and only rebuilt after the EX items changed. `snap` has to be the snapshot
+ * the reader handed out last (a SNAP chunk or the output of the last delta).
+ */
+int demo_r_item_type(dd_demo_reader *dr, const dd_snap_item *item); // -1 for extended types with an unknown UUID
+const dd_snap_item *demo_r_find_item(dd_demo_reader *dr, const dd_snapshot *snap, int type, int id);
+
+/*
+ * Delta composition: folds a run of deltas into one net delta against the reader's current snapshot, so that skipping
+ * ahead costs one demo_r_unpack_delta() instead of one per tick. Deletions cancel additions and item diffs are summed.
+ * Don't unpack deltas between demo_r_compose_begin() and applying the result, the current snapshot is the base.
+ */
+void demo_r_compose_begin(dd_demo_reader *dr);
+bool demo_r_compose_add(dd_demo_reader *dr, const void *delta_data, int delta_size); // false if the run can't be one delta
+int demo_r_compose_finish(dd_demo_reader *dr, void *delta_out, int out_size); // returns the size of the composed delta
+
+/*
+ * Change feed: reports every item a delta removes, adds or updates without building a snapshot for the caller.
+ * Keys are internal type_and_id values. `old_data` points into the reader's current snapshot (NULL for added items),
+ * `new_data` into the delta or a scratch buffer (NULL for removed items); both are only valid during the callback.
+ * Pure updates are applied to the reader's snapshot in place. Pass `unpacked_snap` to also get the full snapshot.
+ */
+typedef void (*dd_delta_item_fn)(void *user, int key, const int *old_data, const int *new_data, int size);
+typedef struct {
+  dd_delta_item_fn item_removed;
+  dd_delta_item_fn item_added;
+  dd_delta_item_fn item_updated;
+} dd_delta_visitor;
+
+int demo_r_visit_delta(dd_demo_reader *dr, const void *delta_data, int delta_size, const dd_delta_visitor *visitor, void *user, void *unpacked_snap);
+
+/*
+ * Random access: returns the snapshot as of `tick` (the last one at or before it), NULL if there is none or the demo
+ * is broken. The keyframes are indexed on the first call. Decoded keyframes and checkpoints taken every
+ * `checkpoint_interval` ticks while replaying deltas are kept in an LRU cache, so a query replays at most one
+ * checkpoint interval and repeated or nearby queries mostly hit the cache. Afterwards the reader continues with the
+ * chunks following `tick`; the snapshot stays valid until the next snapshot is read or unpacked.
+ */
+const dd_snapshot *demo_r_get_snapshot_at(dd_demo_reader *dr, int tick);
+int demo_r_num_keyframes(dd_demo_reader *dr);
+int demo_r_keyframe_tick(dd_demo_reader *dr, int index);
+void demo_r_set_snapshot_cache(dd_demo_reader *dr, int max_snapshots, int checkpoint_interval); // 0 interval: keyframes only
+
+/*
+ * Reverse stepping: moves to the snapshot before the current one and returns it, NULL at the start of the demo.
+ * Going back decodes the checkpoint interval before the current tick once into a structurally shared snapshot
+ * history (see demo_sh_*), further steps back are served from it. As long as the interval fits into the memory budget
+ * a step back costs about as much as a step forward. Like demo_r_get_snapshot_at(), the reader then continues with
+ * the chunks following the returned snapshot.
+ */
+const dd_snapshot *demo_r_prev_tick(dd_demo_reader *dr);
+void demo_r_set_reverse_budget(dd_demo_reader *dr, size_t max_bytes);
+
+/*
+ * Event Extraction API
+ * One pass over a demo that turns chat, kill messages, race finishes and death / finish events into a flat event log.
+ * Only message chunks and the event items of each delta are decoded: the reader gets subscribed to the event types, so
+ * other item payloads are skipped and no full snapshot is built. Call it on a freshly opened reader. Returns the number
+ * of events, or -1 if the demo is broken (events up to that point have been reported).
+ */
+enum {
+  DD_EVENT_CHAT,        // client_id: author (-1 for the server), data[0]: team, text: message
+  DD_EVENT_KILL,        // client_id: victim, data: killer, weapon, mode special
+  DD_EVENT_RACE_FINISH, // client_id: player, data: time, diff, personal record, server record
+  DD_EVENT_DEATH,       // client_id: player, data: x, y
+  DD_EVENT_FINISH,      // client_id: -1, data: x, y
+  DD_NUM_EVENT_TYPES
+};
+#define DD_EVENT_MASK(type) (1u << (type))
+#define DD_EVENT_MASK_ALL ((1u << DD_NUM_EVENT_TYPES) - 1)
+
+typedef struct {
+  int tick;
+  int type;
+  int client_id;
+  int data[4];
+  const char *text; // only valid during the callback
+  int text_len;
+} dd_event;
+
+typedef void (*dd_event_fn)(void *user, const dd_event *event);
+int demo_extract_events(dd_demo_reader *dr, unsigned event_mask, dd_event_fn callback, void *user);
+
 /* Snapshot Builder API */
 dd_snapshot_builder *demo_sb_create();
 void demo_sb_destroy(dd_snapshot_builder **sb_ptr);
 void demo_sb_clear(dd_snapshot_builder *sb);
 void *demo_sb_add_item(dd_snapshot_builder *sb, int type, int id, int size);
 int demo_sb_finish(dd_snapshot_builder *sb, void *snap_data);
+void demo_sb_set_sorted(dd_snapshot_builder *sb, bool sorted); // sort items by key in demo_sb_finish (default: on)
+
+/*
+ * Zero-copy mode: items are written straight into the caller's snapshot buffer (DD_MAX_SNAPSHOT_SIZE bytes) behind an
+ * offsets table reserved for `max_items` items (0 reserves the maximum). demo_sb_finish(sb, NULL) then only writes the
+ * offsets; the data is moved once if fewer items than reserved were added, or if it has to be sorted.
+ */
+void demo_sb_clear_into(dd_snapshot_builder *sb, void *snap_data, int max_items);
+
+/*
+ * Incremental Snapshot Builder API
+ * Items persist between ticks, so only the items that changed have to be updated, added or removed.
+ * demo_w_write_incremental() turns the recorded changes into the delta directly instead of diffing whole snapshots
+ * and commits them, after which the next tick starts with an empty change set.
+ */
+dd_incremental_builder *demo_ib_create();
+void demo_ib_destroy(dd_incremental_builder **ib_ptr);
+void demo_ib_reset(dd_incremental_builder *ib);
+void *demo_ib_update_item(dd_incremental_builder *ib, int type, int id, int size); // adds (zeroed) or returns the existing item for writing
+bool demo_ib_remove_item(dd_incremental_builder *ib, int type, int id);
+int demo_ib_finish(const dd_incremental_builder *ib, void *snap_data); // writes the current (sorted) snapshot
+void demo_ib_commit(dd_incremental_builder *ib);                        // clears the change set, called by demo_w_write_incremental
+
+/*
+ * Demo Editing API
+ * demo_slice() writes the ticks [start_tick, end_tick] of the reader's demo to `out`, with the map and the timeline
+ * markers in that range. Chunks are copied verbatim from the keyframe at or before start_tick on; only if start_tick
+ * isn't a keyframe its snapshot gets re-encoded as one. The reader must not have a type subscription.
+ */
+bool demo_slice(dd_demo_reader *dr, FILE *out, int start_tick, int end_tick);
+
+/*
+ * demo_concat() stitches consecutive recordings of the same map (map CRC, size and SHA256 have to match) into one
+ * demo, header and map are taken from the first part. Chunks are copied verbatim, each part from its first keyframe
+ * on. A part whose ticks don't come after the previous part's is rebased to start right behind it, timeline markers
+ * are merged and moved along. Pass freshly opened readers.
+ */
+bool demo_concat(dd_demo_reader **parts, int num_parts, FILE *out);
+
+/*
+ * demo_transcode() decodes the ticks [start_tick, end_tick] (end_tick -1: up to the end) and encodes them again with
+ * `dw`, so the writer's keyframe interval applies. Chunk types in `strip_chunks` (1 << DD_CHUNK_MSG, DD_CHUNK_SNAP or
+ * DD_CHUNK_SNAP_DELTA) are left out, without snapshots only the ticks with messages keep a tick marker. Start `dw` as
+ * a segment to transcode pieces of a demo in parallel.
+ * With `decimate` only ticks that are a multiple of it are kept, each encoded against the previous kept one. Events
+ * (explosions, sounds, deaths, ...) of the dropped ticks are added to the next kept snapshot, on a free id if theirs is
+ * taken, and their messages are written right after it, so nothing is lost and stock clients play the result.
+ * Stripped item types are taken out of every snapshot before it is encoded, so deltas simply don't carry them and
+ * keyframes are written without them (along with the EX items naming them).
+ */
+typedef struct {
+  unsigned strip_chunks;
+  bool sort_snapshots; // write items in key order
+  int decimate;        // keep every n-th tick (5: 10 Hz), events and messages of the others move to the next kept one
+  const int *strip_item_types; // public item types left out of every snapshot (DD_NETOBJTYPE_*, DD_NETEVENTTYPE_*)
+  int num_strip_item_types;
+  const int *strip_msg_types; // message ids as demo_msg_get_header() returns them, only game and extended messages
+  int num_strip_msg_types;
+} dd_transcode_options;
+
+bool demo_transcode(dd_demo_reader *dr, dd_demo_writer *dw, int start_tick, int end_tick, const dd_transcode_options *options);
+
+/*
+ * Columnar export: demo_export_columns() streams the snapshots of a demo into one file per item type, named
+ * `<path_prefix><type>.ddcol` (e.g. "out/character.ddcol"). A row is one item at one tick, with the columns "tick",
+ * "id" and one per int of the item, named after the struct fields ("X", "VelX", ...; "f0", "f1", ... for types
+ * without a schema). Ticks without a snapshot chunk repeat the previous snapshot and add no rows.
+ * Rows are stored in chunks of `rows_per_chunk` (0: DD_DEFAULT_COLUMN_ROWS), each column of a chunk a contiguous
+ * int32 array aligned to 64 bytes; an index at the end has every chunk's offset and min / max per column. Numbers are
+ * in host byte order. Returns the number of files written, -1 on failure.
+ *
+ * demo_col_open() reads such a file from memory, e.g. mapped: nothing is copied, the columns point into `data`, which
+ * has to stay valid and be 8 byte aligned.
+ */
+#define DD_DEFAULT_COLUMN_ROWS 65536
+#define DD_COLUMN_NAME_SIZE 32
+
+typedef struct {
+  char magic[8]; // "DDCOLS1"
+  int32_t type;  // public item type
+  int32_t num_columns;
+  int32_t rows_per_chunk;
+  int32_t num_chunks;
+  int64_t num_rows;
+  int64_t index_offset; // num_chunks dd_column_chunk, then num_chunks * num_columns dd_column_stats
+  char name[DD_COLUMN_NAME_SIZE];
+} dd_column_header; // followed by num_columns names of DD_COLUMN_NAME_SIZE bytes
+
+typedef struct {
+  int64_t offset;
+  int32_t num_rows;
+  int32_t column_stride; // bytes from one column of the chunk to the next
+} dd_column_chunk;
+
+typedef struct {
+  int32_t min;
+  int32_t max;
+} dd_column_stats;
+
+typedef struct {
+  const dd_column_header *header;
+  const char (*column_names)[DD_COLUMN_NAME_SIZE];
+  const dd_column_chunk *chunks;
+  const dd_column_stats *stats;
+  const uint8_t *data;
+} dd_column_file;
+
+int demo_export_columns(dd_demo_reader *dr, const char *path_prefix, int rows_per_chunk);
+// snake_case name of a public item type ("character", "ddnet_character", ...) and its field names separated by spaces,
+// NULL for types without a schema
+const char *demo_item_schema(int type, const char **fields);
+bool demo_col_open(dd_column_file *cf, const void *data, size_t size);
+int demo_col_find(const dd_column_file *cf, const char *name); // column index, -1 if there is none
+const int32_t *demo_col_data(const dd_column_file *cf, int chunk, int column);
+const dd_column_stats *demo_col_stats(const dd_column_file *cf, int chunk, int column);
+
+/*
+ * Trajectories and ghosts: demo_extract_trajectories() reads a demo once and demuxes the characters of all clients
+ * into compact per-client trajectories (every field delta-of-delta coded, so steady movement costs a byte or two per
+ * field). The reader gets subscribed to characters, DDNet characters and client infos, everything else is skipped
+ * while reading. Race finishes (Sv_RaceFinish) become runs, with the player's name and skin at the time.
+ * demo_traj_decode() gives back the samples of a client in [start_tick, end_tick]; demo_write_ghost() writes a run
+ * as a DDNet ghost file (.gho, version 6). Call it on a freshly opened reader, NULL if the demo is broken.
+ */
+#define DD_MAX_CLIENTS 128
+
+typedef struct {
+  int m_X;
+  int m_Y;
+  int m_VelX;
+  int m_VelY;
+  int m_Angle;
+  int m_Direction;
+  int m_Weapon;
+  int m_HookState;
+  int m_HookX;
+  int m_HookY;
+  int m_AttackTick;
+  int m_Tick;
+} dd_ghost_character; // as stored in ghost files
+
+typedef struct {
+  int tick; // demo tick
+  dd_ghost_character character;
+} dd_trajectory_sample;
+
+typedef struct {
+  int client_id;
+  int start_tick; // finish tick minus the race time
+  int finish_tick;
+  int time_ms;
+  char name[16];
+  int skin[9]; // skin name (6 packed ints), custom color flag, body and feet color as in dd_netobj_client_info
+} dd_ghost_run;
+
+typedef struct dd_trajectories dd_trajectories;
+
+dd_trajectories *demo_extract_trajectories(dd_demo_reader *dr);
+void demo_traj_destroy(dd_trajectories **trajectories_ptr);
+int demo_traj_num_samples(const dd_trajectories *trajectories, int client_id);
+int demo_traj_decode(const dd_trajectories *trajectories, int client_id, int start_tick, int end_tick, dd_trajectory_sample *samples, int max_samples);
+int demo_traj_num_runs(const dd_trajectories *trajectories);
+const dd_ghost_run *demo_traj_run(const dd_trajectories *trajectories, int index);
+bool demo_write_ghost(const dd_trajectories *trajectories, int run, const dd_demo_info *info, FILE *f);
+
+/*
+ * Spatial index: the items with a position (characters, projectiles, lasers, pickups, flags and positional events,
+ * lasers by the box around both ends) in a hashed uniform grid, for "what is near X" queries without scanning the
+ * snapshot. Build it from a keyframe with demo_si_build() and keep it in step by unpacking the deltas through
+ * demo_si_unpack_delta(), which only touches the items a delta adds, moves or removes. Queries find the items whose
+ * bounds intersect the rectangle (inclusive) or come within `radius` of the point, of the listed public types (NULL:
+ * all). They return the number of matches, at most `max_hits` are written to `hits`.
+ */
+typedef struct dd_spatial_index dd_spatial_index;
+
+typedef struct {
+  int type; // public type
+  int id;
+  int bounds[4]; // x0, y0, x1, y1, a single point for everything but lasers
+} dd_spatial_hit;
+
+dd_spatial_index *demo_si_create(dd_demo_reader *dr);
+void demo_si_destroy(dd_spatial_index **si_ptr);
+void demo_si_build(dd_spatial_index *si, const dd_snapshot *snap); // `snap` has to be the snapshot the reader handed out last
+int demo_si_unpack_delta(dd_spatial_index *si, const void *delta_data, int delta_size, void *unpacked_snap); // unpacked_snap may be NULL
+int demo_si_num_items(const dd_spatial_index *si);
+int demo_si_query_rect(dd_spatial_index *si, int x0, int y0, int x1, int y1, const int *types, int num_types, dd_spatial_hit *hits, int max_hits);
+int demo_si_query_radius(dd_spatial_index *si, int x, int y, int radius, const int *types, int num_types, dd_spatial_hit *hits, int max_hits);
+
+/*
+ * Player demuxing: demo_demux_players() reads a server demo once and writes one demo per output, seen by its client.
+ * Every snapshot keeps the items without a position (infos, EX items, ...) and of the others only the ones in the
+ * client's view: a DD_DEMUX_VIEW_WIDTH x DD_DEMUX_VIEW_HEIGHT rectangle around their character (where they died while
+ * dead), scaled by the camera zoom of their DDNet spectator info, like the server clips what it sends. Their player
+ * info is marked local, messages go to every output. The view test runs on a spatial index that follows the deltas;
+ * each output has its own writer, the snapshots are sorted so they are encoded in linear time.
+ * Pass a freshly opened reader without a type subscription.
+ */
+#define DD_DEMUX_VIEW_WIDTH 2400
+#define DD_DEMUX_VIEW_HEIGHT 1600
+
+typedef struct {
+  int client_id;
+  FILE *f;
+} dd_demux_output;
+
+bool demo_demux_players(dd_demo_reader *dr, const dd_demux_output *outputs, int num_outputs);
+
+/*
+ * Heatmaps: demo_heatmap_add() accumulates a demo into per-tile counters. Every snapshot counts each character in the
+ * tile it is in (occupancy) and, if it didn't move since the previous snapshot, as stalled; death and finish events
+ * count where they happened. Only characters and those events are decoded. The grid grows to cover the tiles that
+ * were hit, up to DD_HEAT_MAX_TILES in each direction (map positions are never negative, anything outside is dropped).
+ * Fill one heatmap per thread and demo_heatmap_merge() them at the end. Pass freshly opened readers; false if the
+ * demo is broken (what was read is kept) or memory ran out.
+ */
+#define DD_HEAT_TILE_SIZE 32
+#define DD_HEAT_MAX_TILES 4096
+
+enum {
+  DD_HEAT_OCCUPANCY,
+  DD_HEAT_STALL,
+  DD_HEAT_DEATH,
+  DD_HEAT_FINISH,
+  DD_NUM_HEAT_LAYERS
+};
+
+typedef struct {
+  int width; // tiles
+  int height;
+  uint32_t *layers[DD_NUM_HEAT_LAYERS]; // width * height counters each, row by row
+} dd_heatmap;
+
+void demo_heatmap_init(dd_heatmap *hm);
+void demo_heatmap_free(dd_heatmap *hm);
+bool demo_heatmap_add(dd_heatmap *hm, dd_demo_reader *dr);
+bool demo_heatmap_merge(dd_heatmap *dst, const dd_heatmap *src);
+
+/*
+ * Map datafiles: the map a demo embeds (and every DDNet map file) is a "DATA" datafile of typed items and zlib
+ * compressed data blocks. Opening one only reads its header; the item index is read on first use and data blocks are
+ * read and inflated when they are asked for, then kept until demo_map_unload_data() or demo_map_close(). So getting
+ * the game layer of a multi-megabyte map reads a few kilobytes of index and the one block holding it.
+ * demo_map_open() reads the datafile at `offset` in `f` (`size` -1: up to the end of the file) and
+ * demo_r_open_map() the one embedded in a demo, both keep the file position. demo_map_open_memory() works on a buffer
+ * that has to outlive the map, e.g. a memory-mapped map file, compressed blocks are inflated straight from it.
+ * All of them return NULL if there is no valid datafile header. Items are in host byte order.
+ */
+typedef struct dd_map_file dd_map_file;
+
+/* Map item types */
+enum {
+  DD_MAPITEMTYPE_VERSION = 0,
+  DD_MAPITEMTYPE_INFO,
+  DD_MAPITEMTYPE_IMAGE,
+  DD_MAPITEMTYPE_ENVELOPE,
+  DD_MAPITEMTYPE_GROUP,
+  DD_MAPITEMTYPE_LAYER,
+  DD_MAPITEMTYPE_ENVPOINTS,
+  DD_MAPITEMTYPE_SOUND,
+};
+
+/* Tile layer flags, each names one of the DDNet physics layers */
+enum {
+  DD_TILESLAYERFLAG_GAME = 1 << 0,
+  DD_TILESLAYERFLAG_TELE = 1 << 1,
+  DD_TILESLAYERFLAG_SPEEDUP = 1 << 2,
+  DD_TILESLAYERFLAG_FRONT = 1 << 3,
+  DD_TILESLAYERFLAG_SWITCH = 1 << 4,
+  DD_TILESLAYERFLAG_TUNE = 1 << 5,
+};
+
+typedef struct {
+  int type;
+  int id;
+  int size; // bytes
+  const int32_t *data; // valid until the map is closed
+} dd_map_item;
+
+/* Tile of the game and front layers, the others have their own (see demo_map_get_tiles()) */
+typedef struct {
+  uint8_t index;
+  uint8_t flags;
+  uint8_t skip;
+  uint8_t reserved;
+} dd_map_tile;
+
+dd_map_file *demo_map_open(FILE *f, int64_t offset, int64_t size);
+dd_map_file *demo_map_open_memory(const void *data, size_t size);
+dd_map_file *demo_r_open_map(dd_demo_reader *dr); // NULL if the demo doesn't embed a map
+void demo_map_close(dd_map_file **map_ptr);
+int demo_map_num_items(dd_map_file *map); // 0 if the index is broken
+bool demo_map_get_item(dd_map_file *map, int index, dd_map_item *item);
+bool demo_map_find_item(dd_map_file *map, int type, int id, dd_map_item *item);
+void demo_map_get_type(dd_map_file *map, int type, int *start, int *num); // range of item indices of `type`
+int demo_map_num_data(dd_map_file *map);
+int demo_map_data_size(dd_map_file *map, int index); // inflated size, -1 for invalid indices
+const void *demo_map_get_data(dd_map_file *map, int index); // NULL if the block is broken or memory ran out
+void demo_map_unload_data(dd_map_file *map, int index);
+
+/*
+ * Tiles of the first tile layer with `layer_flag` (one DD_TILESLAYERFLAG_*), width * height tiles row by row, NULL if
+ * the map has no such layer. Game and front tiles are dd_map_tile, tele, speedup, switch and tune tiles are 2, 6, 4
+ * and 2 bytes as in DDNet's mapitems.h.
+ */
+const void *demo_map_get_tiles(dd_map_file *map, int layer_flag, int *width, int *height);
+
+/*
+ * Snapshot History API
+ * Keeps the last `capacity` snapshots (e.g. a rewind window) in a ring. Snapshots are stored structurally shared and
+ * immutable: items that didn't change since the previous push are referenced instead of copied, as are whole pages of
+ * them, so the memory grows with what changed per tick instead of with the snapshot size. Ticks have to increase, the
+ * oldest snapshot is dropped once the ring is full. Entries are addressed by index, 0 being the oldest.
+ */
+dd_snap_history *demo_sh_create(int capacity);
+void demo_sh_destroy(dd_snap_history **sh_ptr);
+void demo_sh_clear(dd_snap_history *sh);
+bool demo_sh_push(dd_snap_history *sh, int tick, const dd_snapshot *snap);
+int demo_sh_count(const dd_snap_history *sh);
+int demo_sh_tick(const dd_snap_history *sh, int index);
+int demo_sh_find(const dd_snap_history *sh, int tick); // index of the snapshot at `tick`, -1 if not in the history
+const void *demo_sh_find_item(const dd_snap_history *sh, int index, int type, int id, int *size);
+int demo_sh_get_snapshot(const dd_snap_history *sh, int index, void *snap_data); // writes the (sorted) snapshot, returns its size
+size_t demo_sh_memory_usage(const dd_snap_history *sh);
 
 /*
  * Message Packer API
@@ -893,10 +1378,39 @@ typedef struct {
 } dd_msg_packer;
 
 void demo_msg_init(dd_msg_packer *packer, void *buffer, size_t buffer_size);
+void demo_msg_add_header(dd_msg_packer *packer, int msg_id, bool system); // (msg_id << 1) | system, UUID for extended ids
 void demo_msg_add_int(dd_msg_packer *packer, int i);
 void demo_msg_add_string(dd_msg_packer *packer, const char *str);
 int demo_msg_finish(dd_msg_packer *packer);
 
+/*
+ * Message Unpacker API
+ * Reads a DD_CHUNK_MSG payload in place. Strings are views into the chunk buffer, their terminator is part of it, so
+ * `str` can be used as a C string as long as the chunk is. Reading past the end sets `error` and returns 0 / "".
+ * The typed decoders fill the message structs above, their string members point into the chunk as well.
+ */
+typedef struct {
+  const char *str;
+  int len;
+} dd_str_view;
+
+typedef struct {
+  const uint8_t *current;
+  const uint8_t *end;
+  bool error;
+} dd_msg_unpacker;
+
+void demo_msg_unpack_init(dd_msg_unpacker *unpacker, const void *data, int size);
+int demo_msg_get_header(dd_msg_unpacker *unpacker, bool *system); // message id, extended ids resolved by UUID, -1 if unknown
+int demo_msg_get_int(dd_msg_unpacker *unpacker);
+dd_str_view demo_msg_get_string(dd_msg_unpacker *unpacker);
+
+bool demo_msg_decode_sv_chat(dd_msg_unpacker *unpacker, dd_netmsg_sv_chat *msg);
+bool demo_msg_decode_sv_killmsg(dd_msg_unpacker *unpacker, dd_netmsg_sv_killmsg *msg);
+bool demo_msg_decode_sv_killmsg_team(dd_msg_unpacker *unpacker, dd_netmsg_sv_killmsg_team *msg);
+bool demo_msg_decode_sv_race_finish(dd_msg_unpacker *unpacker, dd_netmsg_sv_race_finish *msg);
+bool demo_msg_decode_sv_ddrace_time(dd_msg_unpacker *unpacker, dd_netmsg_sv_ddrace_time *msg);
+
 #ifdef __cplusplus
 }
 #endif
@@ -967,6 +1481,10 @@ static void dd_uint_to_be(uint8_t *data, uint32_t val) {
   data[2] = (val >> 8) & 0xFF;
   data[3] = val & 0xFF;
 }
+static uint32_t dd_le_to_uint(const uint8_t *data) {
+  uint32_t d0 = data[0], d1 = data[1], d2 = data[2], d3 = data[3];
+  return (d3 << 24) | (d2 << 16) | (d1 << 8) | d0;
+}
 
 #if defined(_WIN32) || defined(_WIN64)
 #define dd_fseek _fseeki64
@@ -987,8 +1505,16 @@ static void dd_str_timestamp(char *buffer, size_t buffer_size) {
   strftime(buffer, buffer_size, "%Y-%m-%d %H-%M-%S", tmp);
 }
 
+/* strnlen() is POSIX, not C99 */
+static size_t dd_str_nlen(const char *str, size_t max_len) {
+  size_t len = 0;
+  while (len < max_len && str[len])
+    len++;
+  return len;
+}
+
 /******************************************************************************
- * MESSAGE PACKER IMPLEMENTATION
+ * MESSAGE PACKER AND UNPACKER IMPLEMENTATION
  ******************************************************************************/
 void demo_msg_init(dd_msg_packer *packer, void *buffer, size_t buffer_size) {
   packer->error = false;
@@ -998,6 +1524,65 @@ void demo_msg_init(dd_msg_packer *packer, void *buffer, size_t buffer_size) {
 }
 
 static uint8_t *dd_variable_int_pack(uint8_t *dst, int i, int dst_size);
+static const uint8_t *dd_variable_int_unpack(const uint8_t *src, int *val, int src_size);
+
+typedef struct {
+  int msg_id;
+  const char *name;
+  uint8_t uuid[16];
+} dd_msg_uuid_entry;
+
+// game messages sent as NETMSG_EX, system messages never end up in demos
+static const dd_msg_uuid_entry g_dd_msg_uuids[] = {
+    {DD_NETMSGTYPE_SV_MYOWNMESSAGE, "my-own-message@heinrich5991.de", {0x12, 0x31, 0xe4, 0x84, 0xf6, 0x07, 0x37, 0x22, 0xa8, 0x9a, 0xbd, 0x85, 0xdb, 0x46, 0xf5, 0xd2}},
+    {DD_NETMSGTYPE_CL_SHOWDISTANCE, "show-distance@netmsg.ddnet.tw", {0x53, 0xbb, 0x28, 0xaf, 0x42, 0x52, 0x3a, 0xc9, 0x8f, 0xd3, 0x6c, 0xcb, 0xc2, 0xa6, 0x03, 0xe3}},
+    {DD_NETMSGTYPE_CL_SHOWOTHERS, "showothers@netmsg.ddnet.tw", {0x7f, 0x26, 0x4c, 0xdd, 0x71, 0xa2, 0x39, 0x62, 0xbb, 0xce, 0x0f, 0x94, 0xbb, 0xd8, 0x19, 0x13}},
+    {DD_NETMSGTYPE_CL_CAMERAINFO, "camera-info@netmsg.ddnet.org", {0x8c, 0x47, 0x02, 0x28, 0xee, 0x11, 0x38, 0x08, 0x93, 0xb9, 0xc5, 0xc8, 0x7d, 0x08, 0xb5, 0x1c}},
+    {DD_NETMSGTYPE_SV_TEAMSSTATE, "teamsstate@netmsg.ddnet.tw", {0xa0, 0x91, 0x96, 0x1a, 0x95, 0xe8, 0x37, 0x44, 0xbb, 0x60, 0x5e, 0xac, 0x9b, 0xd5, 0x63, 0xc6}},
+    {DD_NETMSGTYPE_SV_DDRACETIME, "ddrace-time@netmsg.ddnet.tw", {0x5d, 0xde, 0x8b, 0x3c, 0x6f, 0x6f, 0x37, 0xac, 0xa7, 0x2a, 0xbb, 0x34, 0x1f, 0xe7, 0x6d, 0xe5}},
+    {DD_NETMSGTYPE_SV_RECORD, "record@netmsg.ddnet.tw", {0x80, 0x4f, 0x14, 0x9f, 0x9b, 0x53, 0x3b, 0x0a, 0x89, 0x7f, 0x59, 0x66, 0x3a, 0x1c, 0x4e, 0xb9}},
+    {DD_NETMSGTYPE_SV_KILLMSGTEAM, "killmsgteam@netmsg.ddnet.tw", {0xee, 0x61, 0x0b, 0x6f, 0x90, 0x9f, 0x31, 0x1e, 0x93, 0xf7, 0x11, 0xa9, 0x5f, 0x55, 0xa0, 0x86}},
+    {DD_NETMSGTYPE_SV_YOURVOTE, "yourvote@netmsg.ddnet.org", {0xbf, 0xd7, 0xf0, 0xfc, 0x16, 0xd5, 0x3e, 0x10, 0x80, 0x15, 0xa7, 0x83, 0x80, 0xf1, 0x38, 0x70}},
+    {DD_NETMSGTYPE_SV_RACEFINISH, "racefinish@netmsg.ddnet.org", {0xc9, 0x15, 0xba, 0x68, 0x0a, 0x49, 0x33, 0x24, 0x91, 0x5a, 0x7a, 0x62, 0x20, 0xce, 0xcf, 0x33}},
+    {DD_NETMSGTYPE_SV_COMMANDINFO, "commandinfo@netmsg.ddnet.org", {0x90, 0x77, 0x8f, 0x65, 0x1b, 0x8f, 0x32, 0x2a, 0x97, 0x13, 0xcf, 0x74, 0x1a, 0xa4, 0x4a, 0x05}},
+    {DD_NETMSGTYPE_SV_COMMANDINFOREMOVE, "commandinfo-remove@netmsg.ddnet.org", {0xeb, 0x2e, 0x77, 0xce, 0xe9, 0xa2, 0x35, 0xaa, 0x94, 0xbe, 0x23, 0x5f, 0x52, 0x3a, 0xc1, 0xaa}},
+    {DD_NETMSGTYPE_SV_VOTEOPTIONGROUPSTART, "sv-vote-option-group-start@netmsg.ddnet.org", {0x96, 0x9d, 0x12, 0x7c, 0xb7, 0x68, 0x39, 0x0d, 0x88, 0x79, 0x61, 0x04, 0x99, 0x37, 0x69, 0xfa}},
+    {DD_NETMSGTYPE_SV_VOTEOPTIONGROUPEND, "sv-vote-option-group-end@netmsg.ddnet.org", {0x4f, 0x09, 0x67, 0x65, 0x39, 0xb1, 0x37, 0x66, 0x82, 0xdc, 0x61, 0xb2, 0x0c, 0xcf, 0x58, 0x9a}},
+    {DD_NETMSGTYPE_SV_COMMANDINFOGROUPSTART, "sv-commandinfo-group-start@netmsg.ddnet.org", {0x9e, 0x22, 0x01, 0x38, 0xd3, 0x93, 0x3c, 0xb0, 0x90, 0xf1, 0xe5, 0x87, 0xc0, 0x0a, 0xb1, 0xd0}},
+    {DD_NETMSGTYPE_SV_COMMANDINFOGROUPEND, "sv-commandinfo-group-end@netmsg.ddnet.org", {0x05, 0x41, 0x25, 0xd8, 0x00, 0x62, 0x38, 0x91, 0x84, 0x0b, 0x47, 0x46, 0x22, 0x85, 0xa0, 0x1f}},
+    {DD_NETMSGTYPE_SV_CHANGEINFOCOOLDOWN, "change-info-cooldown@netmsg.ddnet.org", {0x74, 0x6c, 0xb5, 0x4c, 0x6b, 0x2b, 0x39, 0xa7, 0x8c, 0xd8, 0x7c, 0x7a, 0x1c, 0x6c, 0x30, 0x09}},
+    {DD_NETMSGTYPE_SV_MAPSOUNDGLOBAL, "map-soundglobal@netmsg.ddnet.org", {0x7b, 0x9a, 0x38, 0x25, 0x2d, 0x49, 0x3c, 0x74, 0x9c, 0xb7, 0x35, 0x56, 0x25, 0xfd, 0x81, 0xfe}},
+    {DD_NETMSGTYPE_SV_PREINPUT, "preinput@netmsg.ddnet.org", {0xb5, 0xd3, 0xa6, 0x86, 0xad, 0x59, 0x38, 0x2c, 0xb3, 0xde, 0xd9, 0xfe, 0xdc, 0x33, 0x20, 0xae}}};
+
+// perfect hash of the first UUID word, see dd_uuid_hash()
+#define DD_MSG_UUID_HASH_MUL 0x5712751bu
+static const signed char g_dd_msg_uuid_hash[32] = {7,  17, -1, 12, 18, 6, -1, 13, -1, 10, 14, -1, 15, 2,  -1, 11,
+                                                   8,  16, 9,  -1, 0,  -1, 1, -1, -1, 5,  -1, 4,  -1, -1, -1, 3};
+
+void demo_msg_add_header(dd_msg_packer *packer, int msg_id, bool system) {
+  if (msg_id < DD_OFFSET_NETMSGTYPE_UUID) {
+    demo_msg_add_int(packer, (msg_id << 1) | (system ? 1 : 0));
+    return;
+  }
+
+  const dd_msg_uuid_entry *entry = NULL;
+  for (size_t i = 0; i < sizeof(g_dd_msg_uuids) / sizeof(g_dd_msg_uuids[0]); i++) {
+    if (g_dd_msg_uuids[i].msg_id == msg_id) entry = &g_dd_msg_uuids[i];
+  }
+  if (!entry) {
+    packer->error = true;
+    return;
+  }
+  demo_msg_add_int(packer, (DD_NETMSGTYPE_EX << 1) | (system ? 1 : 0));
+  if (packer->error) return;
+  if (packer->current + 16 > packer->end) {
+    packer->error = true;
+    return;
+  }
+  memcpy(packer->current, entry->uuid, 16);
+  packer->current += 16;
+}
+
 void demo_msg_add_int(dd_msg_packer *packer, int i) {
   if (packer->error) {
     return;
@@ -1034,43 +1619,275 @@ int demo_msg_finish(dd_msg_packer *packer) {
   return (int)((char *)packer->current - (char *)packer->start);
 }
 
+void demo_msg_unpack_init(dd_msg_unpacker *unpacker, const void *data, int size) {
+  unpacker->current = (const uint8_t *)data;
+  unpacker->end = (const uint8_t *)data + (size > 0 ? size : 0);
+  unpacker->error = false;
+}
+
+int demo_msg_get_int(dd_msg_unpacker *unpacker) {
+  if (unpacker->error) return 0;
+  int value;
+  const uint8_t *next = dd_variable_int_unpack(unpacker->current, &value, (int)(unpacker->end - unpacker->current));
+  if (!next) {
+    unpacker->error = true;
+    return 0;
+  }
+  unpacker->current = next;
+  return value;
+}
+
+dd_str_view demo_msg_get_string(dd_msg_unpacker *unpacker) {
+  dd_str_view view = {"", 0};
+  if (unpacker->error) return view;
+  const uint8_t *terminator = (const uint8_t *)memchr(unpacker->current, 0, unpacker->end - unpacker->current);
+  if (!terminator) {
+    unpacker->error = true;
+    return view;
+  }
+  view.str = (const char *)unpacker->current;
+  view.len = (int)(terminator - unpacker->current);
+  unpacker->current = terminator + 1;
+  return view;
+}
+
+int demo_msg_get_header(dd_msg_unpacker *unpacker, bool *system) {
+  int header = demo_msg_get_int(unpacker);
+  if (system) *system = header & 1;
+  int msg_id = header >> 1;
+  if (unpacker->error) return -1;
+  if (msg_id != DD_NETMSGTYPE_EX) return msg_id;
+
+  if (unpacker->end - unpacker->current < 16) {
+    unpacker->error = true;
+    return -1;
+  }
+  const uint8_t *uuid = unpacker->current;
+  unpacker->current += 16;
+  int index = g_dd_msg_uuid_hash[(dd_be_to_uint(uuid) * DD_MSG_UUID_HASH_MUL) >> 27];
+  if (index < 0 || memcmp(g_dd_msg_uuids[index].uuid, uuid, 16) != 0) return -1;
+  return g_dd_msg_uuids[index].msg_id;
+}
+
+bool demo_msg_decode_sv_chat(dd_msg_unpacker *unpacker, dd_netmsg_sv_chat *msg) {
+  msg->m_Team = demo_msg_get_int(unpacker);
+  msg->m_ClientId = demo_msg_get_int(unpacker);
+  msg->m_pMessage = demo_msg_get_string(unpacker).str;
+  return !unpacker->error;
+}
+
+bool demo_msg_decode_sv_killmsg(dd_msg_unpacker *unpacker, dd_netmsg_sv_killmsg *msg) {
+  msg->m_Killer = demo_msg_get_int(unpacker);
+  msg->m_Victim = demo_msg_get_int(unpacker);
+  msg->m_Weapon = demo_msg_get_int(unpacker);
+  msg->m_ModeSpecial = demo_msg_get_int(unpacker);
+  return !unpacker->error;
+}
+
+bool demo_msg_decode_sv_killmsg_team(dd_msg_unpacker *unpacker, dd_netmsg_sv_killmsg_team *msg) {
+  msg->m_Team = demo_msg_get_int(unpacker);
+  msg->m_First = demo_msg_get_int(unpacker);
+  return !unpacker->error;
+}
+
+bool demo_msg_decode_sv_race_finish(dd_msg_unpacker *unpacker, dd_netmsg_sv_race_finish *msg) {
+  msg->m_ClientId = demo_msg_get_int(unpacker);
+  msg->m_Time = demo_msg_get_int(unpacker);
+  msg->m_Diff = demo_msg_get_int(unpacker);
+  msg->m_RecordPersonal = demo_msg_get_int(unpacker);
+  msg->m_RecordServer = demo_msg_get_int(unpacker);
+  return !unpacker->error;
+}
+
+bool demo_msg_decode_sv_ddrace_time(dd_msg_unpacker *unpacker, dd_netmsg_sv_ddrace_time *msg) {
+  msg->m_Time = demo_msg_get_int(unpacker);
+  msg->m_Check = demo_msg_get_int(unpacker);
+  msg->m_Finish = demo_msg_get_int(unpacker);
+  return !unpacker->error;
+}
+
 /******************************************************************************
  *
- * UUID MANAGER
+ * NETOBJ TYPE REGISTRY
  *
  ******************************************************************************/
 
-typedef struct {
-  int type_id;
-  uint8_t uuid[16];
-} dd_uuid_entry;
-
-static const dd_uuid_entry g_dd_uuids[] = {
-    {DD_NETOBJTYPE_MYOWNOBJECT, {0x0d, 0xc7, 0x7a, 0x02, 0xbf, 0xee, 0x3a, 0x53, 0xac, 0x8e, 0x0b, 0xb0, 0x24, 0x1b, 0xd7, 0x22}},
-    {DD_NETOBJTYPE_DDNETCHARACTER, {0x76, 0xce, 0x45, 0x5b, 0xf9, 0xeb, 0x3a, 0x48, 0xad, 0xd7, 0xe0, 0x4b, 0x94, 0x1d, 0x04, 0x5c}},
-    {DD_NETOBJTYPE_DDNETPLAYER, {0x22, 0xca, 0x93, 0x8d, 0x13, 0x80, 0x3e, 0x2b, 0x9e, 0x7b, 0xd2, 0x55, 0x8e, 0xa6, 0xbe, 0x11}},
-    {DD_NETOBJTYPE_GAMEINFOEX, {0x93, 0x3d, 0xea, 0x6a, 0xda, 0x79, 0x30, 0xea, 0xa9, 0x8f, 0x8a, 0xf0, 0x36, 0x89, 0xa9, 0x45}},
-    {DD_NETOBJTYPE_DDRACEPROJECTILE, {0x0e, 0x6d, 0xb8, 0x5c, 0x2b, 0x61, 0x38, 0x6f, 0xbb, 0xf2, 0xd0, 0xd0, 0x47, 0x1b, 0x92, 0x72}},
-    {DD_NETOBJTYPE_DDNETLASER, {0x29, 0xde, 0x68, 0xa2, 0x69, 0x28, 0x31, 0xb8, 0x83, 0x60, 0xa2, 0x30, 0x7e, 0x0d, 0x84, 0x4f}},
-    {DD_NETOBJTYPE_DDNETPROJECTILE, {0x65, 0x50, 0xfb, 0xce, 0xf3, 0x17, 0x3b, 0x31, 0x8f, 0xfe, 0xd2, 0xb3, 0x7f, 0x3a, 0xb4, 0x0e}},
-    {DD_NETOBJTYPE_DDNETPICKUP, {0xea, 0x5e, 0x4a, 0x51, 0x58, 0xfb, 0x36, 0x84, 0x96, 0xe4, 0xe0, 0xd2, 0x67, 0xf4, 0xca, 0x65}},
-    {DD_NETOBJTYPE_DDNETSPECTATORINFO, {0xd1, 0x33, 0x07, 0xb2, 0x9a, 0x19, 0x37, 0xcb, 0x8f, 0x8c, 0x07, 0xc7, 0x18, 0x52, 0x18, 0x83}},
-    {DD_NETEVENTTYPE_BIRTHDAY, {0x1f, 0xd3, 0x57, 0x46, 0x62, 0x63, 0x35, 0x8c, 0xb4, 0xd6, 0x6e, 0xf6, 0x0e, 0x0e, 0xfa, 0xaa}},
-    {DD_NETEVENTTYPE_FINISH, {0x68, 0xbf, 0x89, 0x39, 0xef, 0x55, 0x38, 0x78, 0x90, 0x82, 0x13, 0x52, 0x7e, 0xb0, 0xa5, 0x97}},
-    {DD_NETOBJTYPE_MYOWNEVENT, {0x0c, 0x4f, 0xd2, 0x7d, 0x47, 0xe3, 0x38, 0x71, 0xa2, 0x26, 0x9f, 0x41, 0x74, 0x86, 0xa3, 0x11}},
-    {DD_NETOBJTYPE_SPECCHAR, {0x4b, 0x80, 0x1c, 0x74, 0xe2, 0x4c, 0x3c, 0xe0, 0xb9, 0x2c, 0xb7, 0x54, 0xd0, 0x2c, 0xfc, 0x8a}},
-    {DD_NETOBJTYPE_SWITCHSTATE, {0xec, 0x15, 0xe6, 0x69, 0xce, 0x11, 0x33, 0x67, 0xae, 0x8e, 0xb9, 0x0e, 0x5b, 0x27, 0xb9, 0xd5}},
-    {DD_NETOBJTYPE_ENTITYEX, {0x2d, 0xe9, 0xae, 0xc3, 0x32, 0xe4, 0x39, 0x86, 0x8f, 0x7e, 0xe7, 0x45, 0x9d, 0xa7, 0xf5, 0x35}},
-    {DD_NETEVENTTYPE_MAPSOUNDWORLD, {0x54, 0xec, 0xad, 0x2e, 0xbf, 0xad, 0x3b, 0xe5, 0x89, 0x03, 0x62, 0x1b, 0xa0, 0x52, 0x45, 0x8e}}};
+// registry slots: type ids below DD_MAX_NETOBJSIZES, then the extended types OFFSET_UUID + n
+#define DD_MAX_REGISTERED_TYPES (DD_MAX_NETOBJSIZES + MAX_EXTENDED_ITEM_TYPES)
+
+static const dd_netobj_type_info g_dd_builtin_types[] = {
+    {DD_NETOBJTYPE_PLAYERINPUT, sizeof(dd_netobj_player_input), "PlayerInput", {0}},
+    {DD_NETOBJTYPE_PROJECTILE, sizeof(dd_netobj_projectile), "Projectile", {0}},
+    {DD_NETOBJTYPE_LASER, sizeof(dd_netobj_laser), "Laser", {0}},
+    {DD_NETOBJTYPE_PICKUP, sizeof(dd_netobj_pickup), "Pickup", {0}},
+    {DD_NETOBJTYPE_FLAG, sizeof(dd_netobj_flag), "Flag", {0}},
+    {DD_NETOBJTYPE_GAMEINFO, sizeof(dd_netobj_game_info), "GameInfo", {0}},
+    {DD_NETOBJTYPE_GAMEDATA, sizeof(dd_netobj_game_data), "GameData", {0}},
+    {DD_NETOBJTYPE_CHARACTERCORE, sizeof(dd_netobj_character_core), "CharacterCore", {0}},
+    {DD_NETOBJTYPE_CHARACTER, sizeof(dd_netobj_character), "Character", {0}},
+    {DD_NETOBJTYPE_PLAYERINFO, sizeof(dd_netobj_player_info), "PlayerInfo", {0}},
+    {DD_NETOBJTYPE_CLIENTINFO, sizeof(dd_netobj_client_info), "ClientInfo", {0}},
+    {DD_NETOBJTYPE_SPECTATORINFO, sizeof(dd_netobj_spectator_info), "SpectatorInfo", {0}},
+    {DD_NETEVENTTYPE_COMMON, sizeof(dd_netevent_common), "Common", {0}},
+    {DD_NETEVENTTYPE_EXPLOSION, sizeof(dd_netevent_explosion), "Explosion", {0}},
+    {DD_NETEVENTTYPE_SPAWN, sizeof(dd_netevent_spawn), "Spawn", {0}},
+    {DD_NETEVENTTYPE_HAMMERHIT, sizeof(dd_netevent_hammer_hit), "HammerHit", {0}},
+    {DD_NETEVENTTYPE_DEATH, sizeof(dd_netevent_death), "Death", {0}},
+    {DD_NETEVENTTYPE_SOUNDGLOBAL, sizeof(dd_netevent_sound_global), "SoundGlobal", {0}},
+    {DD_NETEVENTTYPE_SOUNDWORLD, sizeof(dd_netevent_sound_world), "SoundWorld", {0}},
+    {DD_NETEVENTTYPE_DAMAGEIND, sizeof(dd_netevent_damage_ind), "DamageInd", {0}},
+    {DD_NETOBJTYPE_MYOWNOBJECT, sizeof(int), "my-own-object@heinrich5991.de", {0x0d, 0xc7, 0x7a, 0x02, 0xbf, 0xee, 0x3a, 0x53, 0xac, 0x8e, 0x0b, 0xb0, 0x24, 0x1b, 0xd7, 0x22}},
+    {DD_NETOBJTYPE_DDNETCHARACTER, sizeof(dd_netobj_ddnet_character), "character@netobj.ddnet.tw", {0x76, 0xce, 0x45, 0x5b, 0xf9, 0xeb, 0x3a, 0x48, 0xad, 0xd7, 0xe0, 0x4b, 0x94, 0x1d, 0x04, 0x5c}},
+    {DD_NETOBJTYPE_DDNETPLAYER, sizeof(dd_netobj_ddnet_player), "player@netobj.ddnet.tw", {0x22, 0xca, 0x93, 0x8d, 0x13, 0x80, 0x3e, 0x2b, 0x9e, 0x7b, 0xd2, 0x55, 0x8e, 0xa6, 0xbe, 0x11}},
+    {DD_NETOBJTYPE_GAMEINFOEX, sizeof(dd_netobj_game_info_ex), "gameinfo@netobj.ddnet.tw", {0x93, 0x3d, 0xea, 0x6a, 0xda, 0x79, 0x30, 0xea, 0xa9, 0x8f, 0x8a, 0xf0, 0x36, 0x89, 0xa9, 0x45}},
+    {DD_NETOBJTYPE_DDRACEPROJECTILE, sizeof(dd_netobj_ddrace_projectile), "projectile@netobj.ddnet.tw", {0x0e, 0x6d, 0xb8, 0x5c, 0x2b, 0x61, 0x38, 0x6f, 0xbb, 0xf2, 0xd0, 0xd0, 0x47, 0x1b, 0x92, 0x72}},
+    {DD_NETOBJTYPE_DDNETLASER, sizeof(dd_netobj_ddnet_laser), "laser@netobj.ddnet.tw", {0x29, 0xde, 0x68, 0xa2, 0x69, 0x28, 0x31, 0xb8, 0x83, 0x60, 0xa2, 0x30, 0x7e, 0x0d, 0x84, 0x4f}},
+    {DD_NETOBJTYPE_DDNETPROJECTILE, sizeof(dd_netobj_ddnet_projectile), "ddnet-projectile@netobj.ddnet.tw", {0x65, 0x50, 0xfb, 0xce, 0xf3, 0x17, 0x3b, 0x31, 0x8f, 0xfe, 0xd2, 0xb3, 0x7f, 0x3a, 0xb4, 0x0e}},
+    {DD_NETOBJTYPE_DDNETPICKUP, sizeof(dd_netobj_ddnet_pickup), "pickup@netobj.ddnet.tw", {0xea, 0x5e, 0x4a, 0x51, 0x58, 0xfb, 0x36, 0x84, 0x96, 0xe4, 0xe0, 0xd2, 0x67, 0xf4, 0xca, 0x65}},
+    {DD_NETOBJTYPE_DDNETSPECTATORINFO, sizeof(dd_netobj_ddnet_spectator_info), "spectator-info@netobj.ddnet.org", {0xd1, 0x33, 0x07, 0xb2, 0x9a, 0x19, 0x37, 0xcb, 0x8f, 0x8c, 0x07, 0xc7, 0x18, 0x52, 0x18, 0x83}},
+    {DD_NETEVENTTYPE_BIRTHDAY, sizeof(dd_netevent_birthday), "birthday@netevent.ddnet.org", {0x1f, 0xd3, 0x57, 0x46, 0x62, 0x63, 0x35, 0x8c, 0xb4, 0xd6, 0x6e, 0xf6, 0x0e, 0x0e, 0xfa, 0xaa}},
+    {DD_NETEVENTTYPE_FINISH, sizeof(dd_netevent_finish), "finish@netevent.ddnet.org", {0x68, 0xbf, 0x89, 0x39, 0xef, 0x55, 0x38, 0x78, 0x90, 0x82, 0x13, 0x52, 0x7e, 0xb0, 0xa5, 0x97}},
+    {DD_NETOBJTYPE_MYOWNEVENT, sizeof(int), "my-own-event@heinrich5991.de", {0x0c, 0x4f, 0xd2, 0x7d, 0x47, 0xe3, 0x38, 0x71, 0xa2, 0x26, 0x9f, 0x41, 0x74, 0x86, 0xa3, 0x11}},
+    {DD_NETOBJTYPE_SPECCHAR, sizeof(dd_netobj_spec_char), "spec-char@netobj.ddnet.tw", {0x4b, 0x80, 0x1c, 0x74, 0xe2, 0x4c, 0x3c, 0xe0, 0xb9, 0x2c, 0xb7, 0x54, 0xd0, 0x2c, 0xfc, 0x8a}},
+    {DD_NETOBJTYPE_SWITCHSTATE, sizeof(dd_netobj_switch_state), "switch-state@netobj.ddnet.tw", {0xec, 0x15, 0xe6, 0x69, 0xce, 0x11, 0x33, 0x67, 0xae, 0x8e, 0xb9, 0x0e, 0x5b, 0x27, 0xb9, 0xd5}},
+    {DD_NETOBJTYPE_ENTITYEX, sizeof(dd_netobj_entity_ex), "entity-ex@netobj.ddnet.tw", {0x2d, 0xe9, 0xae, 0xc3, 0x32, 0xe4, 0x39, 0x86, 0x8f, 0x7e, 0xe7, 0x45, 0x9d, 0xa7, 0xf5, 0x35}},
+    {DD_NETEVENTTYPE_MAPSOUNDWORLD, sizeof(dd_netevent_map_sound_world), "map-sound-world@netevent.ddnet.org", {0x54, 0xec, 0xad, 0x2e, 0xbf, 0xad, 0x3b, 0xe5, 0x89, 0x03, 0x62, 0x1b, 0xa0, 0x52, 0x45, 0x8e}}};
+
+static dd_netobj_type_info g_dd_netobj_types[DD_MAX_REGISTERED_TYPES]; // unregistered slots have no name
+static bool g_dd_types_ready;
+
+/*
+ * UUIDs are md5 based, so their first word hashes well. The multiplier gives every built-in UUID a slot of its own,
+ * registered mod types fall back to linear probing.
+ */
+#define DD_UUID_HASH_MUL 0xca4d5fa2u
+#define DD_UUID_HASH_BITS 7
+static signed char g_dd_uuid_slots[1 << DD_UUID_HASH_BITS]; // registry slot or -1
+
+static int dd_type_slot(int type_id) {
+  if (type_id >= 0 && type_id < DD_MAX_NETOBJSIZES) return type_id;
+  if (type_id >= OFFSET_UUID && type_id - OFFSET_UUID < MAX_EXTENDED_ITEM_TYPES) return DD_MAX_NETOBJSIZES + type_id - OFFSET_UUID;
+  return -1;
+}
+
+static int dd_uuid_hash(uint32_t first_word) { return (int)((first_word * DD_UUID_HASH_MUL) >> (32 - DD_UUID_HASH_BITS)); }
+
+static void dd_rebuild_uuid_hash(void) {
+  memset(g_dd_uuid_slots, -1, sizeof(g_dd_uuid_slots));
+  for (int slot = DD_MAX_NETOBJSIZES; slot < DD_MAX_REGISTERED_TYPES; slot++) {
+    if (!g_dd_netobj_types[slot].name) continue;
+    int h = dd_uuid_hash(dd_be_to_uint(g_dd_netobj_types[slot].uuid));
+    while (g_dd_uuid_slots[h] >= 0)
+      h = (h + 1) & ((1 << DD_UUID_HASH_BITS) - 1);
+    g_dd_uuid_slots[h] = (signed char)slot;
+  }
+}
+
+/* Not thread safe, see dd_register_netobj_type(). The flag is set last so a lookup never sees a half filled table. */
+static void dd_types_init(void) {
+  if (g_dd_types_ready) return;
+  for (size_t i = 0; i < sizeof(g_dd_builtin_types) / sizeof(g_dd_builtin_types[0]); i++) {
+    g_dd_netobj_types[dd_type_slot(g_dd_builtin_types[i].type_id)] = g_dd_builtin_types[i];
+  }
+  dd_rebuild_uuid_hash();
+  g_dd_types_ready = true;
+}
+
+/* Returns the public type named by the payload of a DD_NETOBJTYPE_EX item, -1 for unknown UUIDs. */
+static int dd_uuid_lookup(const int *uuid_data) {
+  dd_types_init();
+  for (int h = dd_uuid_hash((uint32_t)uuid_data[0]); g_dd_uuid_slots[h] >= 0; h = (h + 1) & ((1 << DD_UUID_HASH_BITS) - 1)) {
+    const dd_netobj_type_info *info = &g_dd_netobj_types[(int)g_dd_uuid_slots[h]];
+    int i = 0;
+    while (i < 4 && (uint32_t)uuid_data[i] == (uint32_t)dd_be_to_uint(info->uuid + i * 4))
+      i++;
+    if (i == 4) return info->type_id;
+  }
+  return -1;
+}
+
+const dd_netobj_type_info *dd_get_netobj_type(int type_id) {
+  dd_types_init();
+  int slot = dd_type_slot(type_id);
+  return slot >= 0 && g_dd_netobj_types[slot].name ? &g_dd_netobj_types[slot] : NULL;
+}
+
+bool dd_register_netobj_type(int type_id, const uint8_t uuid[16], int size, const char *name) {
+  dd_types_init();
+  int slot = dd_type_slot(type_id);
+  if (slot < 0 || type_id == DD_NETOBJTYPE_EX || !name || size < 0 || size % 4 != 0) return false;
+
+  bool extended = type_id >= OFFSET_UUID;
+  if (extended) {
+    if (!uuid) return false;
+    int uuid_data[4];
+    for (int i = 0; i < 4; i++)
+      uuid_data[i] = dd_be_to_uint(uuid + i * 4);
+    int owner = dd_uuid_lookup(uuid_data);
+    if (owner >= 0 && owner != type_id) return false; // every UUID names one type
+  }
+
+  dd_netobj_type_info *info = &g_dd_netobj_types[slot];
+  info->type_id = type_id;
+  info->size = size;
+  info->name = name;
+  if (extended) memcpy(info->uuid, uuid, 16);
+  else memset(info->uuid, 0, 16);
+  if (extended) dd_rebuild_uuid_hash();
+  return true;
+}
 
 static bool dd_uuid_get(int type_id, uint8_t uuid_out[16]) {
-  for (size_t i = 0; i < sizeof(g_dd_uuids) / sizeof(g_dd_uuids[0]); ++i) {
-    if (g_dd_uuids[i].type_id == type_id) {
-      memcpy(uuid_out, g_dd_uuids[i].uuid, 16);
-      return true;
-    }
+  const dd_netobj_type_info *info = type_id >= OFFSET_UUID ? dd_get_netobj_type(type_id) : NULL;
+  if (!info) return false;
+  memcpy(uuid_out, info->uuid, 16);
+  return true;
+}
+
+/* Public extended types as announced by a builder, internal type DD_MAX_TYPE - index. */
+typedef struct {
+  int types[MAX_EXTENDED_ITEM_TYPES];
+  int num_types;
+  signed char index_of[MAX_EXTENDED_ITEM_TYPES]; // by type - OFFSET_UUID, -1 if not announced yet
+} dd_ex_type_map;
+
+static void dd_ex_map_clear(dd_ex_type_map *map) {
+  map->num_types = 0;
+  memset(map->index_of, -1, sizeof(map->index_of));
+}
+
+static int dd_ex_map_find(const dd_ex_type_map *map, int type) {
+  if (type - OFFSET_UUID < MAX_EXTENDED_ITEM_TYPES) return map->index_of[type - OFFSET_UUID];
+  for (int i = 0; i < map->num_types; i++) { // only types without a known UUID end up here
+    if (map->types[i] == type) return i;
+  }
+  return -1;
+}
+
+static int dd_ex_map_add(dd_ex_type_map *map, int type) {
+  if (map->num_types >= MAX_EXTENDED_ITEM_TYPES) return -1;
+  int index = map->num_types++;
+  map->types[index] = type;
+  if (type - OFFSET_UUID < MAX_EXTENDED_ITEM_TYPES) map->index_of[type - OFFSET_UUID] = (signed char)index;
+  return index;
+}
+
+static void dd_ex_map_pop(dd_ex_type_map *map) {
+  int type = map->types[--map->num_types];
+  if (type - OFFSET_UUID < MAX_EXTENDED_ITEM_TYPES) map->index_of[type - OFFSET_UUID] = -1;
+}
+
+/* Fills the payload of a DD_NETOBJTYPE_EX item announcing `type_id`. */
+static void dd_uuid_to_item_data(int type_id, int *uuid_data) {
+  uint8_t uuid[16];
+  if (dd_uuid_get(type_id, uuid)) {
+    uuid_data[0] = dd_be_to_uint(uuid);
+    uuid_data[1] = dd_be_to_uint(uuid + 4);
+    uuid_data[2] = dd_be_to_uint(uuid + 8);
+    uuid_data[3] = dd_be_to_uint(uuid + 12);
+  } else {
+    memset(uuid_data, 0, 16);
   }
-  return false;
 }
 
 /******************************************************************************
@@ -1361,54 +2178,130 @@ const dd_snap_item *dd_snap_find_item(const dd_snapshot *snap, int type, int id)
   return NULL;
 }
 
+bool dd_snap_is_sorted(const dd_snapshot *snap) {
+  const int *offsets = dd_snap_offsets(snap);
+  const char *data = dd_snap_data_start(snap);
+  for (int i = 1; i < snap->num_items; i++) {
+    if (((const dd_snap_item *)(data + offsets[i - 1]))->type_and_id >= ((const dd_snap_item *)(data + offsets[i]))->type_and_id) return false;
+  }
+  return true;
+}
+
+static int dd_snap_find_index_sorted(const dd_snapshot *snap, int key) {
+  const int *offsets = dd_snap_offsets(snap);
+  const char *data = dd_snap_data_start(snap);
+  int lo = 0, hi = snap->num_items - 1;
+  while (lo <= hi) {
+    int mid = lo + (hi - lo) / 2;
+    int mid_key = ((const dd_snap_item *)(data + offsets[mid]))->type_and_id;
+    if (mid_key == key) return mid;
+    if (mid_key < key)
+      lo = mid + 1;
+    else
+      hi = mid - 1;
+  }
+  return -1;
+}
+
+const dd_snap_item *dd_snap_find_item_sorted(const dd_snapshot *snap, int type, int id) {
+  return dd_snap_get_item(snap, dd_snap_find_index_sorted(snap, (type << 16) | id));
+}
+
+/* Index lookup that uses binary search when the caller knows the snapshot is sorted. */
+static int dd_snap_find_index(const dd_snapshot *snap, int key, bool sorted) {
+  if (sorted) return dd_snap_find_index_sorted(snap, key);
+  for (int i = 0; i < snap->num_items; i++) {
+    if (dd_snap_get_item(snap, i)->type_and_id == key) return i;
+  }
+  return -1;
+}
+
 struct dd_snapshot_builder {
-  uint8_t data[DD_MAX_SNAPSHOT_SIZE];
+  uint8_t *data; // own_data, or the data area of `target` when building in place
+  uint8_t *own_data;
   int data_size;
+  int data_capacity;
   int offsets[DD_MAX_SNAPSHOT_ITEMS];
   int num_items;
+  int max_items;
 
-  int extended_item_types[MAX_EXTENDED_ITEM_TYPES];
-  int num_extended_item_types;
-};
+  dd_snapshot *target; // zero-copy destination set by demo_sb_clear_into()
 
-static int demo_sb_get_extended_item_type_index(dd_snapshot_builder *sb, int type_id, bool *is_new) {
-  *is_new = false;
-  for (int i = 0; i < sb->num_extended_item_types; i++) {
-    if (sb->extended_item_types[i] == type_id) return i;
-  }
+  dd_ex_type_map ex_types;
 
-  if (sb->num_extended_item_types >= MAX_EXTENDED_ITEM_TYPES) return -1;
+  bool sort_items;
+};
 
-  int index = sb->num_extended_item_types++;
-  sb->extended_item_types[index] = type_id;
-  *is_new = true;
-  return index;
+static int demo_sb_get_extended_item_type_index(dd_snapshot_builder *sb, int type_id, bool *is_new) {
+  int index = dd_ex_map_find(&sb->ex_types, type_id);
+  *is_new = index < 0;
+  return index < 0 ? dd_ex_map_add(&sb->ex_types, type_id) : index;
 }
 
 dd_snapshot_builder *demo_sb_create() {
   dd_snapshot_builder *sb = (dd_snapshot_builder *)malloc(sizeof(dd_snapshot_builder));
-  if (sb) demo_sb_clear(sb);
+  if (!sb) return NULL;
+  sb->own_data = NULL; // allocated on first use, builders that only build in place never need it
+  sb->sort_items = true;
+  demo_sb_clear(sb);
   return sb;
 }
 
 void demo_sb_destroy(dd_snapshot_builder **sb_ptr) {
   if (sb_ptr && *sb_ptr) {
+    free((*sb_ptr)->own_data);
     free(*sb_ptr);
     *sb_ptr = NULL;
   }
 }
 
 void demo_sb_clear(dd_snapshot_builder *sb) {
+  sb->data = sb->own_data;
   sb->data_size = 0;
+  sb->data_capacity = DD_MAX_SNAPSHOT_SIZE;
   sb->num_items = 0;
-  sb->num_extended_item_types = 0;
+  sb->max_items = DD_MAX_SNAPSHOT_ITEMS;
+  sb->target = NULL;
+  dd_ex_map_clear(&sb->ex_types);
 }
 
-void *demo_sb_add_item(dd_snapshot_builder *sb, int type, int id, int size) {
-  if (sb->num_items >= DD_MAX_SNAPSHOT_ITEMS || sb->data_size + (int)sizeof(dd_snap_item) + size > DD_MAX_SNAPSHOT_SIZE) {
+void demo_sb_clear_into(dd_snapshot_builder *sb, void *snap_data, int max_items) {
+  demo_sb_clear(sb);
+  if (max_items <= 0 || max_items > DD_MAX_SNAPSHOT_ITEMS) max_items = DD_MAX_SNAPSHOT_ITEMS;
+  sb->target = (dd_snapshot *)snap_data;
+  sb->target->num_items = max_items; // places the data area right behind the reserved offsets
+  sb->data = (uint8_t *)dd_snap_data_start(sb->target);
+  sb->data_capacity = DD_MAX_SNAPSHOT_SIZE - (int)sizeof(dd_snapshot) - (int)sizeof(int) * max_items;
+  sb->max_items = max_items;
+}
+
+void demo_sb_set_sorted(dd_snapshot_builder *sb, bool sorted) { sb->sort_items = sorted; }
+
+/* Appends an item header for `key` with room for `size` bytes, or returns NULL if the snapshot is full. */
+static dd_snap_item *demo_sb_push_item(dd_snapshot_builder *sb, int key, int size) {
+  if (sb->num_items >= sb->max_items || sb->data_size + (int)sizeof(dd_snap_item) + size > sb->data_capacity) {
     return NULL;
   }
+  if (!sb->data) {
+    sb->own_data = (uint8_t *)malloc(DD_MAX_SNAPSHOT_SIZE);
+    if (!sb->own_data) return NULL;
+    sb->data = sb->own_data;
+  }
+  dd_snap_item *obj = (dd_snap_item *)(sb->data + sb->data_size);
+  obj->type_and_id = key;
+  sb->offsets[sb->num_items] = sb->data_size;
+  sb->data_size += sizeof(dd_snap_item) + size;
+  sb->num_items++;
+  return obj;
+}
+
+/* Adds an item with an already internal type (no UUID mapping, no zeroing). Used when rebuilding snapshots from deltas. */
+static void *demo_sb_add_raw_item(dd_snapshot_builder *sb, int type, int id, int size) {
+  dd_snap_item *obj = demo_sb_push_item(sb, (type << 16) | id, size);
+  return obj ? (void *)dd_snap_item_data(obj) : NULL;
+}
 
+void *demo_sb_add_item(dd_snapshot_builder *sb, int type, int id, int size) {
   int final_type = type;
 
   if (type >= OFFSET_UUID) {
@@ -1419,58 +2312,386 @@ void *demo_sb_add_item(dd_snapshot_builder *sb, int type, int id, int size) {
     }
 
     if (is_new) {
-      if (sb->num_items >= DD_MAX_SNAPSHOT_ITEMS || sb->data_size + (int)sizeof(dd_snap_item) + 16 > DD_MAX_SNAPSHOT_SIZE) {
-        sb->num_extended_item_types--;
+      // the EX item and the item itself have to fit together
+      if (sb->num_items + 2 > sb->max_items || sb->data_size + 2 * (int)sizeof(dd_snap_item) + 16 + size > sb->data_capacity) {
+        dd_ex_map_pop(&sb->ex_types);
         return NULL;
       }
 
       int internal_id = DD_MAX_TYPE - extended_index;
-      dd_snap_item *ex_item = (dd_snap_item *)(sb->data + sb->data_size);
-      ex_item->type_and_id = (DD_NETOBJTYPE_EX << 16) | internal_id;
-      sb->offsets[sb->num_items] = sb->data_size;
-      sb->data_size += sizeof(dd_snap_item) + 16;
-      sb->num_items++;
-
-      int *uuid_data = dd_snap_item_data(ex_item);
-      uint8_t uuid[16];
-      if (dd_uuid_get(type, uuid)) {
-        uuid_data[0] = dd_be_to_uint(uuid);
-        uuid_data[1] = dd_be_to_uint(uuid + 4);
-        uuid_data[2] = dd_be_to_uint(uuid + 8);
-        uuid_data[3] = dd_be_to_uint(uuid + 12);
-      } else {
-        memset(uuid_data, 0, 16);
+      dd_snap_item *ex_item = demo_sb_push_item(sb, (DD_NETOBJTYPE_EX << 16) | internal_id, 16);
+      if (!ex_item) {
+        dd_ex_map_pop(&sb->ex_types);
+        return NULL;
       }
+      dd_uuid_to_item_data(type, dd_snap_item_data(ex_item));
     }
 
     final_type = DD_MAX_TYPE - extended_index;
   }
 
-  dd_snap_item *obj = (dd_snap_item *)(sb->data + sb->data_size);
-  obj->type_and_id = (final_type << 16) | id;
-  sb->offsets[sb->num_items] = sb->data_size;
-  sb->data_size += sizeof(dd_snap_item) + size;
-  sb->num_items++;
+  dd_snap_item *obj = demo_sb_push_item(sb, (final_type << 16) | id, size);
+  if (!obj) return NULL;
 
   void *p_data = (void *)dd_snap_item_data(obj);
   memset(p_data, 0, size);
   return p_data;
 }
 
+/* LSD radix sort (four 8 bit passes) of item indices by key. Keys are non-negative, so unsigned order is key order. */
+static void dd_radix_sort_items(const int *keys, int *order, int *tmp, int num) {
+  int counts[256];
+  int *src = order, *dst = tmp;
+  for (int i = 0; i < num; i++)
+    src[i] = i;
+  for (int shift = 0; shift < 32; shift += 8) {
+    memset(counts, 0, sizeof(counts));
+    for (int i = 0; i < num; i++)
+      counts[((unsigned)keys[src[i]] >> shift) & 0xff]++;
+    int sum = 0;
+    for (int b = 0; b < 256; b++) {
+      int c = counts[b];
+      counts[b] = sum;
+      sum += c;
+    }
+    for (int i = 0; i < num; i++)
+      dst[counts[((unsigned)keys[src[i]] >> shift) & 0xff]++] = src[i];
+    int *swap = src;
+    src = dst;
+    dst = swap;
+  }
+  // after an even number of passes the result is back in `order`
+}
+
 int demo_sb_finish(dd_snapshot_builder *sb, void *snap_data) {
-  dd_snapshot *snap = (dd_snapshot *)snap_data;
+  dd_snapshot *snap = (dd_snapshot *)(snap_data ? snap_data : sb->target);
+  size_t total_size = sizeof(dd_snapshot) + sizeof(int) * sb->num_items + sb->data_size;
+  if (total_size > DD_MAX_SNAPSHOT_SIZE) return -1;
+
+  int keys[DD_MAX_SNAPSHOT_ITEMS];
+  bool in_order = true;
+  for (int i = 0; i < sb->num_items; i++) {
+    keys[i] = ((const dd_snap_item *)(sb->data + sb->offsets[i]))->type_and_id;
+    if (i > 0 && keys[i] < keys[i - 1]) in_order = false;
+  }
+
+  if (snap == sb->target && (!sb->sort_items || in_order)) {
+    // built in place: only the offsets are written, the data moves only if fewer items than reserved were added
+    uint8_t *data_start = (uint8_t *)(dd_snap_offsets(snap) + sb->num_items);
+    if (data_start != sb->data) memmove(data_start, sb->data, sb->data_size);
+    snap->data_size = sb->data_size;
+    snap->num_items = sb->num_items;
+    memcpy(dd_snap_offsets(snap), sb->offsets, sizeof(int) * sb->num_items);
+    sb->data = data_start;
+    return (int)total_size;
+  }
+
+  const uint8_t *src = sb->data;
+  if (snap == sb->target) {
+    // sorting in place needs the unsorted items out of the way first
+    if (!sb->own_data) sb->own_data = (uint8_t *)malloc(DD_MAX_SNAPSHOT_SIZE);
+    if (!sb->own_data) return -1;
+    memcpy(sb->own_data, sb->data, sb->data_size);
+    src = sb->own_data;
+  }
+
   snap->data_size = sb->data_size;
   snap->num_items = sb->num_items;
 
-  size_t total_size = sizeof(dd_snapshot) + sizeof(int) * sb->num_items + sb->data_size;
-  if (total_size > DD_MAX_SNAPSHOT_SIZE) return -1;
+  if (!sb->sort_items || in_order) {
+    memcpy(dd_snap_offsets(snap), sb->offsets, sizeof(int) * sb->num_items);
+    if (sb->data_size > 0) memcpy(dd_snap_data_start(snap), src, sb->data_size); // an empty builder has no data yet
+    return (int)total_size;
+  }
+
+  // copy every item straight to its sorted position, the data is only moved once
+  int order[DD_MAX_SNAPSHOT_ITEMS], tmp[DD_MAX_SNAPSHOT_ITEMS];
+  dd_radix_sort_items(keys, order, tmp, sb->num_items);
+
+  int *offsets = dd_snap_offsets(snap);
+  char *data = dd_snap_data_start(snap);
+  int offset = 0;
+  for (int i = 0; i < sb->num_items; i++) {
+    int index = order[i];
+    int end = index == sb->num_items - 1 ? sb->data_size : sb->offsets[index + 1];
+    int item_size = end - sb->offsets[index];
+    offsets[i] = offset;
+    memcpy(data + offset, src + sb->offsets[index], item_size);
+    offset += item_size;
+  }
+
+  return (int)total_size;
+}
+
+/******************************************************************************
+ *
+ * INCREMENTAL SNAPSHOT BUILDER IMPLEMENTATION
+ *
+ ******************************************************************************/
+
+#define DD_IB_MAX_SLOTS (DD_MAX_SNAPSHOT_ITEMS * 2) // live items plus the ones removed during the current tick
+#define DD_IB_HASH_SIZE (DD_IB_MAX_SLOTS * 2)
+
+typedef struct {
+  int key;
+  int size;
+  int offset;     // into data
+  int old_offset; // into old_data, only valid for dirty items that existed at the last commit
+  int old_size;
+  bool present;     // part of the current snapshot
+  bool was_present; // part of the snapshot at the last commit
+  bool dirty;
+} dd_ib_slot;
+
+struct dd_incremental_builder {
+  uint8_t data[DD_MAX_SNAPSHOT_SIZE];
+  int data_end;
+  uint8_t old_data[DD_MAX_SNAPSHOT_SIZE];
+  int old_data_end;
+
+  dd_ib_slot slots[DD_IB_MAX_SLOTS];
+  int num_slots;
+  int num_present;
+  int present_data_size;
+  short hash[DD_IB_HASH_SIZE]; // key -> slot, -1 is empty
+
+  int dirty[DD_IB_MAX_SLOTS];
+  int num_dirty;
+  bool needs_keyframe; // an item changed its size, which deltas cannot express
+
+  dd_ex_type_map ex_types;
+};
+
+static unsigned dd_ib_hash_key(int key) { return ((unsigned)key * 2654435761u) >> 20 & (DD_IB_HASH_SIZE - 1); }
+
+static int dd_ib_find_slot(const dd_incremental_builder *ib, int key) {
+  for (unsigned h = dd_ib_hash_key(key);; h = (h + 1) & (DD_IB_HASH_SIZE - 1)) {
+    int slot = ib->hash[h];
+    if (slot < 0 || ib->slots[slot].key == key) return slot;
+  }
+}
 
-  memcpy(dd_snap_offsets(snap), sb->offsets, sizeof(int) * sb->num_items);
-  memcpy(dd_snap_data_start(snap), sb->data, sb->data_size);
+static void dd_ib_rebuild_hash(dd_incremental_builder *ib) {
+  memset(ib->hash, 0xff, sizeof(ib->hash));
+  for (int i = 0; i < ib->num_slots; i++) {
+    unsigned h = dd_ib_hash_key(ib->slots[i].key);
+    while (ib->hash[h] >= 0)
+      h = (h + 1) & (DD_IB_HASH_SIZE - 1);
+    ib->hash[h] = i;
+  }
+}
+
+/* Moves the live item data to the front of the arena to reclaim the holes left by removed or resized items. */
+static void dd_ib_compact(dd_incremental_builder *ib) {
+  int slots[DD_IB_MAX_SLOTS], offsets[DD_IB_MAX_SLOTS], order[DD_IB_MAX_SLOTS], tmp[DD_IB_MAX_SLOTS];
+  int num = 0;
+  for (int i = 0; i < ib->num_slots; i++) {
+    if (!ib->slots[i].present) continue;
+    slots[num] = i;
+    offsets[num++] = ib->slots[i].offset;
+  }
+  if (num == 0) {
+    ib->data_end = 0;
+    return;
+  }
+  // slide the items down in offset order so nothing is overwritten before it moved
+  dd_radix_sort_items(offsets, order, tmp, num);
+  int end = 0;
+  for (int i = 0; i < num; i++) {
+    dd_ib_slot *slot = &ib->slots[slots[order[i]]];
+    if (slot->offset != end) memmove(ib->data + end, ib->data + slot->offset, slot->size);
+    slot->offset = end;
+    end += slot->size;
+  }
+  ib->data_end = end;
+}
+
+/* Reserves `size` bytes at the end of the arena, compacting it once if needed. */
+static int dd_ib_alloc(dd_incremental_builder *ib, int size) {
+  if (ib->data_end + size > (int)sizeof(ib->data)) dd_ib_compact(ib);
+  if (ib->data_end + size > (int)sizeof(ib->data)) return -1;
+  int offset = ib->data_end;
+  ib->data_end += size;
+  return offset;
+}
+
+/* Records the state of a slot at the last commit the first time it is touched during a tick. */
+static bool dd_ib_mark_dirty(dd_incremental_builder *ib, int slot_index) {
+  dd_ib_slot *slot = &ib->slots[slot_index];
+  if (slot->dirty) return true;
+  if (slot->was_present) {
+    if (ib->old_data_end + slot->size > (int)sizeof(ib->old_data)) return false;
+    slot->old_offset = ib->old_data_end;
+    slot->old_size = slot->size;
+    memcpy(ib->old_data + slot->old_offset, ib->data + slot->offset, slot->size);
+    ib->old_data_end += slot->size;
+  }
+  slot->dirty = true;
+  ib->dirty[ib->num_dirty++] = slot_index;
+  return true;
+}
+
+static void *dd_ib_update_raw_item(dd_incremental_builder *ib, int key, int size) {
+  int slot_index = dd_ib_find_slot(ib, key);
+  dd_ib_slot *slot;
+  if (slot_index < 0) {
+    if (ib->num_slots >= DD_IB_MAX_SLOTS || ib->num_present >= DD_MAX_SNAPSHOT_ITEMS) return NULL;
+    if (ib->present_data_size + (int)sizeof(dd_snap_item) + size > DD_MAX_SNAPSHOT_SIZE) return NULL;
+
+    slot_index = ib->num_slots++;
+    slot = &ib->slots[slot_index];
+    memset(slot, 0, sizeof(*slot));
+    slot->key = key;
+    unsigned h = dd_ib_hash_key(key);
+    while (ib->hash[h] >= 0)
+      h = (h + 1) & (DD_IB_HASH_SIZE - 1);
+    ib->hash[h] = slot_index;
+  } else {
+    slot = &ib->slots[slot_index];
+    if (!slot->present || slot->size != size) {
+      if (ib->num_present + !slot->present > DD_MAX_SNAPSHOT_ITEMS) return NULL;
+      int grow = (slot->present ? size - slot->size : (int)sizeof(dd_snap_item) + size);
+      if (ib->present_data_size + grow > DD_MAX_SNAPSHOT_SIZE) return NULL;
+    }
+  }
+
+  if (!dd_ib_mark_dirty(ib, slot_index)) return NULL;
+
+  if (slot->present && slot->size != size) {
+    int offset = dd_ib_alloc(ib, size);
+    if (offset < 0) return NULL;
+    int keep = slot->size < size ? slot->size : size;
+    memmove(ib->data + offset, ib->data + slot->offset, keep);
+    memset(ib->data + offset + keep, 0, size - keep);
+    ib->present_data_size += size - slot->size;
+    slot->offset = offset;
+    slot->size = size;
+    if (slot->was_present) ib->needs_keyframe = true;
+  } else if (!slot->present) {
+    // the old location may have been reclaimed by a compaction
+    int offset = dd_ib_alloc(ib, size);
+    if (offset < 0) return NULL;
+    slot->offset = offset;
+    slot->size = size;
+    memset(ib->data + slot->offset, 0, size);
+    slot->present = true;
+    ib->num_present++;
+    ib->present_data_size += sizeof(dd_snap_item) + size;
+    if (slot->was_present && slot->old_size != size) ib->needs_keyframe = true;
+  }
+  return ib->data + slot->offset;
+}
+
+dd_incremental_builder *demo_ib_create() {
+  dd_incremental_builder *ib = (dd_incremental_builder *)malloc(sizeof(dd_incremental_builder));
+  if (ib) demo_ib_reset(ib);
+  return ib;
+}
+
+void demo_ib_destroy(dd_incremental_builder **ib_ptr) {
+  if (ib_ptr && *ib_ptr) {
+    free(*ib_ptr);
+    *ib_ptr = NULL;
+  }
+}
+
+void demo_ib_reset(dd_incremental_builder *ib) {
+  ib->data_end = 0;
+  ib->old_data_end = 0;
+  ib->num_slots = 0;
+  ib->num_present = 0;
+  ib->present_data_size = 0;
+  ib->num_dirty = 0;
+  ib->needs_keyframe = true;
+  dd_ex_map_clear(&ib->ex_types);
+  memset(ib->hash, 0xff, sizeof(ib->hash));
+}
+
+void *demo_ib_update_item(dd_incremental_builder *ib, int type, int id, int size) {
+  int final_type = type;
+  if (type >= OFFSET_UUID) {
+    int extended_index = dd_ex_map_find(&ib->ex_types, type);
+    if (extended_index == -1) {
+      if (ib->ex_types.num_types >= MAX_EXTENDED_ITEM_TYPES) return NULL;
+      extended_index = ib->ex_types.num_types;
+      int *uuid_data = (int *)dd_ib_update_raw_item(ib, (DD_NETOBJTYPE_EX << 16) | (DD_MAX_TYPE - extended_index), 16);
+      if (!uuid_data) return NULL;
+      dd_uuid_to_item_data(type, uuid_data);
+      dd_ex_map_add(&ib->ex_types, type);
+    }
+    final_type = DD_MAX_TYPE - extended_index;
+  }
+  return dd_ib_update_raw_item(ib, (final_type << 16) | id, size);
+}
+
+bool demo_ib_remove_item(dd_incremental_builder *ib, int type, int id) {
+  if (type >= OFFSET_UUID) {
+    int extended_index = dd_ex_map_find(&ib->ex_types, type);
+    if (extended_index == -1) return false;
+    type = DD_MAX_TYPE - extended_index;
+  }
+  int slot_index = dd_ib_find_slot(ib, (type << 16) | id);
+  if (slot_index < 0 || !ib->slots[slot_index].present) return false;
+  if (!dd_ib_mark_dirty(ib, slot_index)) return false;
+  dd_ib_slot *slot = &ib->slots[slot_index];
+  slot->present = false;
+  ib->num_present--;
+  ib->present_data_size -= sizeof(dd_snap_item) + slot->size;
+  return true;
+}
+
+int demo_ib_finish(const dd_incremental_builder *ib, void *snap_data) {
+  dd_snapshot *snap = (dd_snapshot *)snap_data;
+  int keys[DD_MAX_SNAPSHOT_ITEMS], slots[DD_MAX_SNAPSHOT_ITEMS], order[DD_MAX_SNAPSHOT_ITEMS], tmp[DD_MAX_SNAPSHOT_ITEMS];
+  int num = 0;
+  for (int i = 0; i < ib->num_slots; i++) {
+    if (!ib->slots[i].present) continue;
+    keys[num] = ib->slots[i].key;
+    slots[num++] = i;
+  }
 
+  size_t total_size = sizeof(dd_snapshot) + sizeof(int) * num + ib->present_data_size;
+  if (total_size > DD_MAX_SNAPSHOT_SIZE) return -1;
+  snap->data_size = ib->present_data_size;
+  snap->num_items = num;
+
+  dd_radix_sort_items(keys, order, tmp, num);
+  int *offsets = dd_snap_offsets(snap);
+  char *data = dd_snap_data_start(snap);
+  int offset = 0;
+  for (int i = 0; i < num; i++) {
+    const dd_ib_slot *slot = &ib->slots[slots[order[i]]];
+    offsets[i] = offset;
+    ((dd_snap_item *)(data + offset))->type_and_id = slot->key;
+    memcpy(data + offset + sizeof(dd_snap_item), ib->data + slot->offset, slot->size);
+    offset += sizeof(dd_snap_item) + slot->size;
+  }
   return (int)total_size;
 }
 
+void demo_ib_commit(dd_incremental_builder *ib) {
+  bool removed = false;
+  for (int i = 0; i < ib->num_dirty; i++) {
+    dd_ib_slot *slot = &ib->slots[ib->dirty[i]];
+    slot->dirty = false;
+    slot->was_present = slot->present;
+    removed |= !slot->present;
+  }
+  ib->num_dirty = 0;
+  ib->old_data_end = 0;
+  ib->needs_keyframe = false;
+
+  if (removed) {
+    // drop the removed slots, the arena holes are reclaimed by the next compaction
+    int num = 0;
+    for (int i = 0; i < ib->num_slots; i++) {
+      if (ib->slots[i].present) ib->slots[num++] = ib->slots[i];
+    }
+    ib->num_slots = num;
+    dd_ib_rebuild_hash(ib);
+  }
+}
+
 /******************************************************************************
  *
  * DEMO WRITER IMPLEMENTATION
@@ -1482,7 +2703,11 @@ struct dd_demo_writer {
   int last_tick_marker;
   int first_tick;
   int last_keyframe;
+  int keyframe_interval;
   uint8_t last_snapshot_data[DD_MAX_SNAPSHOT_SIZE];
+  bool last_sorted;
+  bool segment; // only chunks, no header to fix up in demo_w_finish
+  const dd_incremental_builder *incremental_source; // last_snapshot_data is stale while deltas come from this builder
   int timeline_markers[DD_MAX_TIMELINE_MARKERS];
   int num_timeline_markers;
   dd_huffman_state huffman;
@@ -1496,6 +2721,7 @@ dd_demo_writer *demo_w_create() {
   if (!dw) return NULL;
   dd_huffman_init(&dw->huffman);
   dd_writer_init_netobj_sizes(dw);
+  dw->keyframe_interval = DD_SERVER_TICK_SPEED * 5;
   return dw;
 }
 
@@ -1507,15 +2733,22 @@ void demo_w_destroy(dd_demo_writer **dw_ptr) {
   }
 }
 
-bool demo_w_begin(dd_demo_writer *dw, FILE *f, const char *map_name, uint32_t map_crc, const char *type) {
-  if (!dw || !f) return false;
-
+static void dd_writer_reset(dd_demo_writer *dw, FILE *f, bool segment) {
   dw->file = f;
+  dw->segment = segment;
   dw->last_tick_marker = -1;
   dw->first_tick = -1;
   dw->last_keyframe = -1;
   dw->num_timeline_markers = 0;
   memset(dw->last_snapshot_data, 0, sizeof(dw->last_snapshot_data));
+  dw->last_sorted = true;
+  dw->incremental_source = NULL;
+}
+
+bool demo_w_begin(dd_demo_writer *dw, FILE *f, const char *map_name, uint32_t map_crc, const char *type) {
+  if (!dw || !f) return false;
+
+  dd_writer_reset(dw, f, false);
 
   dd_demo_header header;
   memset(&header, 0, sizeof(header));
@@ -1546,8 +2779,10 @@ bool demo_w_write_map(dd_demo_writer *dw, const uint8_t map_sha256[32], const ui
   fwrite(map_size_be, sizeof(map_size_be), 1, dw->file);
   fseek(dw->file, current_pos, SEEK_SET);
 
-  fwrite(DD_SHA256_EXTENSION, sizeof(DD_SHA256_EXTENSION), 1, dw->file);
-  fwrite(map_sha256, 32, 1, dw->file);
+  if (map_sha256) {
+    fwrite(DD_SHA256_EXTENSION, sizeof(DD_SHA256_EXTENSION), 1, dw->file);
+    fwrite(map_sha256, 32, 1, dw->file);
+  }
   if (map_size > 0) fwrite(map_data, map_size, 1, dw->file);
 
   return true;
@@ -1625,10 +2860,28 @@ static int diff_item(const int *past, const int *current, int *out, int size) {
   return needed;
 }
 
+/* Appends the update entry for one item to the delta (`from_data` is NULL for new items). Unchanged items are rolled back;
+ * returns the new write position. */
+static int *demo_w_delta_add_update(dd_demo_writer *dw, dd_snap_delta *delta, int *out, int key, const int *from_data, const int *to_data, int item_size) {
+  int *entry = out;
+  int item_type = key >> 16;
+  *out++ = item_type;
+  *out++ = key & 0xffff;
+  if (item_type >= DD_MAX_NETOBJSIZES || dw->item_sizes[item_type] == 0) *out++ = item_size / 4;
+  if (from_data) {
+    if (!diff_item(from_data, to_data, out, item_size / 4)) return entry;
+  } else {
+    memcpy(out, to_data, item_size);
+  }
+  delta->num_update_items++;
+  return out + item_size / 4;
+}
+
 bool demo_w_write_snap(dd_demo_writer *dw, int tick, const void *data, int size) {
   if (!dw || !dw->file) return false;
 
-  if (dw->last_keyframe == -1 || (tick - dw->last_keyframe) > DD_SERVER_TICK_SPEED * 5) {
+  bool sorted = dd_snap_is_sorted((const dd_snapshot *)data);
+  if (dw->last_keyframe == -1 || (dw->keyframe_interval > 0 && tick - dw->last_keyframe > dw->keyframe_interval) || dw->incremental_source) {
     demo_w_write_tickmarker(dw, tick, true);
     demo_w_write_data(dw, DD_CHUNKTYPE_SNAPSHOT, data, size);
     dw->last_keyframe = tick;
@@ -1646,41 +2899,42 @@ bool demo_w_write_snap(dd_demo_writer *dw, int tick, const void *data, int size)
     delta->num_update_items = 0;
     delta->num_temp_items = 0;
 
-    for (int i = 0; i < from->num_items; i++) {
-      const dd_snap_item *from_item = dd_snap_get_item(from, i);
-      if (!dd_snap_find_item(to, dd_snap_item_type(from_item), dd_snap_item_id(from_item))) {
-        delta->num_deleted_items++;
-        *delta_data++ = dd_snap_item_key(from_item);
+    if (sorted && dw->last_sorted) {
+      // both snapshots are in key order, so deletions and updates fall out of two linear merges
+      int j = 0;
+      for (int i = 0; i < from->num_items; i++) {
+        int from_key = dd_snap_get_item(from, i)->type_and_id;
+        while (j < to->num_items && dd_snap_get_item(to, j)->type_and_id < from_key)
+          j++;
+        if (j == to->num_items || dd_snap_get_item(to, j)->type_and_id != from_key) {
+          delta->num_deleted_items++;
+          *delta_data++ = from_key;
+        }
       }
-    }
 
-    for (int i = 0; i < to->num_items; i++) {
-      const dd_snap_item *to_item = dd_snap_get_item(to, i);
-      int item_type = dd_snap_item_type(to_item);
-      int item_id = dd_snap_item_id(to_item);
-      int item_size = dd_snap_get_item_size(to, i);
-      const dd_snap_item *from_item = dd_snap_find_item(from, item_type, item_id);
-
-      bool include_size = item_type >= DD_MAX_NETOBJSIZES || dw->item_sizes[item_type] == 0;
-
-      if (from_item) {
-        int *diff_storage = (int *)malloc(item_size);
-        if (diff_storage && diff_item(dd_snap_item_data(from_item), dd_snap_item_data(to_item), diff_storage, item_size / 4)) {
-          *delta_data++ = item_type;
-          *delta_data++ = item_id;
-          if (include_size) *delta_data++ = item_size / 4;
-          memcpy(delta_data, diff_storage, item_size);
-          delta_data += item_size / 4;
-          delta->num_update_items++;
+      int i = 0;
+      for (j = 0; j < to->num_items; j++) {
+        const dd_snap_item *to_item = dd_snap_get_item(to, j);
+        while (i < from->num_items && dd_snap_get_item(from, i)->type_and_id < to_item->type_and_id)
+          i++;
+        const int *from_data = NULL;
+        if (i < from->num_items && dd_snap_get_item(from, i)->type_and_id == to_item->type_and_id) from_data = dd_snap_item_data(dd_snap_get_item(from, i));
+        delta_data = demo_w_delta_add_update(dw, delta, delta_data, to_item->type_and_id, from_data, dd_snap_item_data(to_item), dd_snap_get_item_size(to, j));
+      }
+    } else {
+      for (int i = 0; i < from->num_items; i++) {
+        const dd_snap_item *from_item = dd_snap_get_item(from, i);
+        if (!dd_snap_find_item(to, dd_snap_item_type(from_item), dd_snap_item_id(from_item))) {
+          delta->num_deleted_items++;
+          *delta_data++ = dd_snap_item_key(from_item);
         }
-        if (diff_storage) free(diff_storage);
-      } else {
-        *delta_data++ = item_type;
-        *delta_data++ = item_id;
-        if (include_size) *delta_data++ = item_size / 4;
-        memcpy(delta_data, dd_snap_item_data(to_item), item_size);
-        delta_data += item_size / 4;
-        delta->num_update_items++;
+      }
+
+      for (int i = 0; i < to->num_items; i++) {
+        const dd_snap_item *to_item = dd_snap_get_item(to, i);
+        const dd_snap_item *from_item = dd_snap_find_item(from, dd_snap_item_type(to_item), dd_snap_item_id(to_item));
+        delta_data = demo_w_delta_add_update(dw, delta, delta_data, to_item->type_and_id, from_item ? dd_snap_item_data(from_item) : NULL,
+                                             dd_snap_item_data(to_item), dd_snap_get_item_size(to, i));
       }
     }
 
@@ -1690,6 +2944,86 @@ bool demo_w_write_snap(dd_demo_writer *dw, int tick, const void *data, int size)
     }
     memcpy(dw->last_snapshot_data, data, size);
   }
+  dw->last_sorted = sorted;
+  dw->incremental_source = NULL;
+  return true;
+}
+
+bool demo_w_write_incremental(dd_demo_writer *dw, int tick, dd_incremental_builder *ib) {
+  if (!dw || !dw->file || !ib) return false;
+
+  if (dw->last_keyframe == -1 || (dw->keyframe_interval > 0 && tick - dw->last_keyframe > dw->keyframe_interval) || dw->incremental_source != ib || ib->needs_keyframe) {
+    int size = demo_ib_finish(ib, dw->last_snapshot_data);
+    if (size < 0) return false;
+    demo_w_write_tickmarker(dw, tick, true);
+    demo_w_write_data(dw, DD_CHUNKTYPE_SNAPSHOT, dw->last_snapshot_data, size);
+    dw->last_keyframe = tick;
+    dw->last_sorted = true;
+  } else {
+    demo_w_write_tickmarker(dw, tick, false);
+
+    // the change set is the delta: only the items touched since the last commit are visited
+    uint8_t delta_buf[DD_MAX_SNAPSHOT_SIZE];
+    dd_snap_delta *delta = (dd_snap_delta *)delta_buf;
+    int *delta_data = delta->data;
+
+    delta->num_deleted_items = 0;
+    delta->num_update_items = 0;
+    delta->num_temp_items = 0;
+
+    for (int i = 0; i < ib->num_dirty; i++) {
+      const dd_ib_slot *slot = &ib->slots[ib->dirty[i]];
+      if (slot->was_present && !slot->present) {
+        delta->num_deleted_items++;
+        *delta_data++ = slot->key;
+      }
+    }
+    for (int i = 0; i < ib->num_dirty; i++) {
+      const dd_ib_slot *slot = &ib->slots[ib->dirty[i]];
+      if (!slot->present) continue;
+      const int *from_data = slot->was_present ? (const int *)(ib->old_data + slot->old_offset) : NULL;
+      delta_data = demo_w_delta_add_update(dw, delta, delta_data, slot->key, from_data, (const int *)(ib->data + slot->offset), slot->size);
+    }
+
+    int delta_size = (int)((uint8_t *)delta_data - delta_buf);
+    if (delta_size > (int)sizeof(dd_snap_delta) - (int)sizeof(int)) {
+      demo_w_write_data(dw, DD_CHUNKTYPE_DELTA, delta_buf, delta_size);
+    }
+  }
+  dw->incremental_source = ib;
+  demo_ib_commit(ib);
+  return true;
+}
+
+bool demo_w_write_raw_chunk(dd_demo_writer *dw, const dd_demo_chunk *chunk) {
+  if (!dw || !dw->file) return false;
+
+  int type;
+  switch (chunk->type) {
+  case DD_CHUNK_TICK_MARKER:
+    demo_w_write_tickmarker(dw, chunk->tick, chunk->is_keyframe);
+    return true;
+  case DD_CHUNK_SNAP:
+    type = DD_CHUNKTYPE_SNAPSHOT;
+    break;
+  case DD_CHUNK_SNAP_DELTA:
+    type = DD_CHUNKTYPE_DELTA;
+    break;
+  case DD_CHUNK_MSG:
+    type = DD_CHUNKTYPE_MESSAGE;
+    break;
+  default:
+    return false;
+  }
+  if (chunk->size < 0 || chunk->size > 0xffff) return false;
+
+  demo_w_write_chunk_header(dw, type, chunk->size);
+  fwrite(chunk->data, chunk->size, 1, dw->file);
+  if (type != DD_CHUNKTYPE_MESSAGE) {
+    // last_snapshot_data doesn't follow copied snapshots, the next one has to be a keyframe
+    dw->last_keyframe = -1;
+    dw->incremental_source = NULL;
+  }
   return true;
 }
 
@@ -1707,8 +3041,41 @@ void demo_w_add_marker(dd_demo_writer *dw, int tick) {
   }
 }
 
+bool demo_w_begin_segment(dd_demo_writer *dw, FILE *f) {
+  if (!dw || !f) return false;
+  dd_writer_reset(dw, f, true);
+  return true;
+}
+
+bool demo_w_append_segment(dd_demo_writer *dw, const dd_demo_writer *segment, FILE *segment_file) {
+  if (!dw || !dw->file || !segment->segment || segment->file) return false;
+  if (segment->first_tick < 0) return true;
+  if (dw->last_tick_marker >= segment->first_tick) return false;
+
+  // a segment starts with a keyframe, its tick markers don't depend on ours
+  uint8_t buffer[64 * 1024];
+  size_t read_bytes;
+  if (dd_fseek(segment_file, 0, SEEK_SET) != 0) return false;
+  while ((read_bytes = fread(buffer, 1, sizeof(buffer), segment_file)) > 0) {
+    if (fwrite(buffer, 1, read_bytes, dw->file) != read_bytes) return false;
+  }
+  if (ferror(segment_file)) return false;
+
+  if (dw->first_tick < 0) dw->first_tick = segment->first_tick;
+  dw->last_tick_marker = segment->last_tick_marker;
+  dw->last_keyframe = -1;
+  dw->incremental_source = NULL;
+  return true;
+}
+
+void demo_w_set_keyframe_interval(dd_demo_writer *dw, int ticks) { dw->keyframe_interval = ticks; }
+
 bool demo_w_finish(dd_demo_writer *dw) {
   if (!dw || !dw->file) return false;
+  if (dw->segment) {
+    dw->file = NULL;
+    return true;
+  }
 
   fseek(dw->file, offsetof(dd_demo_header, length), SEEK_SET);
   uint8_t length_be[4];
@@ -1738,28 +3105,132 @@ bool demo_w_finish(dd_demo_writer *dw) {
  *
  ******************************************************************************/
 
+typedef struct dd_delta_composer dd_delta_composer;
+
+/* A delta with its update entries split up and matched against the reader's current snapshot. */
+typedef struct {
+  const int *deleted;
+  int deleted_from[DD_MAX_SNAPSHOT_ITEMS]; // index in the current snapshot or -1
+  int num_deleted;
+  int update_keys[DD_MAX_SNAPSHOT_ITEMS];
+  int update_sizes[DD_MAX_SNAPSHOT_ITEMS];
+  int update_from[DD_MAX_SNAPSHOT_ITEMS]; // index in the current snapshot or -1 for new items
+  const int *update_data[DD_MAX_SNAPSHOT_ITEMS];
+  int num_updates;
+  bool updates_in_order;
+  bool structural; // adds or removes items, or changes an item's size
+  bool ex_changed; // touches a DD_NETOBJTYPE_EX item
+
+  // with a subscription: extended type indices can be reassigned from tick to tick, see dd_reader_alloc_hidden()
+  bool ex_subscribed[MAX_EXTENDED_ITEM_TYPES]; // by DD_MAX_TYPE - internal type, with the delta applied
+  int dropped_from[DD_MAX_SNAPSHOT_ITEMS];     // items of the current snapshot whose type index now names an unsubscribed type
+  int num_dropped;
+  int hidden_keys[DD_MAX_SNAPSHOT_ITEMS]; // updates of extended items that stay out of the projection
+  int hidden_sizes[DD_MAX_SNAPSHOT_ITEMS];
+  const int *hidden_data[DD_MAX_SNAPSHOT_ITEMS];
+  int hidden_from[DD_MAX_SNAPSHOT_ITEMS];    // index in the hidden snapshot or -1
+  int projected_from[DD_MAX_SNAPSHOT_ITEMS]; // index in the current snapshot or -1
+  int num_hidden_updates;
+  bool hidden_used[DD_MAX_SNAPSHOT_ITEMS]; // hidden items the delta deletes, updates or brings back
+  bool hidden_changed;
+} dd_parsed_delta;
+
+typedef struct {
+  int tick;
+  int64_t offset; // right behind the keyframe's tick marker
+} dd_keyframe;
+
+typedef struct {
+  int tick;
+  int64_t offset; // right behind the chunk that produced the snapshot
+  unsigned last_used;
+  int size;
+  uint8_t *snap;
+} dd_cached_snapshot;
+
 struct dd_demo_reader {
   FILE *file;
   dd_demo_info info;
   int current_tick;
   uint8_t chunk_data[DD_MAX_PAYLOAD];
+  uint8_t raw_chunk_data[DD_MAX_PAYLOAD];
   uint8_t last_snapshot_data[DD_MAX_SNAPSHOT_SIZE];
+  bool last_sorted;
+  int snapshot_tick; // tick of last_snapshot_data, -1 if there is none yet
+  dd_snapshot_builder *unpack_builder;
+  dd_delta_composer *composer;
+  dd_parsed_delta parsed_delta;
+  uint8_t *scratch_snapshot;
   dd_huffman_state huffman;
   short item_sizes[DD_MAX_NETOBJSIZES];
+
+  // type subscription, vanilla types by type id and extended types by public type id - OFFSET_UUID
+  bool subscribe_all;
+  uint64_t subscribed_types;
+  uint64_t subscribed_ex_types;
+  uint8_t *hidden_buffers; // the hidden snapshot, the one being rebuilt and payloads of a delta, NULL until needed
+  uint8_t *hidden_snapshot;
+  uint8_t *hidden_next;
+  uint8_t *hidden_payloads;
+
+  // extended type resolution of the current snapshot
+  bool ex_types_dirty;
+  short ex_public_types[MAX_EXTENDED_ITEM_TYPES];   // by DD_MAX_TYPE - internal type, -1 if unknown
+  short ex_internal_types[MAX_EXTENDED_ITEM_TYPES]; // by public type - OFFSET_UUID, -1 if not announced
+
+  // random access, see SNAPSHOT SEEKING
+  int64_t chunks_start;
+  dd_keyframe *keyframes;
+  int num_keyframes;
+  bool keyframes_indexed;
+  dd_cached_snapshot *cache;
+  int cache_capacity;
+  int num_cached;
+  unsigned cache_clock;
+  int checkpoint_interval;
+  bool positioned; // the file position belongs to snapshot_tick, no chunk has been read since the last seek
+
+  // reverse stepping: the snapshots before the current one and the file offsets behind them (same indices)
+  dd_snap_history *reverse;
+  int64_t *reverse_offsets;
+  size_t reverse_budget;
 };
 
 static void dd_reader_init_netobj_sizes(dd_demo_reader *dr);
+static void dd_composer_free(dd_delta_composer *dc);
+static void dd_reader_clear_cache(dd_demo_reader *dr);
+static void dd_reader_clear_hidden(dd_demo_reader *dr);
 
 dd_demo_reader *demo_r_create() {
   dd_demo_reader *dr = (dd_demo_reader *)calloc(1, sizeof(dd_demo_reader));
   if (!dr) return NULL;
+  dr->unpack_builder = demo_sb_create();
+  if (!dr->unpack_builder) {
+    free(dr);
+    return NULL;
+  }
   dd_huffman_init(&dr->huffman);
   dd_reader_init_netobj_sizes(dr);
+  dr->subscribe_all = true;
+  dr->ex_types_dirty = true;
+  dr->snapshot_tick = -1;
+  dr->cache_capacity = DD_DEFAULT_SNAPSHOT_CACHE;
+  dr->checkpoint_interval = DD_SERVER_TICK_SPEED;
+  dr->reverse_budget = DD_DEFAULT_REVERSE_BUDGET;
   return dr;
 }
 
 void demo_r_destroy(dd_demo_reader **dr_ptr) {
   if (dr_ptr && *dr_ptr) {
+    demo_sb_destroy(&(*dr_ptr)->unpack_builder);
+    dd_composer_free((*dr_ptr)->composer);
+    dd_reader_clear_cache(*dr_ptr);
+    free((*dr_ptr)->cache);
+    free((*dr_ptr)->keyframes);
+    demo_sh_destroy(&(*dr_ptr)->reverse);
+    free((*dr_ptr)->reverse_offsets);
+    free((*dr_ptr)->scratch_snapshot);
+    free((*dr_ptr)->hidden_buffers);
     free(*dr_ptr);
     *dr_ptr = NULL;
   }
@@ -1770,6 +3241,12 @@ bool demo_r_open(dd_demo_reader *dr, FILE *f) {
 
   dr->file = f;
   dr->current_tick = -1;
+  dr->snapshot_tick = -1;
+  dr->positioned = false;
+  dr->keyframes_indexed = false;
+  dr->num_keyframes = 0;
+  dd_reader_clear_cache(dr);
+  dd_reader_clear_hidden(dr);
 
   if (fread(&dr->info.header, sizeof(dd_demo_header), 1, f) != 1) return false;
   if (memcmp(dr->info.header.marker, DD_HEADER_MARKER, sizeof(DD_HEADER_MARKER)) != 0) return false;
@@ -1800,14 +3277,197 @@ bool demo_r_open(dd_demo_reader *dr, FILE *f) {
   }
 
   dd_fseek(f, dr->info.map_size, SEEK_CUR);
+  dr->chunks_start = dd_ftell(f);
 
   return true;
 }
 
 const dd_demo_info *demo_r_get_info(const dd_demo_reader *dr) { return &dr->info; }
 
-bool demo_r_next_chunk(dd_demo_reader *dr, dd_demo_chunk *chunk) {
+void demo_r_subscribe_types(dd_demo_reader *dr, const int *types, int num_types) {
+  dd_reader_clear_cache(dr); // cached snapshots are projected with the old subscription
+  dd_reader_clear_hidden(dr);
+  dr->subscribe_all = types == NULL;
+  dr->subscribed_types = 0;
+  dr->subscribed_ex_types = 0;
+  for (int i = 0; types && i < num_types; i++) {
+    if (types[i] >= 0 && types[i] < 64) dr->subscribed_types |= (uint64_t)1 << types[i];
+    else if (types[i] >= OFFSET_UUID && types[i] < OFFSET_UUID + 64) dr->subscribed_ex_types |= (uint64_t)1 << (types[i] - OFFSET_UUID);
+  }
+}
+
+/* Whether items of internal `type` are kept. `ex_data` is the payload of the EX item naming an extended type, if any. */
+static bool dd_reader_subscribed(const dd_demo_reader *dr, int type, const int *ex_data) {
+  if (dr->subscribe_all || type == DD_NETOBJTYPE_EX) return true;
+  if (type < 64) return (dr->subscribed_types >> type) & 1;
+  if (!ex_data) return false;
+
+  int public_type = dd_uuid_lookup(ex_data);
+  return public_type >= OFFSET_UUID && ((dr->subscribed_ex_types >> (public_type - OFFSET_UUID)) & 1);
+}
+
+static void dd_reader_refresh_ex_types(dd_demo_reader *dr) {
+  memset(dr->ex_public_types, -1, sizeof(dr->ex_public_types));
+  memset(dr->ex_internal_types, -1, sizeof(dr->ex_internal_types));
+
+  // EX items have the smallest keys, in a sorted snapshot they all come first
+  const dd_snapshot *snap = (const dd_snapshot *)dr->last_snapshot_data;
+  for (int i = 0; i < snap->num_items; i++) {
+    const dd_snap_item *item = dd_snap_get_item(snap, i);
+    if (dd_snap_item_type(item) != DD_NETOBJTYPE_EX) {
+      if (dr->last_sorted) break;
+      continue;
+    }
+    int index = DD_MAX_TYPE - dd_snap_item_id(item);
+    if (index < 0 || index >= MAX_EXTENDED_ITEM_TYPES || dd_snap_get_item_size(snap, i) < 16) continue;
+    int public_type = dd_uuid_lookup(dd_snap_item_data(item));
+    if (public_type < 0) continue;
+    dr->ex_public_types[index] = (short)public_type;
+    dr->ex_internal_types[public_type - OFFSET_UUID] = (short)dd_snap_item_id(item);
+  }
+  dr->ex_types_dirty = false;
+}
+
+static int dd_reader_public_type(dd_demo_reader *dr, int type) {
+  int index = DD_MAX_TYPE - type;
+  if (index < 0 || index >= MAX_EXTENDED_ITEM_TYPES) return type;
+  if (dr->ex_types_dirty) dd_reader_refresh_ex_types(dr);
+  return dr->ex_public_types[index];
+}
+
+int demo_r_item_type(dd_demo_reader *dr, const dd_snap_item *item) { return dd_reader_public_type(dr, dd_snap_item_type(item)); }
+
+const dd_snap_item *demo_r_find_item(dd_demo_reader *dr, const dd_snapshot *snap, int type, int id) {
+  if (type >= OFFSET_UUID) {
+    if (type - OFFSET_UUID >= MAX_EXTENDED_ITEM_TYPES) return NULL;
+    if (dr->ex_types_dirty) dd_reader_refresh_ex_types(dr);
+    type = dr->ex_internal_types[type - OFFSET_UUID];
+    if (type < 0) return NULL;
+  }
+  return dr->last_sorted ? dd_snap_find_item_sorted(snap, type, id) : dd_snap_find_item(snap, type, id);
+}
+
+/* Index of an extended internal type among the extended types of a snapshot, -1 for other types. */
+static int dd_extended_index(int type) {
+  int index = DD_MAX_TYPE - type;
+  return index >= 0 && index < MAX_EXTENDED_ITEM_TYPES ? index : -1;
+}
+
+/*
+ * The hidden snapshot holds the items of extended types a subscription drops. Extended type indices are assigned per
+ * snapshot, so an index can name a subscribed type later on, and the item is then updated in place, diffed against
+ * data the projection doesn't have. The allocation also holds the next hidden snapshot and the payloads a delta
+ * brings back.
+ */
+static bool dd_reader_alloc_hidden(dd_demo_reader *dr) {
+  if (dr->hidden_buffers) return true;
+  dr->hidden_buffers = (uint8_t *)malloc((size_t)DD_MAX_SNAPSHOT_SIZE * 3);
+  if (!dr->hidden_buffers) return false;
+  dr->hidden_snapshot = dr->hidden_buffers;
+  dr->hidden_next = dr->hidden_buffers + DD_MAX_SNAPSHOT_SIZE;
+  dr->hidden_payloads = dr->hidden_buffers + DD_MAX_SNAPSHOT_SIZE * 2;
+  memset(dr->hidden_snapshot, 0, sizeof(dd_snapshot));
+  return true;
+}
+
+static void dd_reader_clear_hidden(dd_demo_reader *dr) {
+  if (dr->hidden_snapshot) memset(dr->hidden_snapshot, 0, sizeof(dd_snapshot));
+}
+
+static const dd_snapshot *dd_reader_hidden(const dd_demo_reader *dr) {
+  const dd_snapshot *hidden = (const dd_snapshot *)dr->hidden_snapshot;
+  return hidden && hidden->num_items > 0 ? hidden : NULL;
+}
+
+/* Makes the snapshot just built in hidden_next the hidden one. */
+static void dd_reader_swap_hidden(dd_demo_reader *dr) {
+  uint8_t *next = dr->hidden_next;
+  dr->hidden_next = dr->hidden_snapshot;
+  dr->hidden_snapshot = next;
+}
+
+/* The current snapshot with the hidden items merged back in, for storing it and projecting it again later. */
+static const dd_snapshot *dd_reader_full_snapshot(dd_demo_reader *dr) {
+  const dd_snapshot *snap = (const dd_snapshot *)dr->last_snapshot_data;
+  const dd_snapshot *hidden = dd_reader_hidden(dr);
+  if (!hidden) return snap;
+
+  dd_snapshot_builder *sb = dr->unpack_builder;
+  demo_sb_clear_into(sb, dr->hidden_payloads, snap->num_items + hidden->num_items);
+  const dd_snapshot *parts[2] = {snap, hidden};
+  for (int p = 0; p < 2; p++) {
+    for (int i = 0; i < parts[p]->num_items; i++) {
+      const dd_snap_item *item = dd_snap_get_item(parts[p], i);
+      int item_size = dd_snap_get_item_size(parts[p], i);
+      void *obj = demo_sb_add_raw_item(sb, dd_snap_item_type(item), dd_snap_item_id(item), item_size);
+      if (obj) memcpy(obj, dd_snap_item_data(item), item_size);
+    }
+  }
+  return demo_sb_finish(sb, NULL) > 0 ? (const dd_snapshot *)dr->hidden_payloads : snap;
+}
+
+/* Drops the items of unsubscribed types from `snap` in place and returns its new size. Dropped items of extended
+ * types become the hidden snapshot. */
+static int dd_reader_project_snapshot(dd_demo_reader *dr, dd_snapshot *snap) {
+  int size = sizeof(dd_snapshot) + sizeof(int) * snap->num_items + snap->data_size;
+  dd_reader_clear_hidden(dr);
+  if (dr->subscribe_all) return size;
+
+  // decide before moving anything, the EX items are looked up in the unmodified snapshot
+  bool sorted = dd_snap_is_sorted(snap);
+  bool keep[DD_MAX_SNAPSHOT_ITEMS];
+  int offsets[DD_MAX_SNAPSHOT_ITEMS + 1];
+  for (int i = 0; i < snap->num_items; i++) {
+    int type = dd_snap_item_type(dd_snap_get_item(snap, i));
+    const int *ex_data = NULL;
+    if (type >= 64 && type != DD_NETOBJTYPE_EX) {
+      int ex_index = dd_snap_find_index(snap, (DD_NETOBJTYPE_EX << 16) | type, sorted);
+      if (ex_index >= 0) ex_data = dd_snap_item_data(dd_snap_get_item(snap, ex_index));
+    }
+    keep[i] = dd_reader_subscribed(dr, type, ex_data);
+    offsets[i] = dd_snap_offsets(snap)[i];
+  }
+  offsets[snap->num_items] = snap->data_size;
+
+  int num_hidden = 0;
+  for (int i = 0; i < snap->num_items; i++)
+    num_hidden += !keep[i] && dd_extended_index(dd_snap_item_type(dd_snap_get_item(snap, i))) >= 0;
+  if (num_hidden > 0 && dd_reader_alloc_hidden(dr)) {
+    dd_snapshot_builder *sb = dr->unpack_builder;
+    demo_sb_clear_into(sb, dr->hidden_next, num_hidden);
+    for (int i = 0; i < snap->num_items; i++) {
+      const dd_snap_item *item = dd_snap_get_item(snap, i);
+      if (keep[i] || dd_extended_index(dd_snap_item_type(item)) < 0) continue;
+      int item_size = offsets[i + 1] - offsets[i] - (int)sizeof(dd_snap_item);
+      void *obj = demo_sb_add_raw_item(sb, dd_snap_item_type(item), dd_snap_item_id(item), item_size);
+      if (obj) memcpy(obj, dd_snap_item_data(item), item_size);
+    }
+    if (demo_sb_finish(sb, NULL) > 0) dd_reader_swap_hidden(dr);
+  }
+
+  // the offsets table shrinks, so kept items only ever move towards the front
+  const uint8_t *old_data = (const uint8_t *)(dd_snap_offsets(snap) + snap->num_items);
+  int num_kept = 0;
+  for (int i = 0; i < snap->num_items; i++)
+    num_kept += keep[i];
+  uint8_t *new_data = (uint8_t *)(dd_snap_offsets(snap) + num_kept);
+
+  int k = 0, data_size = 0;
+  for (int i = 0; i < snap->num_items; i++) {
+    if (!keep[i]) continue;
+    int item_size = offsets[i + 1] - offsets[i];
+    memmove(new_data + data_size, old_data + offsets[i], item_size);
+    dd_snap_offsets(snap)[k++] = data_size;
+    data_size += item_size;
+  }
+  snap->num_items = num_kept;
+  snap->data_size = data_size;
+  return sizeof(dd_snapshot) + sizeof(int) * num_kept + data_size;
+}
+
+static bool dd_reader_read_chunk(dd_demo_reader *dr, dd_demo_chunk *chunk, bool decode) {
   uint8_t header_byte;
+  dr->positioned = false;
 
   while (fread(&header_byte, 1, 1, dr->file) == 1) {
     if (header_byte & DD_CHUNKTYPEFLAG_TICKMARKER) {
@@ -1840,21 +3500,33 @@ bool demo_r_next_chunk(dd_demo_reader *dr, dd_demo_chunk *chunk) {
       size = (size_bytes[1] << 8) | size_bytes[0];
     }
 
-    uint8_t compressed_data[DD_MAX_PAYLOAD];
-    if ((int)fread(compressed_data, 1, size, dr->file) != size) return false;
-
-    int decompressed_size = dd_data_decompress(&dr->huffman, compressed_data, size, dr->chunk_data, sizeof(dr->chunk_data));
-    if (decompressed_size < 0) return false;
+    if ((int)fread(dr->raw_chunk_data, 1, size, dr->file) != size) return false;
 
     chunk->tick = dr->current_tick;
     chunk->is_keyframe = false;
+    if (!decode) {
+      if (type != DD_CHUNKTYPE_SNAPSHOT && type != DD_CHUNKTYPE_DELTA && type != DD_CHUNKTYPE_MESSAGE) continue;
+      chunk->type = type == DD_CHUNKTYPE_SNAPSHOT ? DD_CHUNK_SNAP : type == DD_CHUNKTYPE_DELTA ? DD_CHUNK_SNAP_DELTA : DD_CHUNK_MSG;
+      chunk->size = size;
+      chunk->data = dr->raw_chunk_data;
+      if (type != DD_CHUNKTYPE_MESSAGE) dr->snapshot_tick = -1; // the snapshot state can't follow undecoded chunks
+      return true;
+    }
+
+    int decompressed_size = dd_data_decompress(&dr->huffman, dr->raw_chunk_data, size, dr->chunk_data, sizeof(dr->chunk_data));
+    if (decompressed_size < 0) return false;
+
     chunk->size = decompressed_size;
     chunk->data = dr->chunk_data;
 
     switch (type) {
     case DD_CHUNKTYPE_SNAPSHOT:
       chunk->type = DD_CHUNK_SNAP;
+      chunk->size = dd_reader_project_snapshot(dr, (dd_snapshot *)dr->chunk_data);
       memcpy(dr->last_snapshot_data, chunk->data, chunk->size);
+      dr->last_sorted = dd_snap_is_sorted((const dd_snapshot *)dr->last_snapshot_data);
+      dr->ex_types_dirty = true;
+      dr->snapshot_tick = chunk->tick;
       break;
     case DD_CHUNKTYPE_DELTA:
       chunk->type = DD_CHUNK_SNAP_DELTA;
@@ -1870,122 +3542,3478 @@ bool demo_r_next_chunk(dd_demo_reader *dr, dd_demo_chunk *chunk) {
   return false;
 }
 
-static void undiff_item(const int *past, const int *diff, int *out, int size) {
+bool demo_r_next_chunk(dd_demo_reader *dr, dd_demo_chunk *chunk) { return dd_reader_read_chunk(dr, chunk, true); }
+
+bool demo_r_next_raw_chunk(dd_demo_reader *dr, dd_demo_chunk *chunk) { return dd_reader_read_chunk(dr, chunk, false); }
+
+bool demo_r_read_map(dd_demo_reader *dr, void *map_data) {
+  int64_t pos = dd_ftell(dr->file);
+  if (pos < 0 || dd_fseek(dr->file, dr->chunks_start - dr->info.map_size, SEEK_SET) != 0) return false;
+  bool ok = fread(map_data, 1, dr->info.map_size, dr->file) == dr->info.map_size;
+  return dd_fseek(dr->file, pos, SEEK_SET) == 0 && ok;
+}
+
+static void undiff_item(const int *past, const int *diff, int *out, int size) {
   while (size--) {
     *out++ = (uint32_t)*past++ + (uint32_t)*diff++;
   }
 }
 
-int demo_r_unpack_delta(dd_demo_reader *dr, const void *delta_data, int delta_size, void *unpacked_snap_data) {
-  dd_snap_delta *delta = (dd_snap_delta *)delta_data;
-  dd_snapshot *from = (dd_snapshot *)dr->last_snapshot_data;
-  dd_snapshot_builder *sb = demo_sb_create();
-
-  const int *deleted_items = delta->data;
-  const int *updated_items = deleted_items + delta->num_deleted_items;
+/* Payload size of an update of `type`, read from the entry at `*p` for types without a known size; -1 if cut off. */
+static int dd_delta_item_size(const dd_demo_reader *dr, int type, const int **p, const int *data_end) {
+  if (type >= 0 && type < DD_MAX_NETOBJSIZES && dr->item_sizes[type]) return dr->item_sizes[type];
+  if (*p + 1 > data_end) return -1;
+  return *(*p)++ * (int)sizeof(int);
+}
 
-  // 1. Copy non-deleted and non-updated items from `from` snapshot
+/* Which extended type indices name a subscribed type once the delta is applied: the EX items of the current snapshot
+ * with the delta's EX deletions and updates on top, an EX item updated in place is undiffed to get its new UUID. */
+static bool dd_delta_resolve_ex(const dd_demo_reader *dr, dd_parsed_delta *pd, const int *p, int num_updates, const int *data_end) {
+  const dd_snapshot *from = (const dd_snapshot *)dr->last_snapshot_data;
+  memset(pd->ex_subscribed, 0, sizeof(pd->ex_subscribed));
   for (int i = 0; i < from->num_items; i++) {
-    const dd_snap_item *from_item = dd_snap_get_item(from, i);
-    bool is_deleted = false;
-    for (int d = 0; d < delta->num_deleted_items; d++) {
-      if (deleted_items[d] == dd_snap_item_key(from_item)) {
-        is_deleted = true;
-        break;
-      }
+    const dd_snap_item *item = dd_snap_get_item(from, i);
+    if (dd_snap_item_type(item) != DD_NETOBJTYPE_EX) {
+      if (dr->last_sorted) break;
+      continue;
     }
-    if (is_deleted) continue;
+    int index = dd_extended_index(dd_snap_item_id(item));
+    if (index >= 0) pd->ex_subscribed[index] = dd_snap_get_item_size(from, i) >= 16 && dd_reader_subscribed(dr, dd_snap_item_id(item), dd_snap_item_data(item));
+  }
+  for (int d = 0; d < pd->num_deleted; d++) {
+    int index = (pd->deleted[d] >> 16) == DD_NETOBJTYPE_EX ? dd_extended_index(pd->deleted[d] & 0xffff) : -1;
+    if (index >= 0) pd->ex_subscribed[index] = false;
+  }
 
-    bool is_updated = false;
-    const int *p = updated_items;
-    for (int j = 0; j < delta->num_update_items; j++) {
-      int type = *p++;
-      int id = *p++;
-      int item_size;
-      if (type >= 0 && type < DD_MAX_NETOBJSIZES && dr->item_sizes[type]) {
-        item_size = dr->item_sizes[type];
-      } else {
-        item_size = (*p++) * sizeof(int);
+  for (int n = 0; n < num_updates; n++) {
+    if (p + 2 > data_end) return false;
+    int type = *p++;
+    int id = *p++;
+    int item_size = dd_delta_item_size(dr, type, &p, data_end);
+    if (item_size < 0 || p + item_size / 4 > data_end) return false;
+    int index = type == DD_NETOBJTYPE_EX ? dd_extended_index(id) : -1;
+    if (index >= 0) {
+      int uuid[4];
+      if (item_size >= 16) {
+        int from_index = dd_snap_find_index(from, (type << 16) | id, dr->last_sorted);
+        if (from_index >= 0) undiff_item(dd_snap_item_data(dd_snap_get_item(from, from_index)), p, uuid, 4);
+        else memcpy(uuid, p, sizeof(uuid));
       }
+      pd->ex_subscribed[index] = item_size >= 16 && dd_reader_subscribed(dr, id, uuid);
+    }
+    p += item_size / 4;
+  }
+  return true;
+}
 
-      if (dd_snap_item_type(from_item) == type && dd_snap_item_id(from_item) == id) {
-        is_updated = true;
-        break;
+static bool dd_delta_subscribed(const dd_demo_reader *dr, const dd_parsed_delta *pd, int type) {
+  int index = dd_extended_index(type);
+  return index >= 0 ? pd->ex_subscribed[index] : dd_reader_subscribed(dr, type, NULL);
+}
+
+/* With a subscription, the parse also moves extended items between the projection and the hidden snapshot when their
+ * type index changes sides. Payloads it has to materialize go to hidden_payloads. */
+static bool dd_delta_parse(const dd_demo_reader *dr, const void *delta_data, int delta_size, dd_parsed_delta *pd) {
+  const dd_snap_delta *delta = (const dd_snap_delta *)delta_data;
+  const dd_snapshot *from = (const dd_snapshot *)dr->last_snapshot_data;
+  if (delta_size < (int)sizeof(int) * 3 || delta->num_deleted_items < 0 || delta->num_update_items < 0) return false;
+  if (delta->num_deleted_items > DD_MAX_SNAPSHOT_ITEMS || delta->num_update_items > DD_MAX_SNAPSHOT_ITEMS) return false;
+
+  const int *data_end = (const int *)((const uint8_t *)delta_data + delta_size);
+  pd->deleted = delta->data;
+  pd->num_deleted = delta->num_deleted_items;
+  if (pd->deleted + pd->num_deleted > data_end) return false;
+
+  // lookups are binary searches when the current snapshot is sorted
+  const dd_snapshot *hidden = dr->subscribe_all ? NULL : dd_reader_hidden(dr);
+  if (hidden) memset(pd->hidden_used, 0, sizeof(bool) * hidden->num_items);
+  pd->structural = false;
+  pd->ex_changed = false;
+  pd->num_dropped = 0;
+  pd->num_hidden_updates = 0;
+  pd->hidden_changed = false;
+  for (int d = 0; d < pd->num_deleted; d++) {
+    pd->deleted_from[d] = dd_snap_find_index(from, pd->deleted[d], dr->last_sorted);
+    pd->structural |= pd->deleted_from[d] >= 0;
+    pd->ex_changed |= pd->deleted_from[d] >= 0 && (pd->deleted[d] >> 16) == DD_NETOBJTYPE_EX;
+    int h = hidden ? dd_snap_find_index(hidden, pd->deleted[d], true) : -1;
+    if (h >= 0) pd->hidden_used[h] = pd->hidden_changed = true;
+  }
+
+  pd->num_updates = 0;
+  pd->updates_in_order = true;
+  const int *p = pd->deleted + pd->num_deleted;
+  if (!dr->subscribe_all && !dd_delta_resolve_ex(dr, pd, p, delta->num_update_items, data_end)) return false;
+  int payload_size = 0;
+  for (int n = 0; n < delta->num_update_items; n++) {
+    if (p + 2 > data_end) return false;
+    int type = *p++;
+    int id = *p++;
+    int item_size = dd_delta_item_size(dr, type, &p, data_end);
+    if (item_size < 0 || p + item_size / 4 > data_end) return false;
+    int key = (type << 16) | id;
+
+    if (!dr->subscribe_all && !dd_delta_subscribed(dr, pd, type)) {
+      // the item stays out of the projected snapshot, extended ones are kept in the hidden snapshot
+      if (dd_extended_index(type) >= 0) {
+        int u = pd->num_hidden_updates++;
+        pd->hidden_keys[u] = key;
+        pd->hidden_sizes[u] = item_size;
+        pd->hidden_data[u] = p;
+        pd->hidden_from[u] = hidden ? dd_snap_find_index(hidden, key, true) : -1;
+        pd->projected_from[u] = dd_snap_find_index(from, key, dr->last_sorted);
+        if (pd->hidden_from[u] >= 0) pd->hidden_used[pd->hidden_from[u]] = true;
+        if (pd->projected_from[u] >= 0) pd->dropped_from[pd->num_dropped++] = pd->projected_from[u];
+        pd->structural |= pd->projected_from[u] >= 0;
+        pd->hidden_changed = true;
       }
       p += item_size / 4;
+      continue;
+    }
+
+    int i = pd->num_updates++;
+    pd->update_keys[i] = key;
+    pd->update_sizes[i] = item_size;
+    pd->update_data[i] = p;
+    pd->update_from[i] = dd_snap_find_index(from, key, dr->last_sorted);
+    int h = pd->update_from[i] < 0 && hidden ? dd_snap_find_index(hidden, key, true) : -1;
+    if (h >= 0) {
+      // the type index now names a subscribed type, the diff is against the hidden item
+      if (payload_size + item_size > DD_MAX_SNAPSHOT_SIZE) return false;
+      int *payload = (int *)(dr->hidden_payloads + payload_size);
+      undiff_item(dd_snap_item_data(dd_snap_get_item(hidden, h)), p, payload, item_size / 4);
+      pd->update_data[i] = payload;
+      payload_size += item_size;
+      pd->hidden_used[h] = pd->hidden_changed = true;
+    }
+    pd->structural |= pd->update_from[i] < 0 || dd_snap_get_item_size(from, pd->update_from[i]) != item_size;
+    if (i > 0 && pd->update_keys[i] < pd->update_keys[i - 1]) pd->updates_in_order = false;
+    pd->ex_changed |= type == DD_NETOBJTYPE_EX;
+    p += item_size / 4;
+  }
+  if (dr->subscribe_all || !pd->ex_changed) return true;
+
+  // items the delta doesn't touch change sides when their type index does
+  bool touched[DD_MAX_SNAPSHOT_ITEMS];
+  memset(touched, 0, sizeof(bool) * from->num_items);
+  for (int d = 0; d < pd->num_deleted; d++) {
+    if (pd->deleted_from[d] >= 0) touched[pd->deleted_from[d]] = true;
+  }
+  for (int i = 0; i < pd->num_updates; i++) {
+    if (pd->update_from[i] >= 0) touched[pd->update_from[i]] = true;
+  }
+  for (int d = 0; d < pd->num_dropped; d++)
+    touched[pd->dropped_from[d]] = true;
+  for (int i = 0; i < from->num_items; i++) {
+    int index = dd_extended_index(dd_snap_item_type(dd_snap_get_item(from, i)));
+    if (touched[i] || index < 0 || pd->ex_subscribed[index]) continue;
+    pd->dropped_from[pd->num_dropped++] = i;
+    pd->structural = pd->hidden_changed = true;
+  }
+  for (int h = 0; hidden && h < hidden->num_items; h++) {
+    const dd_snap_item *item = dd_snap_get_item(hidden, h);
+    int index = dd_extended_index(dd_snap_item_type(item));
+    if (pd->hidden_used[h] || index < 0 || !pd->ex_subscribed[index]) continue;
+    int item_size = dd_snap_get_item_size(hidden, h);
+    if (pd->num_updates == DD_MAX_SNAPSHOT_ITEMS || payload_size + item_size > DD_MAX_SNAPSHOT_SIZE) return false;
+    memcpy(dr->hidden_payloads + payload_size, dd_snap_item_data(item), item_size);
+    int i = pd->num_updates++;
+    pd->update_keys[i] = item->type_and_id;
+    pd->update_sizes[i] = item_size;
+    pd->update_data[i] = (const int *)(dr->hidden_payloads + payload_size);
+    pd->update_from[i] = -1;
+    if (i > 0 && pd->update_keys[i] < pd->update_keys[i - 1]) pd->updates_in_order = false;
+    payload_size += item_size;
+    pd->structural = pd->hidden_used[h] = pd->hidden_changed = true;
+  }
+  return true;
+}
+
+/* Rebuilds the hidden snapshot for a parsed delta, before the current snapshot is replaced. */
+static bool dd_reader_update_hidden(dd_demo_reader *dr, const dd_parsed_delta *pd) {
+  if (!pd->hidden_changed) return true;
+  if (!dd_reader_alloc_hidden(dr)) return false;
+  const dd_snapshot *from = (const dd_snapshot *)dr->last_snapshot_data;
+  const dd_snapshot *hidden = (const dd_snapshot *)dr->hidden_snapshot;
+
+  dd_snapshot_builder *sb = dr->unpack_builder;
+  demo_sb_clear_into(sb, dr->hidden_next, DD_MAX_SNAPSHOT_ITEMS);
+  for (int h = 0; h < hidden->num_items; h++) {
+    if (pd->hidden_used[h]) continue;
+    const dd_snap_item *item = dd_snap_get_item(hidden, h);
+    int item_size = dd_snap_get_item_size(hidden, h);
+    void *obj = demo_sb_add_raw_item(sb, dd_snap_item_type(item), dd_snap_item_id(item), item_size);
+    if (obj) memcpy(obj, dd_snap_item_data(item), item_size);
+  }
+
+  bool updated[DD_MAX_SNAPSHOT_ITEMS];
+  memset(updated, 0, sizeof(bool) * from->num_items);
+  for (int u = 0; u < pd->num_hidden_updates; u++) {
+    const int *base = NULL;
+    if (pd->hidden_from[u] >= 0) {
+      base = dd_snap_item_data(dd_snap_get_item(hidden, pd->hidden_from[u]));
+    } else if (pd->projected_from[u] >= 0) {
+      base = dd_snap_item_data(dd_snap_get_item(from, pd->projected_from[u]));
+      updated[pd->projected_from[u]] = true;
     }
+    int key = pd->hidden_keys[u];
+    void *obj = demo_sb_add_raw_item(sb, key >> 16, key & 0xffff, pd->hidden_sizes[u]);
+    if (!obj) continue;
+    if (base) undiff_item(base, pd->hidden_data[u], (int *)obj, pd->hidden_sizes[u] / 4);
+    else memcpy(obj, pd->hidden_data[u], pd->hidden_sizes[u]);
+  }
+  for (int d = 0; d < pd->num_dropped; d++) {
+    int index = pd->dropped_from[d];
+    if (updated[index]) continue;
+    const dd_snap_item *item = dd_snap_get_item(from, index);
+    int item_size = dd_snap_get_item_size(from, index);
+    void *obj = demo_sb_add_raw_item(sb, dd_snap_item_type(item), dd_snap_item_id(item), item_size);
+    if (obj) memcpy(obj, dd_snap_item_data(item), item_size);
+  }
+
+  if (demo_sb_finish(sb, NULL) < 0) return false;
+  dd_reader_swap_hidden(dr);
+  return true;
+}
+
+/* Rebuilds the current snapshot with the parsed delta applied into `unpacked_snap_data` and makes it the new base. */
+static int dd_delta_apply(dd_demo_reader *dr, const dd_parsed_delta *pd, void *unpacked_snap_data) {
+  dd_snapshot *from = (dd_snapshot *)dr->last_snapshot_data;
+
+  // 1. Mark deleted and updated items of `from`
+  bool skip[DD_MAX_SNAPSHOT_ITEMS];
+  memset(skip, 0, sizeof(bool) * from->num_items);
+  for (int d = 0; d < pd->num_deleted; d++) {
+    if (pd->deleted_from[d] >= 0) skip[pd->deleted_from[d]] = true;
+  }
+  for (int i = 0; i < pd->num_updates; i++) {
+    if (pd->update_from[i] >= 0) skip[pd->update_from[i]] = true;
+  }
+  for (int d = 0; d < pd->num_dropped; d++)
+    skip[pd->dropped_from[d]] = true;
+
+  int order[DD_MAX_SNAPSHOT_ITEMS], tmp[DD_MAX_SNAPSHOT_ITEMS];
+  if (pd->updates_in_order) {
+    for (int i = 0; i < pd->num_updates; i++)
+      order[i] = i;
+  } else {
+    dd_radix_sort_items(pd->update_keys, order, tmp, pd->num_updates);
+  }
 
-    if (!is_updated) {
+  // 2. Merge the untouched items of `from` with the updated ones. With a sorted `from` the result comes out in key
+  //    order and is written straight into the caller's buffer.
+  int num_kept = 0;
+  for (int i = 0; i < from->num_items; i++)
+    num_kept += !skip[i];
+
+  dd_snapshot_builder *sb = dr->unpack_builder;
+  demo_sb_clear_into(sb, unpacked_snap_data, num_kept + pd->num_updates);
+
+  int i = 0, u = 0;
+  while (i < from->num_items || u < pd->num_updates) {
+    if (i < from->num_items && skip[i]) {
+      i++;
+      continue;
+    }
+    const dd_snap_item *from_item = i < from->num_items ? dd_snap_get_item(from, i) : NULL;
+    if (from_item && (u == pd->num_updates || from_item->type_and_id < pd->update_keys[order[u]])) {
       int item_size = dd_snap_get_item_size(from, i);
-      void *obj = demo_sb_add_item(sb, dd_snap_item_type(from_item), dd_snap_item_id(from_item), item_size);
+      void *obj = demo_sb_add_raw_item(sb, dd_snap_item_type(from_item), dd_snap_item_id(from_item), item_size);
       if (obj) memcpy(obj, dd_snap_item_data(from_item), item_size);
+      i++;
+      continue;
+    }
+
+    int index = order[u++];
+    int key = pd->update_keys[index];
+    void *new_data = demo_sb_add_raw_item(sb, key >> 16, key & 0xffff, pd->update_sizes[index]);
+    if (!new_data) continue;
+    if (pd->update_from[index] >= 0) {
+      undiff_item(dd_snap_item_data(dd_snap_get_item(from, pd->update_from[index])), pd->update_data[index], (int *)new_data, pd->update_sizes[index] / 4);
+    } else {
+      memcpy(new_data, pd->update_data[index], pd->update_sizes[index]);
+    }
+  }
+
+  int final_size = demo_sb_finish(sb, NULL);
+  if (final_size > 0) {
+    memcpy(dr->last_snapshot_data, unpacked_snap_data, final_size);
+    dr->last_sorted = true; // the builder emits items in key order
+  }
+
+  return final_size;
+}
+
+int demo_r_unpack_delta(dd_demo_reader *dr, const void *delta_data, int delta_size, void *unpacked_snap_data) {
+  dd_parsed_delta *pd = &dr->parsed_delta;
+  if (!dd_delta_parse(dr, delta_data, delta_size, pd) || !dd_reader_update_hidden(dr, pd)) return -1;
+  dr->ex_types_dirty |= pd->ex_changed;
+  int size = dd_delta_apply(dr, pd, unpacked_snap_data);
+  if (size > 0) dr->snapshot_tick = dr->current_tick;
+  return size;
+}
+
+static uint8_t *dd_reader_scratch(dd_demo_reader *dr) {
+  if (!dr->scratch_snapshot) dr->scratch_snapshot = (uint8_t *)malloc(DD_MAX_SNAPSHOT_SIZE);
+  return dr->scratch_snapshot;
+}
+
+int demo_r_visit_delta(dd_demo_reader *dr, const void *delta_data, int delta_size, const dd_delta_visitor *visitor, void *user, void *unpacked_snap) {
+  dd_parsed_delta *pd = &dr->parsed_delta;
+  if (!dd_delta_parse(dr, delta_data, delta_size, pd) || !dd_reader_update_hidden(dr, pd)) return -1;
+  dr->ex_types_dirty |= pd->ex_changed;
+  uint8_t *scratch = dd_reader_scratch(dr);
+  if (!scratch) return -1;
+
+  dd_snapshot *from = (dd_snapshot *)dr->last_snapshot_data;
+  for (int d = 0; d < pd->num_deleted; d++) {
+    int index = pd->deleted_from[d];
+    if (index < 0 || !visitor->item_removed) continue;
+    visitor->item_removed(user, pd->deleted[d], dd_snap_item_data(dd_snap_get_item(from, index)), NULL, dd_snap_get_item_size(from, index));
+  }
+  for (int d = 0; d < pd->num_dropped && visitor->item_removed; d++) {
+    const dd_snap_item *item = dd_snap_get_item(from, pd->dropped_from[d]);
+    visitor->item_removed(user, item->type_and_id, dd_snap_item_data(item), NULL, dd_snap_get_item_size(from, pd->dropped_from[d]));
+  }
+
+  for (int i = 0; i < pd->num_updates; i++) {
+    int index = pd->update_from[i];
+    if (index < 0) {
+      if (visitor->item_added) visitor->item_added(user, pd->update_keys[i], NULL, pd->update_data[i], pd->update_sizes[i]);
+      continue;
+    }
+    int *old_data = dd_snap_item_data(dd_snap_get_item(from, index));
+    int *new_data = (int *)scratch;
+    undiff_item(old_data, pd->update_data[i], new_data, pd->update_sizes[i] / 4);
+    if (visitor->item_updated) visitor->item_updated(user, pd->update_keys[i], old_data, new_data, pd->update_sizes[i]);
+    // pure updates are applied in place, the snapshot only gets rebuilt when items come or go
+    if (!pd->structural) memcpy(old_data, new_data, pd->update_sizes[i]);
+  }
+
+  int size;
+  if (pd->structural) {
+    size = dd_delta_apply(dr, pd, unpacked_snap ? unpacked_snap : scratch);
+  } else {
+    size = sizeof(dd_snapshot) + sizeof(int) * from->num_items + from->data_size;
+    if (unpacked_snap) memcpy(unpacked_snap, from, size);
+  }
+  // a visitor looking up types refreshed them from the old snapshot
+  dr->ex_types_dirty |= pd->ex_changed;
+  if (size > 0) dr->snapshot_tick = dr->current_tick;
+  return size;
+}
+
+/******************************************************************************
+ *
+ * DELTA COMPOSITION
+ *
+ ******************************************************************************/
+
+enum {
+  DD_COMPOSE_NONE,    // slot is unused (an addition that was cancelled by a deletion)
+  DD_COMPOSE_UPDATE,  // payload is the summed diff against the base item, or the full data if the base has no such item
+  DD_COMPOSE_DELETED, // the base item is gone
+};
+
+typedef struct {
+  int key;
+  int state;
+  int size;
+  int offset; // payload offset in data
+} dd_compose_entry;
+
+struct dd_delta_composer {
+  dd_compose_entry *entries;
+  int num_entries;
+  int max_entries;
+  int *hash; // key -> entry, -1 is empty
+  int hash_size;
+  uint8_t *data;
+  int data_size;
+  int data_capacity;
+  bool error;
+};
+
+static void dd_composer_free(dd_delta_composer *dc) {
+  if (!dc) return;
+  free(dc->entries);
+  free(dc->hash);
+  free(dc->data);
+  free(dc);
+}
+
+static unsigned dd_composer_hash_key(int key, int hash_size) {
+  unsigned h = (unsigned)key * 2654435761u;
+  return (h ^ (h >> 16)) & (hash_size - 1);
+}
+
+static bool dd_composer_grow_hash(dd_delta_composer *dc) {
+  int hash_size = dc->hash_size ? dc->hash_size * 2 : 1024;
+  int *hash = (int *)malloc(sizeof(int) * hash_size);
+  if (!hash) return false;
+  memset(hash, 0xff, sizeof(int) * hash_size);
+  for (int i = 0; i < dc->num_entries; i++) {
+    unsigned h = dd_composer_hash_key(dc->entries[i].key, hash_size);
+    while (hash[h] >= 0)
+      h = (h + 1) & (hash_size - 1);
+    hash[h] = i;
+  }
+  free(dc->hash);
+  dc->hash = hash;
+  dc->hash_size = hash_size;
+  return true;
+}
+
+/* Returns the entry for `key`, creating an unused one if needed. */
+static dd_compose_entry *dd_composer_get(dd_delta_composer *dc, int key) {
+  unsigned h = dd_composer_hash_key(key, dc->hash_size);
+  while (dc->hash[h] >= 0) {
+    if (dc->entries[dc->hash[h]].key == key) return &dc->entries[dc->hash[h]];
+    h = (h + 1) & (dc->hash_size - 1);
+  }
+
+  if (dc->num_entries >= dc->max_entries) {
+    int max_entries = dc->max_entries ? dc->max_entries * 2 : 256;
+    dd_compose_entry *entries = (dd_compose_entry *)realloc(dc->entries, sizeof(dd_compose_entry) * max_entries);
+    if (!entries) return NULL;
+    dc->entries = entries;
+    dc->max_entries = max_entries;
+  }
+  if ((dc->num_entries + 1) * 2 > dc->hash_size) {
+    if (!dd_composer_grow_hash(dc)) return NULL;
+    h = dd_composer_hash_key(key, dc->hash_size);
+    while (dc->hash[h] >= 0)
+      h = (h + 1) & (dc->hash_size - 1);
+  }
+
+  dd_compose_entry *entry = &dc->entries[dc->num_entries];
+  entry->key = key;
+  entry->state = DD_COMPOSE_NONE;
+  entry->size = 0;
+  entry->offset = -1;
+  dc->hash[h] = dc->num_entries++;
+  return entry;
+}
+
+/* Points the entry at `size` bytes of payload storage, reusing its old storage when the size matches. */
+static int *dd_composer_payload(dd_delta_composer *dc, dd_compose_entry *entry, int size) {
+  if (entry->offset < 0 || entry->size != size) {
+    if (dc->data_size + size > dc->data_capacity) {
+      int capacity = dc->data_capacity ? dc->data_capacity * 2 : DD_MAX_SNAPSHOT_SIZE;
+      while (capacity < dc->data_size + size)
+        capacity *= 2;
+      uint8_t *data = (uint8_t *)realloc(dc->data, capacity);
+      if (!data) return NULL;
+      dc->data = data;
+      dc->data_capacity = capacity;
+    }
+    entry->offset = dc->data_size;
+    entry->size = size;
+    dc->data_size += size;
+  }
+  return (int *)(dc->data + entry->offset);
+}
+
+/* The base item of `key`: in the current snapshot or, with a subscription, among the hidden extended items the
+ * composed delta will be applied to as well. NULL if there is none. */
+static const dd_snap_item *dd_composer_base_item(const dd_demo_reader *dr, int key, int *size) {
+  const dd_snapshot *base = (const dd_snapshot *)dr->last_snapshot_data;
+  int index = dd_snap_find_index(base, key, dr->last_sorted);
+  if (index < 0) {
+    base = dr->subscribe_all ? NULL : dd_reader_hidden(dr);
+    index = base ? dd_snap_find_index(base, key, true) : -1;
+  }
+  if (index < 0) return NULL;
+  *size = dd_snap_get_item_size(base, index);
+  return dd_snap_get_item(base, index);
+}
+
+void demo_r_compose_begin(dd_demo_reader *dr) {
+  if (!dr->composer) dr->composer = (dd_delta_composer *)calloc(1, sizeof(dd_delta_composer));
+  dd_delta_composer *dc = dr->composer;
+  if (!dc) return;
+  dc->num_entries = 0;
+  dc->data_size = 0;
+  dc->error = !dc->hash && !dd_composer_grow_hash(dc);
+  if (dc->hash) memset(dc->hash, 0xff, sizeof(int) * dc->hash_size);
+}
+
+bool demo_r_compose_add(dd_demo_reader *dr, const void *delta_data, int delta_size) {
+  dd_delta_composer *dc = dr->composer;
+  if (!dc || dc->error) return false;
+  const dd_snap_delta *delta = (const dd_snap_delta *)delta_data;
+  const int *data_end = (const int *)((const uint8_t *)delta_data + delta_size);
+  if (delta_size < (int)sizeof(int) * 3 || delta->num_deleted_items < 0 || delta->num_update_items < 0 ||
+      delta->data + delta->num_deleted_items > data_end) {
+    dc->error = true;
+    return false;
+  }
+
+  // deletions cancel pending additions and turn pending updates of base items into deletions
+  for (int d = 0; d < delta->num_deleted_items; d++) {
+    int key = delta->data[d];
+    dd_compose_entry *entry = dd_composer_get(dc, key);
+    if (!entry) {
+      dc->error = true;
+      return false;
     }
+    if (entry->state == DD_COMPOSE_DELETED) continue;
+    int base_size;
+    entry->state = dd_composer_base_item(dr, key, &base_size) ? DD_COMPOSE_DELETED : DD_COMPOSE_NONE;
   }
 
-  // 2. Add new and updated items from delta
-  const int *p = updated_items;
-  for (int i = 0; i < delta->num_update_items; i++) {
+  bool ok = true;
+  const int *p = delta->data + delta->num_deleted_items;
+  for (int i = 0; i < delta->num_update_items && ok; i++) {
+    if (p + 2 > data_end) {
+      ok = false;
+      break;
+    }
     int type = *p++;
     int id = *p++;
     int item_size;
-
     if (type >= 0 && type < DD_MAX_NETOBJSIZES && dr->item_sizes[type]) {
       item_size = dr->item_sizes[type];
     } else {
-      item_size = (*p++) * sizeof(int);
+      item_size = p < data_end ? (*p++) * (int)sizeof(int) : -1;
     }
-
-    const dd_snap_item *from_item = dd_snap_find_item(from, type, id);
-    void *new_data = demo_sb_add_item(sb, type, id, item_size);
-    if (!new_data) {
-        p += item_size / 4;
-        continue;
+    if (item_size < 0 || p + item_size / 4 > data_end) {
+      ok = false;
+      break;
     }
 
-    if (from_item) {
-      undiff_item(dd_snap_item_data(from_item), p, (int *)new_data, item_size / 4);
+    int key = (type << 16) | id;
+    dd_compose_entry *entry = dd_composer_get(dc, key);
+    if (!entry) {
+      ok = false;
+    } else if (entry->state == DD_COMPOSE_UPDATE) {
+      // diffs of the same item add up; a new size cannot be expressed against the base
+      int *acc = (int *)(dc->data + entry->offset);
+      if (entry->size == item_size)
+        undiff_item(acc, p, acc, item_size / 4);
+      else
+        ok = false;
+    } else if (entry->state == DD_COMPOSE_DELETED) {
+      // deleted and added again: the net change is the new data relative to the base item
+      int base_size = 0;
+      const dd_snap_item *base_item = dd_composer_base_item(dr, key, &base_size);
+      int *acc = NULL;
+      if (base_item && base_size == item_size) acc = dd_composer_payload(dc, entry, item_size);
+      if (acc) {
+        diff_item(dd_snap_item_data(base_item), p, acc, item_size / 4);
+        entry->state = DD_COMPOSE_UPDATE;
+      } else {
+        ok = false;
+      }
     } else {
-      memcpy(new_data, p, item_size);
+      int *acc = dd_composer_payload(dc, entry, item_size);
+      if (acc) {
+        memcpy(acc, p, item_size);
+        entry->state = DD_COMPOSE_UPDATE;
+      } else {
+        ok = false;
+      }
     }
     p += item_size / 4;
   }
 
-  int final_size = demo_sb_finish(sb, unpacked_snap_data);
-  demo_sb_destroy(&sb);
+  if (!ok) dc->error = true;
+  return ok;
+}
 
-  if (final_size > 0) {
-    memcpy(dr->last_snapshot_data, unpacked_snap_data, final_size);
+int demo_r_compose_finish(dd_demo_reader *dr, void *delta_out, int out_size) {
+  dd_delta_composer *dc = dr->composer;
+  if (!dc || dc->error || out_size < (int)sizeof(int) * 3) return -1;
+
+  dd_snap_delta *delta = (dd_snap_delta *)delta_out;
+  int *out = delta->data;
+  const int *out_end = (const int *)((uint8_t *)delta_out + out_size);
+  delta->num_deleted_items = 0;
+  delta->num_update_items = 0;
+  delta->num_temp_items = 0;
+
+  for (int i = 0; i < dc->num_entries; i++) {
+    if (dc->entries[i].state != DD_COMPOSE_DELETED) continue;
+    if (out + 1 > out_end) return -1;
+    *out++ = dc->entries[i].key;
+    delta->num_deleted_items++;
   }
-
-  return final_size;
+  for (int i = 0; i < dc->num_entries; i++) {
+    const dd_compose_entry *entry = &dc->entries[i];
+    if (entry->state != DD_COMPOSE_UPDATE) continue;
+    int type = entry->key >> 16;
+    bool include_size = type >= DD_MAX_NETOBJSIZES || dr->item_sizes[type] == 0;
+    if (out + 3 + entry->size / 4 > out_end) return -1;
+    *out++ = type;
+    *out++ = entry->key & 0xffff;
+    if (include_size) *out++ = entry->size / 4;
+    memcpy(out, dc->data + entry->offset, entry->size);
+    out += entry->size / 4;
+    delta->num_update_items++;
+  }
+  return (int)((uint8_t *)out - (uint8_t *)delta_out);
 }
 
 static void dd_init_netobj_sizes(short *item_sizes) {
   memset(item_sizes, 0, sizeof(short) * DD_MAX_NETOBJSIZES);
-  item_sizes[DD_NETOBJTYPE_PLAYERINPUT] = sizeof(dd_netobj_player_input);
-  item_sizes[DD_NETOBJTYPE_PROJECTILE] = sizeof(dd_netobj_projectile);
-  item_sizes[DD_NETOBJTYPE_LASER] = sizeof(dd_netobj_laser);
-  item_sizes[DD_NETOBJTYPE_PICKUP] = sizeof(dd_netobj_pickup);
-  item_sizes[DD_NETOBJTYPE_FLAG] = sizeof(dd_netobj_flag);
-  item_sizes[DD_NETOBJTYPE_GAMEINFO] = sizeof(dd_netobj_game_info);
-  item_sizes[DD_NETOBJTYPE_GAMEDATA] = sizeof(dd_netobj_game_data);
-  item_sizes[DD_NETOBJTYPE_CHARACTERCORE] = sizeof(dd_netobj_character_core);
-  item_sizes[DD_NETOBJTYPE_CHARACTER] = sizeof(dd_netobj_character);
-  item_sizes[DD_NETOBJTYPE_PLAYERINFO] = sizeof(dd_netobj_player_info);
-  item_sizes[DD_NETOBJTYPE_CLIENTINFO] = sizeof(dd_netobj_client_info);
-  item_sizes[DD_NETOBJTYPE_SPECTATORINFO] = sizeof(dd_netobj_spectator_info);
-  item_sizes[DD_NETEVENTTYPE_COMMON] = sizeof(dd_netevent_common);
-  item_sizes[DD_NETEVENTTYPE_EXPLOSION] = sizeof(dd_netevent_explosion);
-  item_sizes[DD_NETEVENTTYPE_SPAWN] = sizeof(dd_netevent_spawn);
-  item_sizes[DD_NETEVENTTYPE_HAMMERHIT] = sizeof(dd_netevent_hammer_hit);
-  item_sizes[DD_NETEVENTTYPE_DEATH] = sizeof(dd_netevent_death);
-  item_sizes[DD_NETEVENTTYPE_SOUNDGLOBAL] = sizeof(dd_netevent_sound_global);
-  item_sizes[DD_NETEVENTTYPE_SOUNDWORLD] = sizeof(dd_netevent_sound_world);
-  item_sizes[DD_NETEVENTTYPE_DAMAGEIND] = sizeof(dd_netevent_damage_ind);
+  for (int type = 0; type < DD_MAX_NETOBJSIZES; type++) {
+    const dd_netobj_type_info *info = dd_get_netobj_type(type);
+    if (info) item_sizes[type] = (short)info->size;
+  }
 }
 
 static void dd_writer_init_netobj_sizes(dd_demo_writer *dw) { dd_init_netobj_sizes(dw->item_sizes); }
 
 static void dd_reader_init_netobj_sizes(dd_demo_reader *dr) { dd_init_netobj_sizes(dr->item_sizes); }
 
+/******************************************************************************
+ *
+ * EVENT EXTRACTION
+ *
+ ******************************************************************************/
+
+#define DD_MAX_PENDING_EVENTS 256
+
+/* Event items seen while visiting a delta, their types are resolved once the delta (and its EX items) is applied. */
+typedef struct {
+  int keys[DD_MAX_PENDING_EVENTS];
+  int data[DD_MAX_PENDING_EVENTS][3];
+  int num_pending;
+} dd_event_items;
+
+static void dd_event_item_changed(void *user, int key, const int *old_data, const int *new_data, int size) {
+  (void)old_data;
+  dd_event_items *items = (dd_event_items *)user;
+  if ((key >> 16) == DD_NETOBJTYPE_EX || items->num_pending >= DD_MAX_PENDING_EVENTS) return;
+  int *data = items->data[items->num_pending];
+  memset(data, 0, sizeof(items->data[0]));
+  memcpy(data, new_data, size < (int)sizeof(items->data[0]) ? size : (int)sizeof(items->data[0]));
+  items->keys[items->num_pending++] = key;
+}
+
+static bool dd_event_from_item(int type, const int *data, int tick, unsigned event_mask, dd_event *event) {
+  memset(event, 0, sizeof(*event));
+  event->tick = tick;
+  event->client_id = -1;
+  event->data[0] = data[0];
+  event->data[1] = data[1];
+  if (type == DD_NETEVENTTYPE_DEATH && (event_mask & DD_EVENT_MASK(DD_EVENT_DEATH))) {
+    event->type = DD_EVENT_DEATH;
+    event->client_id = data[2];
+    return true;
+  }
+  if (type == DD_NETEVENTTYPE_FINISH && (event_mask & DD_EVENT_MASK(DD_EVENT_FINISH))) {
+    event->type = DD_EVENT_FINISH;
+    return true;
+  }
+  return false;
+}
+
+static bool dd_event_from_msg(const dd_demo_chunk *chunk, unsigned event_mask, dd_event *event) {
+  dd_msg_unpacker unpacker;
+  demo_msg_unpack_init(&unpacker, chunk->data, chunk->size);
+  bool system;
+  int msg_id = demo_msg_get_header(&unpacker, &system);
+  if (system) return false;
+
+  memset(event, 0, sizeof(*event));
+  event->tick = chunk->tick;
+  if (msg_id == DD_NETMSGTYPE_SV_CHAT && (event_mask & DD_EVENT_MASK(DD_EVENT_CHAT))) {
+    event->type = DD_EVENT_CHAT;
+    event->data[0] = demo_msg_get_int(&unpacker);
+    event->client_id = demo_msg_get_int(&unpacker);
+    dd_str_view text = demo_msg_get_string(&unpacker);
+    event->text = text.str;
+    event->text_len = text.len;
+  } else if (msg_id == DD_NETMSGTYPE_SV_KILLMSG && (event_mask & DD_EVENT_MASK(DD_EVENT_KILL))) {
+    dd_netmsg_sv_killmsg msg;
+    if (!demo_msg_decode_sv_killmsg(&unpacker, &msg)) return false;
+    event->type = DD_EVENT_KILL;
+    event->client_id = msg.m_Victim;
+    event->data[0] = msg.m_Killer;
+    event->data[1] = msg.m_Weapon;
+    event->data[2] = msg.m_ModeSpecial;
+  } else if (msg_id == DD_NETMSGTYPE_SV_RACEFINISH && (event_mask & DD_EVENT_MASK(DD_EVENT_RACE_FINISH))) {
+    dd_netmsg_sv_race_finish msg;
+    if (!demo_msg_decode_sv_race_finish(&unpacker, &msg)) return false;
+    event->type = DD_EVENT_RACE_FINISH;
+    event->client_id = msg.m_ClientId;
+    event->data[0] = msg.m_Time;
+    event->data[1] = msg.m_Diff;
+    event->data[2] = msg.m_RecordPersonal;
+    event->data[3] = msg.m_RecordServer;
+  } else {
+    return false;
+  }
+  return !unpacker.error;
+}
+
+int demo_extract_events(dd_demo_reader *dr, unsigned event_mask, dd_event_fn callback, void *user) {
+  unsigned item_events = event_mask & (DD_EVENT_MASK(DD_EVENT_DEATH) | DD_EVENT_MASK(DD_EVENT_FINISH));
+  int types[2], num_types = 0;
+  if (event_mask & DD_EVENT_MASK(DD_EVENT_DEATH)) types[num_types++] = DD_NETEVENTTYPE_DEATH;
+  if (event_mask & DD_EVENT_MASK(DD_EVENT_FINISH)) types[num_types++] = DD_NETEVENTTYPE_FINISH;
+  demo_r_subscribe_types(dr, types, num_types);
+
+  dd_delta_visitor visitor = {NULL, dd_event_item_changed, dd_event_item_changed};
+  dd_event_items items;
+  dd_demo_chunk chunk;
+  dd_event event;
+  int num_events = 0;
+
+  while (demo_r_next_chunk(dr, &chunk)) {
+    switch (chunk.type) {
+    case DD_CHUNK_SNAP: {
+      if (!item_events) break;
+      // keyframes come projected, every item left is an event or an EX item
+      const dd_snapshot *snap = (const dd_snapshot *)chunk.data;
+      for (int i = 0; i < snap->num_items; i++) {
+        const dd_snap_item *item = dd_snap_get_item(snap, i);
+        int data[3] = {0, 0, 0};
+        int size = dd_snap_get_item_size(snap, i);
+        memcpy(data, dd_snap_item_data(item), size < (int)sizeof(data) ? size : (int)sizeof(data));
+        if (!dd_event_from_item(demo_r_item_type(dr, item), data, chunk.tick, event_mask, &event)) continue;
+        callback(user, &event);
+        num_events++;
+      }
+      break;
+    }
+    case DD_CHUNK_SNAP_DELTA:
+      if (!item_events) break;
+      // an event shows up as an added item, or as an update when its key was used by the previous tick's event
+      items.num_pending = 0;
+      if (demo_r_visit_delta(dr, chunk.data, chunk.size, &visitor, &items, NULL) < 0) return -1;
+      for (int i = 0; i < items.num_pending; i++) {
+        if (!dd_event_from_item(dd_reader_public_type(dr, items.keys[i] >> 16), items.data[i], chunk.tick, event_mask, &event)) continue;
+        callback(user, &event);
+        num_events++;
+      }
+      break;
+    case DD_CHUNK_MSG:
+      if (!dd_event_from_msg(&chunk, event_mask, &event)) break;
+      callback(user, &event);
+      num_events++;
+      break;
+    default:
+      break;
+    }
+  }
+  return num_events;
+}
+
+/******************************************************************************
+ *
+ * SNAPSHOT HISTORY
+ *
+ ******************************************************************************/
+
+/*
+ * Every entry is a sorted list of refcounted items, split into refcounted pages. Items equal to the ones of the
+ * previous snapshot are shared, and so are pages whose items are all shared. Page boundaries depend on the keys only
+ * (content defined), so an item coming or going changes its own page but leaves the following ones shareable.
+ */
+#define DD_SH_MAX_PAGE_ITEMS 64
+#define DD_SH_PAGE_BOUNDARY_MASK 15 // about 16 items per page
+
+typedef struct {
+  int refcount;
+  int key;
+  int size;
+  int data[];
+} dd_sh_item;
+
+typedef struct {
+  int refcount;
+  int num_items;
+  dd_sh_item *items[];
+} dd_sh_page;
+
+typedef struct {
+  int tick;
+  int num_items;
+  int data_size;
+  int num_pages;
+  dd_sh_page **pages;
+} dd_sh_entry;
+
+struct dd_snap_history {
+  dd_sh_entry *entries; // ring buffer
+  int capacity;
+  int first;
+  int num_entries;
+  size_t memory_usage;
+};
+
+static void dd_sh_release_item(dd_snap_history *sh, dd_sh_item *item) {
+  if (--item->refcount > 0) return;
+  sh->memory_usage -= sizeof(dd_sh_item) + item->size;
+  free(item);
+}
+
+static void dd_sh_release_page(dd_snap_history *sh, dd_sh_page *page) {
+  if (--page->refcount > 0) return;
+  for (int i = 0; i < page->num_items; i++)
+    dd_sh_release_item(sh, page->items[i]);
+  sh->memory_usage -= sizeof(dd_sh_page) + sizeof(dd_sh_item *) * page->num_items;
+  free(page);
+}
+
+static void dd_sh_release_entry(dd_snap_history *sh, dd_sh_entry *entry) {
+  for (int i = 0; i < entry->num_pages; i++)
+    dd_sh_release_page(sh, entry->pages[i]);
+  sh->memory_usage -= sizeof(dd_sh_page *) * entry->num_pages;
+  free(entry->pages);
+  entry->pages = NULL;
+  entry->num_pages = 0;
+}
+
+static dd_sh_entry *dd_sh_entry_at(const dd_snap_history *sh, int index) { return &sh->entries[(sh->first + index) % sh->capacity]; }
+
+static void dd_sh_drop_oldest(dd_snap_history *sh) {
+  dd_sh_release_entry(sh, dd_sh_entry_at(sh, 0));
+  sh->first = (sh->first + 1) % sh->capacity;
+  sh->num_entries--;
+}
+
+static unsigned dd_sh_key_hash(int key) { return ((unsigned)key * 0x9e3779b1u) >> 16; }
+
+dd_snap_history *demo_sh_create(int capacity) {
+  if (capacity <= 0) return NULL;
+  dd_snap_history *sh = (dd_snap_history *)calloc(1, sizeof(dd_snap_history));
+  if (!sh) return NULL;
+  sh->entries = (dd_sh_entry *)calloc(capacity, sizeof(dd_sh_entry));
+  if (!sh->entries) {
+    free(sh);
+    return NULL;
+  }
+  sh->capacity = capacity;
+  return sh;
+}
+
+void demo_sh_clear(dd_snap_history *sh) {
+  for (int i = 0; i < sh->num_entries; i++)
+    dd_sh_release_entry(sh, dd_sh_entry_at(sh, i));
+  sh->first = 0;
+  sh->num_entries = 0;
+}
+
+void demo_sh_destroy(dd_snap_history **sh_ptr) {
+  if (sh_ptr && *sh_ptr) {
+    demo_sh_clear(*sh_ptr);
+    free((*sh_ptr)->entries);
+    free(*sh_ptr);
+    *sh_ptr = NULL;
+  }
+}
+
+/* Appends a page of `items` to `entry`, shared with the previous snapshot's page starting at the same key if identical. */
+static bool dd_sh_add_page(dd_snap_history *sh, dd_sh_entry *entry, int *capacity, const dd_sh_entry *prev, int *prev_page, dd_sh_item **items,
+                           int num_items) {
+  int first_key = items[0]->key;
+  while (prev && *prev_page < prev->num_pages && prev->pages[*prev_page]->items[0]->key < first_key)
+    (*prev_page)++;
+  dd_sh_page *shared = NULL;
+  if (prev && *prev_page < prev->num_pages) {
+    dd_sh_page *candidate = prev->pages[*prev_page];
+    if (candidate->num_items == num_items && memcmp(candidate->items, items, sizeof(dd_sh_item *) * num_items) == 0) shared = candidate;
+  }
+
+  if (entry->num_pages == *capacity) {
+    int new_capacity = *capacity ? *capacity * 2 : 16;
+    dd_sh_page **pages = (dd_sh_page **)realloc(entry->pages, sizeof(dd_sh_page *) * new_capacity);
+    if (!pages) return false;
+    entry->pages = pages;
+    *capacity = new_capacity;
+  }
+
+  if (shared) {
+    // the page holds the same item pointers, give back the extra item references taken for it
+    for (int i = 0; i < num_items; i++)
+      items[i]->refcount--;
+    shared->refcount++;
+    entry->pages[entry->num_pages++] = shared;
+    return true;
+  }
+
+  dd_sh_page *page = (dd_sh_page *)malloc(sizeof(dd_sh_page) + sizeof(dd_sh_item *) * num_items);
+  if (!page) return false;
+  page->refcount = 1;
+  page->num_items = num_items;
+  memcpy(page->items, items, sizeof(dd_sh_item *) * num_items);
+  sh->memory_usage += sizeof(dd_sh_page) + sizeof(dd_sh_item *) * num_items;
+  entry->pages[entry->num_pages++] = page;
+  return true;
+}
+
+bool demo_sh_push(dd_snap_history *sh, int tick, const dd_snapshot *snap) {
+  if (sh->num_entries > 0 && tick <= dd_sh_entry_at(sh, sh->num_entries - 1)->tick) return false;
+
+  int order[DD_MAX_SNAPSHOT_ITEMS];
+  if (dd_snap_is_sorted(snap)) {
+    for (int i = 0; i < snap->num_items; i++)
+      order[i] = i;
+  } else {
+    int keys[DD_MAX_SNAPSHOT_ITEMS], tmp[DD_MAX_SNAPSHOT_ITEMS];
+    for (int i = 0; i < snap->num_items; i++)
+      keys[i] = dd_snap_get_item(snap, i)->type_and_id;
+    dd_radix_sort_items(keys, order, tmp, snap->num_items);
+  }
+
+  if (sh->num_entries == sh->capacity) dd_sh_drop_oldest(sh);
+  const dd_sh_entry *prev = sh->num_entries > 0 ? dd_sh_entry_at(sh, sh->num_entries - 1) : NULL;
+  dd_sh_entry *entry = dd_sh_entry_at(sh, sh->num_entries);
+  entry->tick = tick;
+  entry->num_items = snap->num_items;
+  entry->data_size = snap->data_size;
+  entry->num_pages = 0;
+  entry->pages = NULL;
+
+  // merge the sorted items with the previous snapshot's ones (walked page by page) to find the unchanged items
+  int prev_page_index = 0, prev_item = 0, share_page = 0, pages_capacity = 0;
+  dd_sh_item *page[DD_SH_MAX_PAGE_ITEMS];
+  int page_items = 0;
+  bool ok = true;
+  for (int n = 0; n < snap->num_items && ok; n++) {
+    const dd_snap_item *snap_item = dd_snap_get_item(snap, order[n]);
+    int key = snap_item->type_and_id;
+    int size = dd_snap_get_item_size(snap, order[n]);
+
+    dd_sh_item *item = NULL;
+    while (prev && prev_page_index < prev->num_pages) {
+      const dd_sh_page *prev_page = prev->pages[prev_page_index];
+      dd_sh_item *candidate = prev_page->items[prev_item];
+      if (candidate->key > key) break;
+      if (++prev_item == prev_page->num_items) {
+        prev_page_index++;
+        prev_item = 0;
+      }
+      if (candidate->key == key && candidate->size == size && memcmp(candidate->data, dd_snap_item_data(snap_item), size) == 0) item = candidate;
+      if (candidate->key == key) break;
+    }
+
+    if (item) {
+      item->refcount++;
+    } else {
+      item = (dd_sh_item *)malloc(sizeof(dd_sh_item) + size);
+      if (!item) {
+        ok = false;
+        break;
+      }
+      item->refcount = 1;
+      item->key = key;
+      item->size = size;
+      memcpy(item->data, dd_snap_item_data(snap_item), size);
+      sh->memory_usage += sizeof(dd_sh_item) + size;
+    }
+
+    page[page_items++] = item;
+    if (page_items == DD_SH_MAX_PAGE_ITEMS || (dd_sh_key_hash(key) & DD_SH_PAGE_BOUNDARY_MASK) == 0 || n == snap->num_items - 1) {
+      ok = dd_sh_add_page(sh, entry, &pages_capacity, prev, &share_page, page, page_items);
+      if (ok) page_items = 0;
+    }
+  }
+
+  sh->memory_usage += sizeof(dd_sh_page *) * entry->num_pages;
+  if (!ok) {
+    for (int i = 0; i < page_items; i++)
+      dd_sh_release_item(sh, page[i]);
+    dd_sh_release_entry(sh, entry);
+    return false;
+  }
+  sh->num_entries++;
+  return true;
+}
+
+int demo_sh_count(const dd_snap_history *sh) { return sh->num_entries; }
+
+int demo_sh_tick(const dd_snap_history *sh, int index) {
+  if (index < 0 || index >= sh->num_entries) return -1;
+  return dd_sh_entry_at(sh, index)->tick;
+}
+
+int demo_sh_find(const dd_snap_history *sh, int tick) {
+  int lo = 0, hi = sh->num_entries - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    int mid_tick = dd_sh_entry_at(sh, mid)->tick;
+    if (mid_tick == tick) return mid;
+    if (mid_tick < tick) lo = mid + 1;
+    else hi = mid - 1;
+  }
+  return -1;
+}
+
+const void *demo_sh_find_item(const dd_snap_history *sh, int index, int type, int id, int *size) {
+  if (index < 0 || index >= sh->num_entries) return NULL;
+  const dd_sh_entry *entry = dd_sh_entry_at(sh, index);
+  int key = (type << 16) | id;
+
+  // last page starting at or before the key
+  int lo = 0, hi = entry->num_pages - 1, page_index = -1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (entry->pages[mid]->items[0]->key <= key) {
+      page_index = mid;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  if (page_index < 0) return NULL;
+
+  const dd_sh_page *page = entry->pages[page_index];
+  lo = 0;
+  hi = page->num_items - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    const dd_sh_item *item = page->items[mid];
+    if (item->key == key) {
+      if (size) *size = item->size;
+      return item->data;
+    }
+    if (item->key < key) lo = mid + 1;
+    else hi = mid - 1;
+  }
+  return NULL;
+}
+
+int demo_sh_get_snapshot(const dd_snap_history *sh, int index, void *snap_data) {
+  if (index < 0 || index >= sh->num_entries) return -1;
+  const dd_sh_entry *entry = dd_sh_entry_at(sh, index);
+  dd_snapshot *snap = (dd_snapshot *)snap_data;
+  snap->num_items = entry->num_items;
+  snap->data_size = entry->data_size;
+
+  int *offsets = dd_snap_offsets(snap);
+  uint8_t *data = (uint8_t *)dd_snap_data_start(snap);
+  int n = 0, offset = 0;
+  for (int p = 0; p < entry->num_pages; p++) {
+    const dd_sh_page *page = entry->pages[p];
+    for (int i = 0; i < page->num_items; i++) {
+      const dd_sh_item *item = page->items[i];
+      offsets[n++] = offset;
+      dd_snap_item *out = (dd_snap_item *)(data + offset);
+      out->type_and_id = item->key;
+      memcpy(dd_snap_item_data(out), item->data, item->size);
+      offset += sizeof(dd_snap_item) + item->size;
+    }
+  }
+  return (int)(sizeof(dd_snapshot) + sizeof(int) * n + offset);
+}
+
+size_t demo_sh_memory_usage(const dd_snap_history *sh) { return sh->memory_usage + sizeof(dd_snap_history) + sizeof(dd_sh_entry) * sh->capacity; }
+
+/******************************************************************************
+ *
+ * SNAPSHOT SEEKING
+ *
+ ******************************************************************************/
+
+static void dd_reader_clear_cache(dd_demo_reader *dr) {
+  for (int i = 0; i < dr->num_cached; i++)
+    free(dr->cache[i].snap);
+  dr->num_cached = 0;
+  if (dr->reverse) demo_sh_clear(dr->reverse);
+}
+
+void demo_r_set_snapshot_cache(dd_demo_reader *dr, int max_snapshots, int checkpoint_interval) {
+  dd_reader_clear_cache(dr);
+  free(dr->cache);
+  dr->cache = NULL;
+  dr->cache_capacity = max_snapshots > 0 ? max_snapshots : 0;
+  dr->checkpoint_interval = checkpoint_interval > 0 ? checkpoint_interval : 0;
+}
+
+/* Scans the chunk headers once (payloads are skipped, not decoded) and records where every keyframe starts. */
+static void dd_reader_index_keyframes(dd_demo_reader *dr) {
+  dr->keyframes_indexed = true;
+  dr->num_keyframes = 0;
+  int64_t pos = dd_ftell(dr->file);
+  if (pos < 0 || dd_fseek(dr->file, dr->chunks_start, SEEK_SET) != 0) return;
+
+  int capacity = 0, tick = -1;
+  uint8_t header_byte;
+  while (fread(&header_byte, 1, 1, dr->file) == 1) {
+    if (header_byte & DD_CHUNKTYPEFLAG_TICKMARKER) {
+      if (dr->info.header.version >= DD_DEMO_VERSION_TICKCOMPRESSION && (header_byte & DD_CHUNKTICKFLAG_TICK_COMPRESSED)) {
+        tick = (tick == -1 ? 0 : tick) + (header_byte & DD_CHUNKMASK_TICK);
+      } else {
+        uint8_t tick_data[4];
+        if (fread(tick_data, sizeof(tick_data), 1, dr->file) != 1) break;
+        tick = dd_be_to_uint(tick_data);
+      }
+      if (!(header_byte & DD_CHUNKTICKFLAG_KEYFRAME)) continue;
+
+      if (dr->num_keyframes == capacity) {
+        int new_capacity = capacity ? capacity * 2 : 64;
+        dd_keyframe *keyframes = (dd_keyframe *)realloc(dr->keyframes, sizeof(dd_keyframe) * new_capacity);
+        if (!keyframes) break;
+        dr->keyframes = keyframes;
+        capacity = new_capacity;
+      }
+      dr->keyframes[dr->num_keyframes].tick = tick;
+      dr->keyframes[dr->num_keyframes].offset = dd_ftell(dr->file);
+      dr->num_keyframes++;
+      continue;
+    }
+
+    int size = header_byte & DD_CHUNKMASK_SIZE;
+    if (size == 30) {
+      uint8_t size_byte;
+      if (fread(&size_byte, 1, 1, dr->file) != 1) break;
+      size = size_byte;
+    } else if (size == 31) {
+      uint8_t size_bytes[2];
+      if (fread(size_bytes, 2, 1, dr->file) != 1) break;
+      size = (size_bytes[1] << 8) | size_bytes[0];
+    }
+    if (dd_fseek(dr->file, size, SEEK_CUR) != 0) break;
+  }
+
+  clearerr(dr->file);
+  dd_fseek(dr->file, pos, SEEK_SET);
+}
+
+int demo_r_num_keyframes(dd_demo_reader *dr) {
+  if (!dr->keyframes_indexed) dd_reader_index_keyframes(dr);
+  return dr->num_keyframes;
+}
+
+int demo_r_keyframe_tick(dd_demo_reader *dr, int index) {
+  if (index < 0 || index >= demo_r_num_keyframes(dr)) return -1;
+  return dr->keyframes[index].tick;
+}
+
+/* Remembers the current snapshot, replacing the least recently used one if the cache is full. */
+static void dd_reader_cache_snapshot(dd_demo_reader *dr, int64_t offset) {
+  if (dr->cache_capacity == 0) return;
+  if (!dr->cache) {
+    dr->cache = (dd_cached_snapshot *)calloc(dr->cache_capacity, sizeof(dd_cached_snapshot));
+    if (!dr->cache) return;
+  }
+  for (int i = 0; i < dr->num_cached; i++) {
+    if (dr->cache[i].tick == dr->snapshot_tick) return;
+  }
+
+  dd_cached_snapshot *entry = &dr->cache[dr->num_cached];
+  if (dr->num_cached == dr->cache_capacity) {
+    entry = &dr->cache[0];
+    for (int i = 1; i < dr->num_cached; i++) {
+      if (dr->cache[i].last_used < entry->last_used) entry = &dr->cache[i];
+    }
+  } else {
+    entry->snap = NULL;
+    dr->num_cached++;
+  }
+
+  const dd_snapshot *snap = dd_reader_full_snapshot(dr);
+  int size = sizeof(dd_snapshot) + sizeof(int) * snap->num_items + snap->data_size;
+  uint8_t *data = (uint8_t *)realloc(entry->snap, size);
+  if (!data) {
+    // drop the slot rather than keeping a stale snapshot in it
+    free(entry->snap);
+    *entry = dr->cache[--dr->num_cached];
+    return;
+  }
+  memcpy(data, snap, size);
+  entry->snap = data;
+  entry->size = size;
+  entry->tick = dr->snapshot_tick;
+  entry->offset = offset;
+  entry->last_used = ++dr->cache_clock;
+}
+
+const dd_snapshot *demo_r_get_snapshot_at(dd_demo_reader *dr, int tick) {
+  if (!dr->keyframes_indexed) dd_reader_index_keyframes(dr);
+
+  // the last keyframe at or before `tick`, any cached snapshot between the two is a better starting point
+  int lo = 0, hi = dr->num_keyframes - 1, keyframe = -1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (dr->keyframes[mid].tick <= tick) {
+      keyframe = mid;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  int base_tick = keyframe >= 0 ? dr->keyframes[keyframe].tick : -1;
+
+  dd_cached_snapshot *cached = NULL;
+  for (int i = 0; i < dr->num_cached; i++) {
+    dd_cached_snapshot *entry = &dr->cache[i];
+    if (entry->tick >= base_tick && entry->tick <= tick && (!cached || entry->tick > cached->tick)) cached = entry;
+  }
+
+  bool continue_here = dr->positioned && dr->snapshot_tick >= base_tick && dr->snapshot_tick <= tick && (!cached || dr->snapshot_tick >= cached->tick);
+  if (!continue_here) {
+    int64_t offset;
+    if (cached) {
+      cached->last_used = ++dr->cache_clock;
+      memcpy(dr->last_snapshot_data, cached->snap, cached->size);
+      dd_reader_project_snapshot(dr, (dd_snapshot *)dr->last_snapshot_data); // splits the hidden items off again
+      dr->last_sorted = dd_snap_is_sorted((const dd_snapshot *)dr->last_snapshot_data);
+      dr->ex_types_dirty = true;
+      dr->snapshot_tick = cached->tick;
+      dr->current_tick = cached->tick;
+      offset = cached->offset;
+    } else if (keyframe >= 0) {
+      dr->snapshot_tick = -1;
+      dr->current_tick = base_tick;
+      offset = dr->keyframes[keyframe].offset;
+    } else {
+      dr->snapshot_tick = -1;
+      dr->current_tick = -1;
+      offset = dr->chunks_start;
+    }
+    if (dd_fseek(dr->file, offset, SEEK_SET) != 0) return NULL;
+  }
+
+  // replay up to the tick marker following `tick`, taking checkpoints on the way
+  static const dd_delta_visitor no_visitor = {NULL, NULL, NULL};
+  int last_checkpoint = dr->snapshot_tick;
+  dd_demo_chunk chunk;
+  for (;;) {
+    int64_t offset = dd_ftell(dr->file);
+    int current_tick = dr->current_tick;
+    if (!demo_r_next_chunk(dr, &chunk)) break;
+
+    if (chunk.type == DD_CHUNK_TICK_MARKER) {
+      if (chunk.tick <= tick) continue;
+      dd_fseek(dr->file, offset, SEEK_SET);
+      dr->current_tick = current_tick;
+      break;
+    }
+    if (chunk.type == DD_CHUNK_SNAP) {
+      dd_reader_cache_snapshot(dr, dd_ftell(dr->file));
+      last_checkpoint = chunk.tick;
+    } else if (chunk.type == DD_CHUNK_SNAP_DELTA && dr->snapshot_tick >= 0) {
+      if (demo_r_visit_delta(dr, chunk.data, chunk.size, &no_visitor, NULL, NULL) < 0) return NULL;
+      if (dr->checkpoint_interval > 0 && chunk.tick - last_checkpoint >= dr->checkpoint_interval) {
+        dd_reader_cache_snapshot(dr, dd_ftell(dr->file));
+        last_checkpoint = chunk.tick;
+      }
+    }
+  }
+
+  dr->positioned = true;
+  return dr->snapshot_tick >= 0 ? (const dd_snapshot *)dr->last_snapshot_data : NULL;
+}
+
+void demo_r_set_reverse_budget(dd_demo_reader *dr, size_t max_bytes) {
+  dr->reverse_budget = max_bytes;
+  if (dr->reverse) demo_sh_clear(dr->reverse);
+}
+
+/* Decodes the snapshots of the interval before `tick` into the reverse history, as many of the last ones as fit. */
+static bool dd_reader_fill_reverse(dd_demo_reader *dr, int tick) {
+  int span = dr->checkpoint_interval > 0 ? dr->checkpoint_interval : DD_SERVER_TICK_SPEED;
+  if (!dr->reverse) {
+    dr->reverse = demo_sh_create(span + 1);
+    dr->reverse_offsets = (int64_t *)malloc(sizeof(int64_t) * (span + 1));
+    if (!dr->reverse || !dr->reverse_offsets) {
+      demo_sh_destroy(&dr->reverse);
+      free(dr->reverse_offsets);
+      dr->reverse_offsets = NULL;
+      return false;
+    }
+  }
+  demo_sh_clear(dr->reverse);
+
+  static const dd_delta_visitor no_visitor = {NULL, NULL, NULL};
+  bool have_snapshot = demo_r_get_snapshot_at(dr, tick - span) != NULL;
+  dd_demo_chunk chunk;
+  for (;;) {
+    if (have_snapshot && dr->snapshot_tick < tick) {
+      // the ring holds span + 1 snapshots, make room for the newest one ourselves to keep the offsets in step
+      dd_snap_history *sh = dr->reverse;
+      if (sh->num_entries == sh->capacity || (sh->num_entries > 0 && demo_sh_memory_usage(sh) > dr->reverse_budget)) {
+        dd_sh_drop_oldest(sh);
+        memmove(dr->reverse_offsets, dr->reverse_offsets + 1, sizeof(int64_t) * sh->num_entries);
+      }
+      if (!demo_sh_push(sh, dr->snapshot_tick, dd_reader_full_snapshot(dr))) return false;
+      dr->reverse_offsets[sh->num_entries - 1] = dd_ftell(dr->file);
+    }
+    have_snapshot = false;
+
+    if (!demo_r_next_chunk(dr, &chunk)) break;
+    if (chunk.type == DD_CHUNK_TICK_MARKER && chunk.tick >= tick) break;
+    if (chunk.type == DD_CHUNK_SNAP) {
+      have_snapshot = true;
+    } else if (chunk.type == DD_CHUNK_SNAP_DELTA && dr->snapshot_tick >= 0) {
+      if (demo_r_visit_delta(dr, chunk.data, chunk.size, &no_visitor, NULL, NULL) < 0) return false;
+      have_snapshot = true;
+    }
+  }
+  return true;
+}
+
+const dd_snapshot *demo_r_prev_tick(dd_demo_reader *dr) {
+  int tick = dr->snapshot_tick;
+  if (tick < 0) return NULL;
+
+  int index = dr->reverse ? demo_sh_find(dr->reverse, tick) : -1;
+  if (index > 0) {
+    index--;
+  } else {
+    if (!dd_reader_fill_reverse(dr, tick)) return NULL;
+    index = demo_sh_count(dr->reverse) - 1;
+    if (index < 0) {
+      // nothing before the first snapshot, stay there
+      demo_r_get_snapshot_at(dr, tick);
+      return NULL;
+    }
+  }
+
+  demo_sh_get_snapshot(dr->reverse, index, dr->last_snapshot_data);
+  dd_reader_project_snapshot(dr, (dd_snapshot *)dr->last_snapshot_data);
+  dr->last_sorted = true;
+  dr->ex_types_dirty = true;
+  dr->snapshot_tick = demo_sh_tick(dr->reverse, index);
+  dr->current_tick = dr->snapshot_tick;
+  if (dd_fseek(dr->file, dr->reverse_offsets[index], SEEK_SET) != 0) return NULL;
+  dr->positioned = true;
+  return (const dd_snapshot *)dr->last_snapshot_data;
+}
+
+/******************************************************************************
+ *
+ * DEMO EDITING
+ *
+ ******************************************************************************/
+
+static bool dd_copy_map(dd_demo_reader *dr, dd_demo_writer *dw) {
+  const dd_demo_info *info = &dr->info;
+  if (info->map_size == 0 && !info->has_sha256) return true;
+
+  uint8_t *map_data = (uint8_t *)malloc(info->map_size ? info->map_size : 1);
+  if (!map_data) return false;
+  bool ok = demo_r_read_map(dr, map_data) && demo_w_write_map(dw, info->has_sha256 ? info->map_sha256 : NULL, map_data, info->map_size);
+  free(map_data);
+  return ok;
+}
+
+bool demo_w_begin_from(dd_demo_writer *dw, FILE *f, dd_demo_reader *dr) {
+  const dd_demo_info *info = &dr->info;
+  return demo_w_begin(dw, f, info->header.map_name, info->map_crc, info->header.type) && dd_copy_map(dr, dw);
+}
+
+bool demo_slice(dd_demo_reader *dr, FILE *out, int start_tick, int end_tick) {
+  if (end_tick < start_tick) return false;
+  dd_demo_writer *dw = demo_w_create();
+  if (!dw) return false;
+  const dd_demo_info *info = &dr->info;
+  bool ok = demo_w_begin_from(dw, out, dr);
+
+  // start right behind the state before start_tick. The first tick gets decoded: a keyframe is copied as is and
+  // from there on everything is, otherwise the tick's snapshot is written as a keyframe first.
+  demo_r_get_snapshot_at(dr, start_tick - 1);
+  uint8_t *snap = dd_reader_scratch(dr);
+  bool copying = false;
+  int pending_tick = -1; // tick marker waiting for its snapshot
+  dd_demo_chunk chunk;
+  while (ok && (copying ? demo_r_next_raw_chunk(dr, &chunk) : demo_r_next_chunk(dr, &chunk))) {
+    if (chunk.type == DD_CHUNK_TICK_MARKER && chunk.tick > end_tick) break;
+    if (copying) {
+      ok = demo_w_write_raw_chunk(dw, &chunk);
+      continue;
+    }
+
+    if (chunk.type == DD_CHUNK_TICK_MARKER) {
+      if (pending_tick >= 0 && dr->snapshot_tick >= 0) {
+        // the tick had no delta, its snapshot is the previous one
+        ok = demo_w_write_snap(dw, pending_tick, dr->last_snapshot_data, dd_snap_size((const dd_snapshot *)dr->last_snapshot_data));
+        copying = true;
+        ok = ok && demo_w_write_raw_chunk(dw, &chunk);
+      } else if (chunk.is_keyframe) {
+        copying = true;
+        ok = demo_w_write_raw_chunk(dw, &chunk);
+      } else {
+        pending_tick = chunk.tick;
+      }
+      continue;
+    }
+    if (pending_tick < 0) continue;
+
+    if (chunk.type == DD_CHUNK_SNAP_DELTA) {
+      int size = snap ? demo_r_unpack_delta(dr, chunk.data, chunk.size, snap) : -1;
+      ok = size > 0 && demo_w_write_snap(dw, pending_tick, snap, size);
+      copying = true;
+    } else if (chunk.type == DD_CHUNK_SNAP) {
+      ok = demo_w_write_snap(dw, pending_tick, chunk.data, chunk.size);
+      copying = true;
+    } else if (dr->snapshot_tick >= 0) {
+      ok = demo_w_write_snap(dw, pending_tick, dr->last_snapshot_data, dd_snap_size((const dd_snapshot *)dr->last_snapshot_data));
+      ok = ok && demo_w_write_msg(dw, chunk.tick, chunk.data, chunk.size);
+      copying = true;
+    }
+  }
+  if (ok && !copying && pending_tick >= 0 && dr->snapshot_tick >= 0) {
+    ok = demo_w_write_snap(dw, pending_tick, dr->last_snapshot_data, dd_snap_size((const dd_snapshot *)dr->last_snapshot_data));
+  }
+
+  for (int i = 0; i < info->num_markers; i++) {
+    if (info->markers[i] >= start_tick && info->markers[i] <= end_tick) demo_w_add_marker(dw, info->markers[i]);
+  }
+  ok = demo_w_finish(dw) && ok;
+  demo_w_destroy(&dw);
+  return ok;
+}
+
+static bool dd_same_map(const dd_demo_info *a, const dd_demo_info *b) {
+  if (a->map_crc != b->map_crc || a->map_size != b->map_size) return false;
+  return !a->has_sha256 || !b->has_sha256 || memcmp(a->map_sha256, b->map_sha256, sizeof(a->map_sha256)) == 0;
+}
+
+bool demo_concat(dd_demo_reader **parts, int num_parts, FILE *out) {
+  if (num_parts <= 0) return false;
+  for (int i = 1; i < num_parts; i++) {
+    if (!dd_same_map(&parts[0]->info, &parts[i]->info)) return false;
+  }
+
+  dd_demo_writer *dw = demo_w_create();
+  if (!dw) return false;
+  bool ok = demo_w_begin_from(dw, out, parts[0]);
+
+  int last_tick = -1;
+  for (int p = 0; p < num_parts && ok; p++) {
+    dd_demo_reader *dr = parts[p];
+    if (!dr->keyframes_indexed) dd_reader_index_keyframes(dr);
+    if (dr->num_keyframes == 0) continue;
+    int first_tick = dr->keyframes[0].tick;
+    int tick_offset = last_tick >= first_tick ? last_tick + 1 - first_tick : 0;
+
+    // chunks before the first keyframe can't be decoded without the recording they were cut from
+    if (dd_fseek(dr->file, dr->keyframes[0].offset, SEEK_SET) != 0) {
+      ok = false;
+      break;
+    }
+    dr->current_tick = first_tick;
+    dd_demo_chunk marker = {DD_CHUNK_TICK_MARKER, first_tick + tick_offset, true, 0, NULL};
+    ok = demo_w_write_raw_chunk(dw, &marker);
+    last_tick = marker.tick;
+
+    dd_demo_chunk chunk;
+    while (ok && demo_r_next_raw_chunk(dr, &chunk)) {
+      if (chunk.type == DD_CHUNK_TICK_MARKER) {
+        chunk.tick += tick_offset;
+        last_tick = chunk.tick;
+      }
+      ok = demo_w_write_raw_chunk(dw, &chunk);
+    }
+
+    for (int i = 0; i < dr->info.num_markers; i++)
+      demo_w_add_marker(dw, dr->info.markers[i] + tick_offset);
+  }
+
+  ok = demo_w_finish(dw) && ok;
+  demo_w_destroy(&dw);
+  return ok;
+}
+
+static bool dd_is_event_type(int type) {
+  return (type >= DD_NETEVENTTYPE_COMMON && type <= DD_NETEVENTTYPE_DAMAGEIND) || type == DD_NETEVENTTYPE_BIRTHDAY || type == DD_NETEVENTTYPE_FINISH ||
+         type == DD_NETOBJTYPE_MYOWNEVENT || type == DD_NETEVENTTYPE_MAPSOUNDWORLD;
+}
+
+typedef struct {
+  dd_demo_reader *dr;
+  dd_demo_writer *dw;
+  const dd_transcode_options *options;
+  bool strip_snapshots;
+  bool strip_messages;
+  uint64_t strip_items[2]; // public types below 64, extended types from OFFSET_UUID
+  uint64_t strip_msgs[2];  // game message ids below 64, extended ids from DD_OFFSET_NETMSGTYPE_UUID
+  bool ok;
+
+  int tick; // -1 before the first tick marker
+  bool tick_kept;
+  bool tick_written;
+
+  // decimation: events and messages of dropped ticks, written with the next kept tick
+  int num_fresh; // events the current tick added itself, a held back event equal to one of them is another event
+  int fresh_keys[DD_MAX_SNAPSHOT_ITEMS];
+  int num_events;
+  int event_keys[DD_MAX_SNAPSHOT_ITEMS];  // internal type of the tick the event comes from
+  int event_types[DD_MAX_SNAPSHOT_ITEMS]; // public type, extended indices differ from tick to tick
+  int event_sizes[DD_MAX_SNAPSHOT_ITEMS];
+  int event_offsets[DD_MAX_SNAPSHOT_ITEMS];
+  int event_data_size;
+  uint8_t event_data[DD_MAX_SNAPSHOT_SIZE];
+  uint8_t *messages; // int size, then the payload padded to 4 bytes
+  int messages_size;
+  int messages_capacity;
+} dd_transcoder;
+
+static void dd_type_mask_add(uint64_t mask[2], int type, int ex_offset) {
+  if (type >= 0 && type < 64) mask[0] |= (uint64_t)1 << type;
+  else if (type >= ex_offset && type < ex_offset + 64) mask[1] |= (uint64_t)1 << (type - ex_offset);
+}
+
+static bool dd_type_mask_has(const uint64_t mask[2], int type, int ex_offset) {
+  if (type >= 0 && type < 64) return (mask[0] >> type) & 1;
+  return type >= ex_offset && type < ex_offset + 64 && ((mask[1] >> (type - ex_offset)) & 1);
+}
+
+/* Whether the item at `index` is of a stripped type, or an EX item naming one. */
+static bool dd_transcoder_strips_item(const dd_transcoder *tc, const dd_snapshot *snap, int index) {
+  if (!tc->strip_items[0] && !tc->strip_items[1]) return false;
+  const dd_snap_item *item = dd_snap_get_item(snap, index);
+  if (dd_snap_item_type(item) == DD_NETOBJTYPE_EX && dd_snap_get_item_size(snap, index) >= 16) {
+    return dd_type_mask_has(tc->strip_items, dd_uuid_lookup(dd_snap_item_data(item)), OFFSET_UUID);
+  }
+  return dd_type_mask_has(tc->strip_items, demo_r_item_type(tc->dr, item), OFFSET_UUID);
+}
+
+static bool dd_transcoder_strips_msg(const dd_transcoder *tc, const dd_demo_chunk *chunk) {
+  if (tc->strip_messages) return true;
+  if (!tc->strip_msgs[0] && !tc->strip_msgs[1]) return false;
+  dd_msg_unpacker unpacker;
+  demo_msg_unpack_init(&unpacker, chunk->data, chunk->size);
+  bool system;
+  int msg_id = demo_msg_get_header(&unpacker, &system);
+  // system messages share the small ids with game messages
+  if (system && msg_id < DD_OFFSET_NETMSGTYPE_UUID) return false;
+  return dd_type_mask_has(tc->strip_msgs, msg_id, DD_OFFSET_NETMSGTYPE_UUID);
+}
+
+static void dd_transcoder_add_event(dd_transcoder *tc, int key, int type, const int *data, int size) {
+  if (tc->num_events == DD_MAX_SNAPSHOT_ITEMS || tc->event_data_size + size > (int)sizeof(tc->event_data)) return;
+  tc->event_keys[tc->num_events] = key;
+  tc->event_types[tc->num_events] = type;
+  tc->event_sizes[tc->num_events] = size;
+  tc->event_offsets[tc->num_events] = tc->event_data_size;
+  memcpy(tc->event_data + tc->event_data_size, data, size);
+  tc->event_data_size += size;
+  tc->num_events++;
+}
+
+/* Keeps every item that may be an event, extended types are only known once the delta is applied: a server announces
+ * them in the snapshots that use them. */
+static void dd_transcoder_on_item(void *user, int key, const int *old_data, const int *new_data, int size) {
+  (void)old_data;
+  dd_transcoder *tc = (dd_transcoder *)user;
+  int type = key >> 16;
+  if (!dd_is_event_type(type) && dd_extended_index(type) < 0) return;
+  if (!tc->tick_kept) {
+    dd_transcoder_add_event(tc, key, -1, new_data, size); // the public type is set by dd_transcoder_filter_events()
+  } else if (tc->num_fresh < DD_MAX_SNAPSHOT_ITEMS) {
+    tc->fresh_keys[tc->num_fresh++] = key;
+  }
+}
+
+/* Drops the items collected since `first_event` / `first_fresh` that turned out not to be events and records the
+ * public types of the others. */
+static void dd_transcoder_filter_events(dd_transcoder *tc, int first_event, int first_fresh) {
+  int num_events = first_event;
+  int data_size = num_events > 0 ? tc->event_offsets[num_events - 1] + tc->event_sizes[num_events - 1] : 0;
+  for (int e = first_event; e < tc->num_events; e++) {
+    int type = dd_reader_public_type(tc->dr, tc->event_keys[e] >> 16);
+    if (!dd_is_event_type(type)) continue;
+    memmove(tc->event_data + data_size, tc->event_data + tc->event_offsets[e], tc->event_sizes[e]);
+    tc->event_keys[num_events] = tc->event_keys[e];
+    tc->event_types[num_events] = type;
+    tc->event_sizes[num_events] = tc->event_sizes[e];
+    tc->event_offsets[num_events] = data_size;
+    data_size += tc->event_sizes[e];
+    num_events++;
+  }
+  tc->num_events = num_events;
+  tc->event_data_size = data_size;
+
+  int num_fresh = first_fresh;
+  for (int i = first_fresh; i < tc->num_fresh; i++) {
+    if (dd_is_event_type(dd_reader_public_type(tc->dr, tc->fresh_keys[i] >> 16))) tc->fresh_keys[num_fresh++] = tc->fresh_keys[i];
+  }
+  tc->num_fresh = num_fresh;
+}
+
+static bool dd_transcoder_add_message(dd_transcoder *tc, const dd_demo_chunk *chunk) {
+  int needed = tc->messages_size + (int)sizeof(int) + ((chunk->size + 3) & ~3);
+  if (needed > tc->messages_capacity) {
+    int capacity = tc->messages_capacity ? tc->messages_capacity * 2 : 4096;
+    while (capacity < needed)
+      capacity *= 2;
+    uint8_t *messages = (uint8_t *)realloc(tc->messages, capacity);
+    if (!messages) return false;
+    tc->messages = messages;
+    tc->messages_capacity = capacity;
+  }
+  memcpy(tc->messages + tc->messages_size, &chunk->size, sizeof(int));
+  memcpy(tc->messages + tc->messages_size + sizeof(int), chunk->data, chunk->size);
+  tc->messages_size = needed;
+  return true;
+}
+
+/* Whether the merged events already hold `key`, or the current snapshot does with different data. */
+static bool dd_transcoder_is_fresh(const dd_transcoder *tc, int key) {
+  for (int i = 0; i < tc->num_fresh; i++) {
+    if (tc->fresh_keys[i] == key) return true;
+  }
+  return false;
+}
+
+/* Whether a later held back event took over the type and id of `event`: the earlier one was gone before the kept tick. */
+static bool dd_transcoder_is_superseded(const dd_transcoder *tc, int event) {
+  for (int e = event + 1; e < tc->num_events; e++) {
+    if (tc->event_types[e] == tc->event_types[event] && (tc->event_keys[e] & 0xffff) == (tc->event_keys[event] & 0xffff)) return true;
+  }
+  return false;
+}
+
+/* Internal type of public `type` in the snapshot being written. An extended type the snapshot doesn't announce gets a
+ * free index and an EX item naming it, `announced` keeps those by type - OFFSET_UUID. -1 if no index is left. */
+static int dd_transcoder_internal_type(dd_transcoder *tc, const dd_snapshot *snap, short *announced, int type) {
+  if (type < OFFSET_UUID) return type;
+  dd_demo_reader *dr = tc->dr;
+  if (dr->ex_types_dirty) dd_reader_refresh_ex_types(dr);
+  if (dr->ex_internal_types[type - OFFSET_UUID] >= 0) return dr->ex_internal_types[type - OFFSET_UUID];
+  if (announced[type - OFFSET_UUID] >= 0) return announced[type - OFFSET_UUID];
+
+  for (int index = 0; index < MAX_EXTENDED_ITEM_TYPES; index++) {
+    int internal_type = DD_MAX_TYPE - index;
+    bool taken = dd_snap_find_index(snap, (DD_NETOBJTYPE_EX << 16) | internal_type, dr->last_sorted) >= 0;
+    for (int i = 0; i < MAX_EXTENDED_ITEM_TYPES && !taken; i++)
+      taken = announced[i] == internal_type;
+    if (taken) continue;
+
+    int *ex_data = (int *)demo_sb_add_raw_item(dr->unpack_builder, DD_NETOBJTYPE_EX, internal_type, 16);
+    if (!ex_data) return -1;
+    dd_uuid_to_item_data(type, ex_data);
+    announced[type - OFFSET_UUID] = (short)internal_type;
+    return internal_type;
+  }
+  return -1;
+}
+
+static bool dd_transcoder_key_taken(const dd_transcoder *tc, const dd_snapshot *snap, const int *merged, int num_merged, int key) {
+  for (int i = 0; i < num_merged; i++) {
+    if (merged[i] == key) return true;
+  }
+  return dd_snap_find_index(snap, key, tc->dr->last_sorted) >= 0;
+}
+
+/* Writes the current snapshot for the tick, with the events of dropped ticks added and sorted if asked to. */
+static bool dd_transcoder_write_snap(dd_transcoder *tc) {
+  dd_demo_reader *dr = tc->dr;
+  const dd_snapshot *snap = (const dd_snapshot *)dr->last_snapshot_data;
+  bool strip = tc->strip_items[0] || tc->strip_items[1];
+  if (tc->num_events == 0 && !strip && (!tc->options->sort_snapshots || dr->last_sorted)) return demo_w_write_snap(tc->dw, tc->tick, snap, dd_snap_size(snap));
+
+  uint8_t *out = dd_reader_scratch(dr);
+  if (!out) return false;
+  dd_snapshot_builder *sb = dr->unpack_builder;
+  demo_sb_clear_into(sb, out, snap->num_items + tc->num_events * 2); // an event may bring its EX item
+  for (int i = 0; i < snap->num_items; i++) {
+    if (dd_transcoder_strips_item(tc, snap, i)) continue;
+    const dd_snap_item *item = dd_snap_get_item(snap, i);
+    int item_size = dd_snap_get_item_size(snap, i);
+    void *obj = demo_sb_add_raw_item(sb, dd_snap_item_type(item), dd_snap_item_id(item), item_size);
+    if (!obj) return false;
+    memcpy(obj, dd_snap_item_data(item), item_size);
+  }
+
+  // events reuse their ids every tick, a clashing event moves to a free id of its type unless it is the same one still
+  // lying in the snapshot. Extended events take the index their type has in this snapshot.
+  int merged[DD_MAX_SNAPSHOT_ITEMS];
+  int num_merged = 0;
+  short announced[MAX_EXTENDED_ITEM_TYPES];
+  memset(announced, -1, sizeof(announced));
+  for (int e = 0; e < tc->num_events; e++) {
+    int size = tc->event_sizes[e];
+    const int *data = (const int *)(tc->event_data + tc->event_offsets[e]);
+    if (tc->event_types[e] < 0 || dd_type_mask_has(tc->strip_items, tc->event_types[e], OFFSET_UUID)) continue;
+    int internal_type = dd_transcoder_internal_type(tc, snap, announced, tc->event_types[e]);
+    if (internal_type < 0) continue;
+    int key = (internal_type << 16) | (tc->event_keys[e] & 0xffff);
+    int index = dd_snap_find_index(snap, key, dr->last_sorted);
+    if (index >= 0 && !dd_transcoder_is_fresh(tc, key) && !dd_transcoder_is_superseded(tc, e) && dd_snap_get_item_size(snap, index) == size &&
+        memcmp(dd_snap_item_data(dd_snap_get_item(snap, index)), data, size) == 0)
+      continue;
+    while (dd_transcoder_key_taken(tc, snap, merged, num_merged, key) && (key & 0xffff) < 0xffff)
+      key++;
+    if (dd_transcoder_key_taken(tc, snap, merged, num_merged, key)) continue;
+    void *obj = demo_sb_add_raw_item(sb, key >> 16, key & 0xffff, size);
+    if (!obj) break;
+    memcpy(obj, data, size);
+    merged[num_merged++] = key;
+  }
+  tc->num_events = 0;
+  tc->event_data_size = 0;
+
+  int size = demo_sb_finish(sb, NULL);
+  return size > 0 && demo_w_write_snap(tc->dw, tc->tick, out, size);
+}
+
+/* Writes the current tick: its snapshot (or just a tick marker if there is none to write) and the held back messages. */
+static void dd_transcoder_write_tick(dd_transcoder *tc, bool need_marker) {
+  tc->tick_written = true;
+  if (!tc->strip_snapshots && tc->dr->snapshot_tick >= 0) {
+    tc->ok = tc->ok && dd_transcoder_write_snap(tc);
+  } else if (need_marker || tc->messages_size > 0) {
+    demo_w_write_tickmarker(tc->dw, tc->tick, false);
+  }
+
+  for (int offset = 0; offset < tc->messages_size && tc->ok;) {
+    int size;
+    memcpy(&size, tc->messages + offset, sizeof(int));
+    tc->ok = demo_w_write_msg(tc->dw, tc->tick, tc->messages + offset + sizeof(int), size);
+    offset += sizeof(int) + ((size + 3) & ~3);
+  }
+  tc->messages_size = 0;
+}
+
+bool demo_transcode(dd_demo_reader *dr, dd_demo_writer *dw, int start_tick, int end_tick, const dd_transcode_options *options) {
+  dd_transcoder *tc = (dd_transcoder *)malloc(sizeof(dd_transcoder));
+  if (!tc) return false;
+  tc->dr = dr;
+  tc->dw = dw;
+  tc->options = options;
+  tc->strip_snapshots = (options->strip_chunks & ((1u << DD_CHUNK_SNAP) | (1u << DD_CHUNK_SNAP_DELTA))) != 0;
+  tc->strip_messages = (options->strip_chunks & (1u << DD_CHUNK_MSG)) != 0;
+  memset(tc->strip_items, 0, sizeof(tc->strip_items));
+  memset(tc->strip_msgs, 0, sizeof(tc->strip_msgs));
+  for (int i = 0; i < options->num_strip_item_types; i++)
+    dd_type_mask_add(tc->strip_items, options->strip_item_types[i], OFFSET_UUID);
+  for (int i = 0; i < options->num_strip_msg_types; i++)
+    dd_type_mask_add(tc->strip_msgs, options->strip_msg_types[i], DD_OFFSET_NETMSGTYPE_UUID);
+  tc->ok = true;
+  tc->tick = -1;
+  tc->tick_kept = false;
+  tc->tick_written = true;
+  tc->num_fresh = 0;
+  tc->num_events = 0;
+  tc->event_data_size = 0;
+  tc->messages = NULL;
+  tc->messages_size = 0;
+  tc->messages_capacity = 0;
+  const dd_delta_visitor collect_events = {NULL, dd_transcoder_on_item, dd_transcoder_on_item};
+
+  // a kept tick is written once its snapshot is known: after its snapshot chunk, or at its first message or the next
+  // tick marker if the snapshot didn't change. Dropped ticks only leave their events and messages behind.
+  demo_r_get_snapshot_at(dr, start_tick - 1);
+  dd_demo_chunk chunk;
+  while (tc->ok && demo_r_next_chunk(dr, &chunk)) {
+    if (chunk.type == DD_CHUNK_TICK_MARKER) {
+      if (end_tick >= 0 && chunk.tick > end_tick) break;
+      if (tc->tick_kept && !tc->tick_written) dd_transcoder_write_tick(tc, false);
+      tc->tick = chunk.tick;
+      tc->tick_kept = options->decimate <= 1 || chunk.tick % options->decimate == 0;
+      tc->tick_written = false;
+      tc->num_fresh = 0;
+      continue;
+    }
+    if (tc->tick < 0) continue;
+
+    if (chunk.type == DD_CHUNK_MSG) {
+      if (dd_transcoder_strips_msg(tc, &chunk)) continue;
+      if (!tc->tick_kept) {
+        tc->ok = dd_transcoder_add_message(tc, &chunk);
+        continue;
+      }
+      if (!tc->tick_written) dd_transcoder_write_tick(tc, true);
+      tc->ok = tc->ok && demo_w_write_msg(dw, tc->tick, chunk.data, chunk.size);
+      continue;
+    }
+
+    if (chunk.type == DD_CHUNK_SNAP_DELTA) {
+      uint8_t *snap = dd_reader_scratch(dr);
+      int size = -1;
+      if (options->decimate > 1 && !tc->strip_snapshots) {
+        int first_event = tc->num_events, first_fresh = tc->num_fresh;
+        size = demo_r_visit_delta(dr, chunk.data, chunk.size, &collect_events, tc, NULL);
+        dd_transcoder_filter_events(tc, first_event, first_fresh);
+      } else if (snap)
+        size = demo_r_unpack_delta(dr, chunk.data, chunk.size, snap);
+      if (size < 0) tc->ok = false;
+    } else if (!tc->tick_kept && !tc->strip_snapshots) {
+      // a dropped keyframe: its events are as new as the ones of a delta
+      const dd_snapshot *snap = (const dd_snapshot *)dr->last_snapshot_data;
+      for (int i = 0; i < snap->num_items; i++) {
+        const dd_snap_item *item = dd_snap_get_item(snap, i);
+        int type = demo_r_item_type(dr, item);
+        if (!dd_is_event_type(type)) continue;
+        dd_transcoder_add_event(tc, item->type_and_id, type, dd_snap_item_data(item), dd_snap_get_item_size(snap, i));
+      }
+    }
+    if (tc->tick_kept && !tc->tick_written && !tc->strip_snapshots) dd_transcoder_write_tick(tc, false);
+  }
+
+  // the last tick takes what is still held back
+  if (tc->ok && tc->tick >= 0 && !tc->tick_written && (tc->tick_kept || tc->num_events > 0 || tc->messages_size > 0)) dd_transcoder_write_tick(tc, false);
+  bool ok = tc->ok;
+  free(tc->messages);
+  free(tc);
+  return ok;
+}
+
+/******************************************************************************
+ *
+ * COLUMNAR EXPORT
+ *
+ ******************************************************************************/
+
+typedef struct {
+  int type;
+  const char *name;   // file name
+  const char *fields; // column names after "tick" and "id", separated by spaces
+} dd_column_schema;
+
+static const dd_column_schema g_dd_column_schemas[] = {
+    {DD_NETOBJTYPE_PLAYERINPUT, "player_input", "Direction TargetX TargetY Jump Fire Hook PlayerFlags WantedWeapon NextWeapon PrevWeapon"},
+    {DD_NETOBJTYPE_PROJECTILE, "projectile", "X Y VelX VelY Type StartTick"},
+    {DD_NETOBJTYPE_LASER, "laser", "X Y FromX FromY StartTick"},
+    {DD_NETOBJTYPE_PICKUP, "pickup", "X Y Type Subtype"},
+    {DD_NETOBJTYPE_FLAG, "flag", "X Y Team"},
+    {DD_NETOBJTYPE_GAMEINFO, "game_info", "GameFlags GameStateFlags RoundStartTick WarmupTimer ScoreLimit TimeLimit RoundNum RoundCurrent"},
+    {DD_NETOBJTYPE_GAMEDATA, "game_data", "TeamscoreRed TeamscoreBlue FlagCarrierRed FlagCarrierBlue"},
+    {DD_NETOBJTYPE_CHARACTERCORE, "character_core", "Tick X Y VelX VelY Angle Direction Jumped HookedPlayer HookState HookTick HookX HookY HookDx HookDy"},
+    {DD_NETOBJTYPE_CHARACTER, "character",
+     "Tick X Y VelX VelY Angle Direction Jumped HookedPlayer HookState HookTick HookX HookY HookDx HookDy PlayerFlags Health Armor AmmoCount Weapon "
+     "Emote AttackTick"},
+    {DD_NETOBJTYPE_PLAYERINFO, "player_info", "Local ClientId Team Score Latency"},
+    {DD_NETOBJTYPE_CLIENTINFO, "client_info",
+     "Name0 Name1 Name2 Name3 Clan0 Clan1 Clan2 Country Skin0 Skin1 Skin2 Skin3 Skin4 Skin5 UseCustomColor ColorBody ColorFeet"},
+    {DD_NETOBJTYPE_SPECTATORINFO, "spectator_info", "SpectatorId X Y"},
+    {DD_NETEVENTTYPE_COMMON, "common", "X Y"},
+    {DD_NETEVENTTYPE_EXPLOSION, "explosion", "X Y"},
+    {DD_NETEVENTTYPE_SPAWN, "spawn", "X Y"},
+    {DD_NETEVENTTYPE_HAMMERHIT, "hammer_hit", "X Y"},
+    {DD_NETEVENTTYPE_DEATH, "death", "X Y ClientId"},
+    {DD_NETEVENTTYPE_SOUNDGLOBAL, "sound_global", "X Y SoundId"},
+    {DD_NETEVENTTYPE_SOUNDWORLD, "sound_world", "X Y SoundId"},
+    {DD_NETEVENTTYPE_DAMAGEIND, "damage_ind", "X Y Angle"},
+    {DD_NETOBJTYPE_MYOWNOBJECT, "my_own_object", "Test"},
+    {DD_NETOBJTYPE_DDNETCHARACTER, "ddnet_character",
+     "Flags FreezeEnd Jumps TeleCheckpoint StrongWeakId JumpedTotal NinjaActivationTick FreezeStart TargetX TargetY TuneZoneOverride"},
+    {DD_NETOBJTYPE_DDNETPLAYER, "ddnet_player", "Flags AuthLevel"},
+    {DD_NETOBJTYPE_GAMEINFOEX, "game_info_ex", "Flags Version Flags2"},
+    {DD_NETOBJTYPE_DDRACEPROJECTILE, "ddrace_projectile", "X Y Angle Data Type StartTick"},
+    {DD_NETOBJTYPE_DDNETLASER, "ddnet_laser", "ToX ToY FromX FromY StartTick Owner Type SwitchNumber Subtype Flags"},
+    {DD_NETOBJTYPE_DDNETPROJECTILE, "ddnet_projectile", "X Y VelX VelY Type StartTick Owner SwitchNumber TuneZone Flags"},
+    {DD_NETOBJTYPE_DDNETPICKUP, "ddnet_pickup", "X Y Type Subtype SwitchNumber Flags"},
+    {DD_NETOBJTYPE_DDNETSPECTATORINFO, "ddnet_spectator_info", "HasCameraInfo Zoom Deadzone FollowFactor SpectatorCount"},
+    {DD_NETEVENTTYPE_BIRTHDAY, "birthday", "X Y"},
+    {DD_NETEVENTTYPE_FINISH, "finish", "X Y"},
+    {DD_NETOBJTYPE_MYOWNEVENT, "my_own_event", "Test"},
+    {DD_NETOBJTYPE_SPECCHAR, "spec_char", "X Y"},
+    {DD_NETOBJTYPE_SWITCHSTATE, "switch_state",
+     "HighestSwitchNumber Status0 Status1 Status2 Status3 Status4 Status5 Status6 Status7 SwitchNumber0 SwitchNumber1 SwitchNumber2 SwitchNumber3 "
+     "EndTick0 EndTick1 EndTick2 EndTick3"},
+    {DD_NETOBJTYPE_ENTITYEX, "entity_ex", "SwitchNumber Layer EntityClass"},
+    {DD_NETEVENTTYPE_MAPSOUNDWORLD, "map_sound_world", "X Y SoundId"},
+};
+
+static const dd_column_schema *dd_column_schema_find(int type) {
+  for (size_t i = 0; i < sizeof(g_dd_column_schemas) / sizeof(g_dd_column_schemas[0]); i++) {
+    if (g_dd_column_schemas[i].type == type) return &g_dd_column_schemas[i];
+  }
+  return NULL;
+}
+
+const char *demo_item_schema(int type, const char **fields) {
+  const dd_column_schema *schema = dd_column_schema_find(type);
+  if (fields) *fields = schema ? schema->fields : NULL;
+  return schema ? schema->name : NULL;
+}
+
+#define DD_COLUMN_ALIGN 64
+#define DD_COLUMN_MAX_COLUMNS 256
+
+typedef struct {
+  FILE *f;
+  int64_t pos;
+  dd_column_header header;
+  int rows; // in the chunk being filled
+  int32_t *columns; // num_columns arrays of rows_per_chunk
+  dd_column_chunk *chunks;
+  dd_column_stats *stats;
+  int chunk_capacity;
+  bool error;
+} dd_column_writer;
+
+static void dd_column_write(dd_column_writer *cw, const void *data, size_t size) {
+  if (size && fwrite(data, size, 1, cw->f) != 1) cw->error = true;
+  cw->pos += size;
+}
+
+static void dd_column_pad(dd_column_writer *cw, int align) {
+  static const uint8_t zeros[DD_COLUMN_ALIGN] = {0};
+  int padding = (int)((align - cw->pos % align) % align);
+  dd_column_write(cw, zeros, padding);
+}
+
+static bool dd_column_writer_open(dd_column_writer *cw, int type, int item_size, const char *path_prefix, int rows_per_chunk) {
+  const dd_column_schema *schema = dd_column_schema_find(type);
+  char names[DD_COLUMN_MAX_COLUMNS][DD_COLUMN_NAME_SIZE];
+  memset(names, 0, sizeof(names));
+  strcpy(names[0], "tick");
+  strcpy(names[1], "id");
+  int num_columns = 2;
+  if (schema) {
+    for (const char *field = schema->fields; *field && num_columns < DD_COLUMN_MAX_COLUMNS; num_columns++) {
+      size_t len = strcspn(field, " ");
+      memcpy(names[num_columns], field, len < DD_COLUMN_NAME_SIZE - 1 ? len : DD_COLUMN_NAME_SIZE - 1);
+      field += len;
+      while (*field == ' ')
+        field++;
+    }
+  } else {
+    for (int i = 0; i < item_size / 4 && num_columns < DD_COLUMN_MAX_COLUMNS; i++)
+      snprintf(names[num_columns++], DD_COLUMN_NAME_SIZE, "f%d", i);
+  }
+
+  memset(&cw->header, 0, sizeof(cw->header));
+  memcpy(cw->header.magic, "DDCOLS1", 8);
+  cw->header.type = type;
+  cw->header.num_columns = num_columns;
+  cw->header.rows_per_chunk = rows_per_chunk;
+  if (schema) snprintf(cw->header.name, sizeof(cw->header.name), "%s", schema->name);
+  else snprintf(cw->header.name, sizeof(cw->header.name), "type%d", type);
+
+  char path[1024];
+  snprintf(path, sizeof(path), "%s%s.ddcol", path_prefix, cw->header.name);
+  cw->columns = (int32_t *)malloc((size_t)num_columns * rows_per_chunk * sizeof(int32_t));
+  cw->f = cw->columns ? fopen(path, "wb") : NULL;
+  if (!cw->f) {
+    cw->error = true;
+    return false;
+  }
+  // the header is written again with the counts once the file is complete
+  dd_column_write(cw, &cw->header, sizeof(cw->header));
+  dd_column_write(cw, names, (size_t)num_columns * DD_COLUMN_NAME_SIZE);
+  return !cw->error;
+}
+
+static void dd_column_flush_chunk(dd_column_writer *cw) {
+  if (cw->rows == 0 || cw->error) return;
+  int num_columns = cw->header.num_columns;
+  if (cw->header.num_chunks == cw->chunk_capacity) {
+    int capacity = cw->chunk_capacity ? cw->chunk_capacity * 2 : 16;
+    dd_column_chunk *chunks = (dd_column_chunk *)realloc(cw->chunks, capacity * sizeof(dd_column_chunk));
+    if (chunks) cw->chunks = chunks;
+    dd_column_stats *stats = (dd_column_stats *)realloc(cw->stats, (size_t)capacity * num_columns * sizeof(dd_column_stats));
+    if (stats) cw->stats = stats;
+    if (!chunks || !stats) {
+      cw->error = true;
+      return;
+    }
+    cw->chunk_capacity = capacity;
+  }
+
+  dd_column_pad(cw, DD_COLUMN_ALIGN);
+  dd_column_chunk *chunk = &cw->chunks[cw->header.num_chunks];
+  chunk->offset = cw->pos;
+  chunk->num_rows = cw->rows;
+  chunk->column_stride = (cw->rows * (int)sizeof(int32_t) + DD_COLUMN_ALIGN - 1) & ~(DD_COLUMN_ALIGN - 1);
+  dd_column_stats *stats = &cw->stats[(size_t)cw->header.num_chunks * num_columns];
+  for (int c = 0; c < num_columns; c++) {
+    const int32_t *column = cw->columns + (size_t)c * cw->header.rows_per_chunk;
+    stats[c].min = stats[c].max = column[0];
+    for (int r = 1; r < cw->rows; r++) {
+      if (column[r] < stats[c].min) stats[c].min = column[r];
+      if (column[r] > stats[c].max) stats[c].max = column[r];
+    }
+    dd_column_write(cw, column, cw->rows * sizeof(int32_t));
+    dd_column_pad(cw, DD_COLUMN_ALIGN);
+  }
+  cw->header.num_chunks++;
+  cw->rows = 0;
+}
+
+static void dd_column_add_row(dd_column_writer *cw, int tick, int id, const int *data, int size) {
+  int32_t *columns = cw->columns;
+  int rows_per_chunk = cw->header.rows_per_chunk, num_fields = cw->header.num_columns - 2;
+  columns[cw->rows] = tick;
+  columns[rows_per_chunk + cw->rows] = id;
+  for (int i = 0; i < num_fields; i++)
+    columns[(size_t)(i + 2) * rows_per_chunk + cw->rows] = i < size / 4 ? data[i] : 0;
+  cw->header.num_rows++;
+  if (++cw->rows == rows_per_chunk) dd_column_flush_chunk(cw);
+}
+
+static bool dd_column_writer_close(dd_column_writer *cw) {
+  dd_column_flush_chunk(cw);
+  dd_column_pad(cw, 8);
+  cw->header.index_offset = cw->pos;
+  dd_column_write(cw, cw->chunks, cw->header.num_chunks * sizeof(dd_column_chunk));
+  dd_column_write(cw, cw->stats, (size_t)cw->header.num_chunks * cw->header.num_columns * sizeof(dd_column_stats));
+  if (!cw->error && (dd_fseek(cw->f, 0, SEEK_SET) != 0 || fwrite(&cw->header, sizeof(cw->header), 1, cw->f) != 1)) cw->error = true;
+  if (fclose(cw->f) != 0) cw->error = true;
+  free(cw->columns);
+  free(cw->chunks);
+  free(cw->stats);
+  return !cw->error;
+}
+
+int demo_export_columns(dd_demo_reader *dr, const char *path_prefix, int rows_per_chunk) {
+  if (rows_per_chunk <= 0) rows_per_chunk = DD_DEFAULT_COLUMN_ROWS;
+  // whole chunks keep the columns of the next chunk aligned too
+  rows_per_chunk = (rows_per_chunk + 15) & ~15;
+  dd_column_writer *writers = (dd_column_writer *)calloc(DD_MAX_REGISTERED_TYPES, sizeof(dd_column_writer));
+  uint8_t *unpacked = dd_reader_scratch(dr);
+  if (!writers || !unpacked) {
+    free(writers);
+    return -1;
+  }
+
+  bool ok = true;
+  dd_demo_chunk chunk;
+  while (ok && demo_r_next_chunk(dr, &chunk)) {
+    const dd_snapshot *snap = NULL;
+    if (chunk.type == DD_CHUNK_SNAP) {
+      snap = (const dd_snapshot *)chunk.data;
+    } else if (chunk.type == DD_CHUNK_SNAP_DELTA) {
+      ok = demo_r_unpack_delta(dr, chunk.data, chunk.size, unpacked) > 0;
+      snap = (const dd_snapshot *)unpacked;
+    }
+    if (!snap || !ok) continue;
+
+    for (int i = 0; i < snap->num_items; i++) {
+      const dd_snap_item *item = dd_snap_get_item(snap, i);
+      int type = demo_r_item_type(dr, item);
+      int slot = dd_type_slot(type);
+      if (type == DD_NETOBJTYPE_EX || slot < 0) continue;
+      dd_column_writer *cw = &writers[slot];
+      if (!cw->f && !cw->error && !dd_column_writer_open(cw, type, dd_snap_get_item_size(snap, i), path_prefix, rows_per_chunk)) ok = false;
+      if (cw->error) continue;
+      dd_column_add_row(cw, chunk.tick, dd_snap_item_id(item), dd_snap_item_data(item), dd_snap_get_item_size(snap, i));
+    }
+  }
+
+  int num_files = 0;
+  for (int slot = 0; slot < DD_MAX_REGISTERED_TYPES; slot++) {
+    if (!writers[slot].f) {
+      free(writers[slot].columns);
+      continue;
+    }
+    if (dd_column_writer_close(&writers[slot])) num_files++;
+    else ok = false;
+  }
+  free(writers);
+  return ok ? num_files : -1;
+}
+
+bool demo_col_open(dd_column_file *cf, const void *data, size_t size) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  const dd_column_header *header = (const dd_column_header *)data;
+  if (size < sizeof(dd_column_header) || memcmp(header->magic, "DDCOLS1", 8) != 0) return false;
+  if (header->num_columns < 2 || header->num_columns > DD_COLUMN_MAX_COLUMNS || header->num_chunks < 0 || header->rows_per_chunk <= 0) return false;
+  if (sizeof(dd_column_header) + (size_t)header->num_columns * DD_COLUMN_NAME_SIZE > size) return false;
+  size_t index_size = header->num_chunks * (sizeof(dd_column_chunk) + (size_t)header->num_columns * sizeof(dd_column_stats));
+  if (header->index_offset < 0 || header->index_offset % 8 != 0 || (uint64_t)header->index_offset + index_size > size) return false;
+
+  cf->header = header;
+  cf->column_names = (const char(*)[DD_COLUMN_NAME_SIZE])(bytes + sizeof(dd_column_header));
+  cf->chunks = (const dd_column_chunk *)(bytes + header->index_offset);
+  cf->stats = (const dd_column_stats *)(cf->chunks + header->num_chunks);
+  cf->data = bytes;
+  for (int i = 0; i < header->num_chunks; i++) {
+    const dd_column_chunk *chunk = &cf->chunks[i];
+    if (chunk->offset < 0 || chunk->offset % 4 != 0 || chunk->num_rows <= 0 || chunk->column_stride < chunk->num_rows * (int)sizeof(int32_t)) return false;
+    if ((uint64_t)chunk->offset + (uint64_t)chunk->column_stride * header->num_columns > size) return false;
+  }
+  return true;
+}
+
+int demo_col_find(const dd_column_file *cf, const char *name) {
+  for (int c = 0; c < cf->header->num_columns; c++) {
+    if (strncmp(cf->column_names[c], name, DD_COLUMN_NAME_SIZE) == 0) return c;
+  }
+  return -1;
+}
+
+const int32_t *demo_col_data(const dd_column_file *cf, int chunk, int column) {
+  if (chunk < 0 || chunk >= cf->header->num_chunks || column < 0 || column >= cf->header->num_columns) return NULL;
+  const dd_column_chunk *c = &cf->chunks[chunk];
+  return (const int32_t *)(cf->data + c->offset + (int64_t)c->column_stride * column);
+}
+
+const dd_column_stats *demo_col_stats(const dd_column_file *cf, int chunk, int column) {
+  if (chunk < 0 || chunk >= cf->header->num_chunks || column < 0 || column >= cf->header->num_columns) return NULL;
+  return &cf->stats[(size_t)chunk * cf->header->num_columns + column];
+}
+
+/******************************************************************************
+ *
+ * TRAJECTORIES AND GHOSTS
+ *
+ ******************************************************************************/
+
+// a sample is the demo tick followed by the ghost character fields
+#define DD_TRAJ_FIELDS (1 + (int)(sizeof(dd_ghost_character) / sizeof(int)))
+
+typedef struct {
+  uint8_t *data; // per sample and field the zigzag varint of v - 2 * prev + prev2
+  int size;
+  int capacity;
+  int num_samples;
+  int prev[DD_TRAJ_FIELDS];
+  int prev2[DD_TRAJ_FIELDS];
+  dd_ghost_character last; // latest state, a sample is only added when it changes
+  bool present;
+  bool frozen; // from the DDNet character, ghosts show frozen players with the ninja
+  int skin[9];
+  char name[16];
+} dd_client_trajectory;
+
+struct dd_trajectories {
+  dd_client_trajectory clients[DD_MAX_CLIENTS];
+  dd_ghost_run *runs;
+  int num_runs;
+  int runs_capacity;
+  bool error;
+};
+
+static void dd_traj_put(dd_client_trajectory *ct, const int *fields, bool *error) {
+  if (ct->size + DD_TRAJ_FIELDS * 5 > ct->capacity) {
+    int capacity = ct->capacity ? ct->capacity * 2 : 1024;
+    uint8_t *data = (uint8_t *)realloc(ct->data, capacity);
+    if (!data) {
+      *error = true;
+      return;
+    }
+    ct->data = data;
+    ct->capacity = capacity;
+  }
+  for (int f = 0; f < DD_TRAJ_FIELDS; f++) {
+    uint32_t dod = (uint32_t)fields[f] - 2u * (uint32_t)ct->prev[f] + (uint32_t)ct->prev2[f];
+    uint32_t zigzag = (dod << 1) ^ (uint32_t)((int32_t)dod >> 31);
+    while (zigzag >= 0x80) {
+      ct->data[ct->size++] = (uint8_t)(zigzag | 0x80);
+      zigzag >>= 7;
+    }
+    ct->data[ct->size++] = (uint8_t)zigzag;
+    ct->prev2[f] = ct->prev[f];
+    ct->prev[f] = fields[f];
+  }
+  ct->num_samples++;
+}
+
+static void dd_traj_add_character(dd_trajectories *t, int tick, int client_id, const dd_netobj_character *character) {
+  if (client_id < 0 || client_id >= DD_MAX_CLIENTS) return;
+  dd_client_trajectory *ct = &t->clients[client_id];
+  const dd_netobj_character_core *core = &character->core;
+  dd_ghost_character ghost = {core->m_X,        core->m_Y,     core->m_VelX,     core->m_VelY,
+                              core->m_Angle,    core->m_Direction,
+                              ct->frozen ? DD_WEAPON_NINJA : character->m_Weapon,
+                              core->m_HookState, core->m_HookX, core->m_HookY, character->m_AttackTick, core->m_Tick};
+  if (ct->present && memcmp(&ghost, &ct->last, sizeof(ghost)) == 0) return;
+  ct->last = ghost;
+  ct->present = true;
+
+  int fields[DD_TRAJ_FIELDS];
+  fields[0] = tick;
+  memcpy(fields + 1, &ghost, sizeof(ghost));
+  dd_traj_put(ct, fields, &t->error);
+}
+
+/* Takes the characters and client infos of a (projected) snapshot. */
+static void dd_traj_add_snapshot(dd_trajectories *t, dd_demo_reader *dr, int tick, const dd_snapshot *snap) {
+  // DDNet characters come after the characters in a sorted snapshot, so the freeze state is taken first
+  for (int i = 0; i < snap->num_items; i++) {
+    const dd_snap_item *item = dd_snap_get_item(snap, i);
+    int id = dd_snap_item_id(item);
+    if (id < 0 || id >= DD_MAX_CLIENTS) continue;
+    int type = demo_r_item_type(dr, item);
+    if (type == DD_NETOBJTYPE_DDNETCHARACTER && dd_snap_get_item_size(snap, i) >= (int)(2 * sizeof(int))) {
+      t->clients[id].frozen = ((const dd_netobj_ddnet_character *)dd_snap_item_data(item))->m_FreezeEnd != 0;
+    } else if (type == DD_NETOBJTYPE_CLIENTINFO && dd_snap_get_item_size(snap, i) >= (int)sizeof(dd_netobj_client_info)) {
+      const dd_netobj_client_info *info = (const dd_netobj_client_info *)dd_snap_item_data(item);
+      dd_client_trajectory *ct = &t->clients[id];
+      memcpy(ct->skin, info->m_aSkin, sizeof(info->m_aSkin));
+      ct->skin[6] = info->m_UseCustomColor;
+      ct->skin[7] = info->m_ColorBody;
+      ct->skin[8] = info->m_ColorFeet;
+      // names are packed 4 characters per int, big endian and offset by 128
+      for (int c = 0; c < 15; c++)
+        ct->name[c] = (char)(((info->m_aName[c / 4] >> (24 - (c % 4) * 8)) & 0xff) - 128);
+      ct->name[15] = '\0';
+    }
+  }
+
+  bool present[DD_MAX_CLIENTS] = {false};
+  for (int i = 0; i < snap->num_items; i++) {
+    const dd_snap_item *item = dd_snap_get_item(snap, i);
+    if (demo_r_item_type(dr, item) != DD_NETOBJTYPE_CHARACTER || dd_snap_get_item_size(snap, i) < (int)sizeof(dd_netobj_character)) continue;
+    int id = dd_snap_item_id(item);
+    dd_traj_add_character(t, tick, id, (const dd_netobj_character *)dd_snap_item_data(item));
+    if (id >= 0 && id < DD_MAX_CLIENTS) present[id] = true;
+  }
+  for (int id = 0; id < DD_MAX_CLIENTS; id++) {
+    if (!present[id]) t->clients[id].present = false;
+  }
+}
+
+static void dd_traj_add_run(dd_trajectories *t, const dd_event *event) {
+  if (event->client_id < 0 || event->client_id >= DD_MAX_CLIENTS || event->data[0] <= 0) return;
+  if (t->num_runs == t->runs_capacity) {
+    int capacity = t->runs_capacity ? t->runs_capacity * 2 : 16;
+    dd_ghost_run *runs = (dd_ghost_run *)realloc(t->runs, capacity * sizeof(dd_ghost_run));
+    if (!runs) {
+      t->error = true;
+      return;
+    }
+    t->runs = runs;
+    t->runs_capacity = capacity;
+  }
+  const dd_client_trajectory *ct = &t->clients[event->client_id];
+  dd_ghost_run *run = &t->runs[t->num_runs++];
+  run->client_id = event->client_id;
+  run->finish_tick = event->tick;
+  run->time_ms = event->data[0];
+  run->start_tick = event->tick - (int)((int64_t)event->data[0] * DD_SERVER_TICK_SPEED / 1000);
+  memcpy(run->name, ct->name, sizeof(run->name));
+  memcpy(run->skin, ct->skin, sizeof(run->skin));
+}
+
+dd_trajectories *demo_extract_trajectories(dd_demo_reader *dr) {
+  dd_trajectories *t = (dd_trajectories *)calloc(1, sizeof(dd_trajectories));
+  uint8_t *unpacked = dd_reader_scratch(dr);
+  if (!t || !unpacked) {
+    free(t);
+    return NULL;
+  }
+  static const int types[] = {DD_NETOBJTYPE_CHARACTER, DD_NETOBJTYPE_DDNETCHARACTER, DD_NETOBJTYPE_CLIENTINFO};
+  demo_r_subscribe_types(dr, types, sizeof(types) / sizeof(types[0]));
+
+  dd_demo_chunk chunk;
+  dd_event event;
+  while (!t->error && demo_r_next_chunk(dr, &chunk)) {
+    switch (chunk.type) {
+    case DD_CHUNK_SNAP:
+      dd_traj_add_snapshot(t, dr, chunk.tick, (const dd_snapshot *)chunk.data);
+      break;
+    case DD_CHUNK_SNAP_DELTA:
+      if (demo_r_unpack_delta(dr, chunk.data, chunk.size, unpacked) < 0) t->error = true;
+      else dd_traj_add_snapshot(t, dr, chunk.tick, (const dd_snapshot *)unpacked);
+      break;
+    case DD_CHUNK_MSG:
+      if (dd_event_from_msg(&chunk, DD_EVENT_MASK(DD_EVENT_RACE_FINISH), &event)) dd_traj_add_run(t, &event);
+      break;
+    }
+  }
+
+  if (t->error) demo_traj_destroy(&t);
+  return t;
+}
+
+void demo_traj_destroy(dd_trajectories **trajectories_ptr) {
+  dd_trajectories *t = *trajectories_ptr;
+  if (!t) return;
+  for (int i = 0; i < DD_MAX_CLIENTS; i++)
+    free(t->clients[i].data);
+  free(t->runs);
+  free(t);
+  *trajectories_ptr = NULL;
+}
+
+int demo_traj_num_samples(const dd_trajectories *trajectories, int client_id) {
+  if (client_id < 0 || client_id >= DD_MAX_CLIENTS) return 0;
+  return trajectories->clients[client_id].num_samples;
+}
+
+int demo_traj_decode(const dd_trajectories *trajectories, int client_id, int start_tick, int end_tick, dd_trajectory_sample *samples, int max_samples) {
+  if (client_id < 0 || client_id >= DD_MAX_CLIENTS) return 0;
+  const dd_client_trajectory *ct = &trajectories->clients[client_id];
+  int prev[DD_TRAJ_FIELDS] = {0}, prev2[DD_TRAJ_FIELDS] = {0};
+  int num_samples = 0, pos = 0;
+  for (int s = 0; s < ct->num_samples && num_samples < max_samples; s++) {
+    int fields[DD_TRAJ_FIELDS];
+    for (int f = 0; f < DD_TRAJ_FIELDS; f++) {
+      uint32_t zigzag = 0;
+      for (int shift = 0;; shift += 7) {
+        uint8_t byte = ct->data[pos++];
+        zigzag |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) break;
+      }
+      uint32_t dod = (zigzag >> 1) ^ (0u - (zigzag & 1));
+      fields[f] = (int)(dod + 2u * (uint32_t)prev[f] - (uint32_t)prev2[f]);
+      prev2[f] = prev[f];
+      prev[f] = fields[f];
+    }
+    if (fields[0] > end_tick) break;
+    if (fields[0] < start_tick) continue;
+    samples[num_samples].tick = fields[0];
+    memcpy(&samples[num_samples].character, fields + 1, sizeof(dd_ghost_character));
+    num_samples++;
+  }
+  return num_samples;
+}
+
+int demo_traj_num_runs(const dd_trajectories *trajectories) { return trajectories->num_runs; }
+
+const dd_ghost_run *demo_traj_run(const dd_trajectories *trajectories, int index) {
+  return index >= 0 && index < trajectories->num_runs ? &trajectories->runs[index] : NULL;
+}
+
+/*
+ * Ghost files: a header, then chunks of up to 50 items of one type (type, item count and big endian size in 4 bytes,
+ * then the items varint packed and huffman compressed). An item that follows one of the same type, even in the
+ * previous chunk, is stored as the difference to it.
+ */
+enum {
+  DD_GHOSTDATA_TYPE_SKIN = 0,
+  DD_GHOSTDATA_TYPE_CHARACTER_NO_TICK,
+  DD_GHOSTDATA_TYPE_CHARACTER,
+  DD_GHOSTDATA_TYPE_START_TICK,
+};
+#define DD_GHOST_VERSION 6
+#define DD_GHOST_HEADER_SIZE 133
+#define DD_GHOST_NUM_TICKS_OFFSET 93
+#define DD_GHOST_ITEMS_PER_CHUNK 50
+#define DD_GHOST_MAX_ITEM_SIZE 64
+
+typedef struct {
+  FILE *f;
+  dd_huffman_state *huffman;
+  int buffer[DD_GHOST_ITEMS_PER_CHUNK * DD_GHOST_MAX_ITEM_SIZE / 4];
+  int buffer_size; // ints
+  int num_items;
+  int last_type;
+  int last_item[DD_GHOST_MAX_ITEM_SIZE / 4];
+  bool error;
+} dd_ghost_writer;
+
+static void dd_ghost_flush_chunk(dd_ghost_writer *gw) {
+  if (gw->buffer_size == 0) return;
+  uint8_t compressed[sizeof(gw->buffer) * 2];
+  int size = dd_data_compress(gw->huffman, gw->buffer, gw->buffer_size * sizeof(int), compressed, sizeof(compressed));
+  uint8_t header[4] = {(uint8_t)gw->last_type, (uint8_t)gw->num_items, (uint8_t)(size >> 8), (uint8_t)size};
+  if (size < 0 || fwrite(header, sizeof(header), 1, gw->f) != 1 || fwrite(compressed, size, 1, gw->f) != 1) gw->error = true;
+  gw->buffer_size = 0;
+  gw->num_items = 0;
+}
+
+static void dd_ghost_write_item(dd_ghost_writer *gw, int type, const void *data, int size) {
+  const int *item = (const int *)data;
+  int num_ints = size / 4;
+  if (gw->last_type == type) {
+    for (int i = 0; i < num_ints; i++)
+      gw->buffer[gw->buffer_size + i] = (int)((uint32_t)item[i] - (uint32_t)gw->last_item[i]);
+  } else {
+    dd_ghost_flush_chunk(gw);
+    memcpy(gw->buffer + gw->buffer_size, item, size);
+  }
+  memcpy(gw->last_item, item, size);
+  gw->last_type = type;
+  gw->buffer_size += num_ints;
+  if (++gw->num_items == DD_GHOST_ITEMS_PER_CHUNK) dd_ghost_flush_chunk(gw);
+}
+
+static void dd_be_put_int(uint8_t *dst, int value) {
+  dst[0] = (uint8_t)(value >> 24);
+  dst[1] = (uint8_t)(value >> 16);
+  dst[2] = (uint8_t)(value >> 8);
+  dst[3] = (uint8_t)value;
+}
+
+bool demo_write_ghost(const dd_trajectories *trajectories, int run_index, const dd_demo_info *info, FILE *f) {
+  const dd_ghost_run *run = demo_traj_run(trajectories, run_index);
+  if (!run) return false;
+  int max_samples = run->finish_tick - run->start_tick + 1;
+  dd_trajectory_sample *samples = (dd_trajectory_sample *)malloc(max_samples * sizeof(dd_trajectory_sample));
+  dd_ghost_writer *gw = (dd_ghost_writer *)calloc(1, sizeof(dd_ghost_writer));
+  dd_huffman_state *huffman = (dd_huffman_state *)malloc(sizeof(dd_huffman_state));
+  bool ok = samples && gw && huffman;
+  if (ok) {
+    int num_samples = demo_traj_decode(trajectories, run->client_id, run->start_tick, run->finish_tick, samples, max_samples);
+    dd_huffman_init(huffman);
+    gw->f = f;
+    gw->huffman = huffman;
+    gw->last_type = -1;
+
+    uint8_t header[DD_GHOST_HEADER_SIZE] = {'T', 'W', 'G', 'H', 'O', 'S', 'T', 0, DD_GHOST_VERSION};
+    memcpy(header + 9, run->name, dd_str_nlen(run->name, 15));
+    memcpy(header + 25, info->header.map_name, dd_str_nlen(info->header.map_name, 63));
+    dd_be_put_int(header + DD_GHOST_NUM_TICKS_OFFSET, num_samples);
+    dd_be_put_int(header + DD_GHOST_NUM_TICKS_OFFSET + 4, run->time_ms);
+    if (info->has_sha256) memcpy(header + DD_GHOST_NUM_TICKS_OFFSET + 8, info->map_sha256, 32);
+    ok = fwrite(header, sizeof(header), 1, f) == 1;
+
+    dd_ghost_write_item(gw, DD_GHOSTDATA_TYPE_START_TICK, &run->start_tick, sizeof(int));
+    dd_ghost_write_item(gw, DD_GHOSTDATA_TYPE_SKIN, run->skin, sizeof(run->skin));
+    for (int i = 0; i < num_samples; i++)
+      dd_ghost_write_item(gw, DD_GHOSTDATA_TYPE_CHARACTER, &samples[i].character, sizeof(dd_ghost_character));
+    dd_ghost_flush_chunk(gw);
+    ok = ok && !gw->error;
+  }
+  free(huffman);
+  free(gw);
+  free(samples);
+  return ok;
+}
+
+/******************************************************************************
+ *
+ * SPATIAL INDEX
+ *
+ ******************************************************************************/
+
+#define DD_GRID_CELL_SHIFT 10 // 1024 units (32 tiles) per cell
+#define DD_GRID_CELL_SIZE (1 << DD_GRID_CELL_SHIFT)
+#define DD_GRID_BUCKETS 4096 // cells are hashed, so the grid covers any map size
+#define DD_GRID_BIG DD_GRID_BUCKETS // bucket of items spanning more than a cell (long lasers)
+#define DD_GRID_KEY_BUCKETS 2048
+
+typedef struct {
+  int key;
+  int type; // public type
+  int bounds[4]; // x0, y0, x1, y1
+  int bucket;
+  int prev; // neighbours in the bucket, -1 at the ends
+  int next; // also links the free entries
+  int key_next;
+  unsigned stamp; // last query that found the entry
+} dd_grid_entry;
+
+/*
+ * Items with a position indexed by the cell of their top left corner. Items are at most a cell wide, so a rectangle
+ * only has to look at the cells it covers plus one row and column to the top and left. Keyed by type_and_id and
+ * updated from the change feed of the deltas; when EX items change the extended types can't be trusted during the
+ * visit, the grid is marked stale and rebuilt from the new snapshot instead.
+ */
+struct dd_spatial_index {
+  dd_demo_reader *dr;
+  dd_grid_entry entries[DD_MAX_SNAPSHOT_ITEMS];
+  int free_entry;
+  int buckets[DD_GRID_BUCKETS + 1];
+  int key_buckets[DD_GRID_KEY_BUCKETS];
+  int num_entries;
+  unsigned stamp;
+  bool stale;
+};
+
+/* Bounds of the items that have a position, as the server clips them (projectiles at their start position). */
+static bool dd_item_bounds(int type, const int *data, int size, int bounds[4]) {
+  int num_ints = size / (int)sizeof(int), x = 0, y = 1;
+  switch (type) {
+  case DD_NETOBJTYPE_CHARACTER:
+    x = 1;
+    y = 2;
+    break;
+  case DD_NETOBJTYPE_LASER:
+  case DD_NETOBJTYPE_DDNETLASER:
+    if (num_ints < 4) return false;
+    bounds[0] = data[0] < data[2] ? data[0] : data[2];
+    bounds[1] = data[1] < data[3] ? data[1] : data[3];
+    bounds[2] = data[0] < data[2] ? data[2] : data[0];
+    bounds[3] = data[1] < data[3] ? data[3] : data[1];
+    return true;
+  case DD_NETOBJTYPE_PROJECTILE:
+  case DD_NETOBJTYPE_PICKUP:
+  case DD_NETOBJTYPE_FLAG:
+  case DD_NETEVENTTYPE_COMMON:
+  case DD_NETEVENTTYPE_EXPLOSION:
+  case DD_NETEVENTTYPE_SPAWN:
+  case DD_NETEVENTTYPE_HAMMERHIT:
+  case DD_NETEVENTTYPE_DEATH:
+  case DD_NETEVENTTYPE_SOUNDWORLD:
+  case DD_NETEVENTTYPE_DAMAGEIND:
+  case DD_NETOBJTYPE_DDRACEPROJECTILE:
+  case DD_NETOBJTYPE_DDNETPROJECTILE:
+  case DD_NETOBJTYPE_DDNETPICKUP:
+  case DD_NETEVENTTYPE_BIRTHDAY:
+  case DD_NETEVENTTYPE_FINISH:
+  case DD_NETOBJTYPE_SPECCHAR:
+  case DD_NETEVENTTYPE_MAPSOUNDWORLD:
+    break;
+  default:
+    return false;
+  }
+  if (num_ints <= y) return false;
+  bounds[0] = bounds[2] = data[x];
+  bounds[1] = bounds[3] = data[y];
+  return true;
+}
+
+static int dd_grid_bucket(int cell_x, int cell_y) {
+  return (int)(((unsigned)cell_x * 73856093u ^ (unsigned)cell_y * 19349663u) & (DD_GRID_BUCKETS - 1));
+}
+
+static int dd_grid_item_bucket(const int bounds[4]) {
+  // unsigned, the subtraction may overflow for far apart points
+  if ((unsigned)bounds[2] - (unsigned)bounds[0] > DD_GRID_CELL_SIZE || (unsigned)bounds[3] - (unsigned)bounds[1] > DD_GRID_CELL_SIZE)
+    return DD_GRID_BIG;
+  return dd_grid_bucket(bounds[0] >> DD_GRID_CELL_SHIFT, bounds[1] >> DD_GRID_CELL_SHIFT);
+}
+
+static int dd_grid_key_bucket(int key) { return (int)(((unsigned)key * 2654435761u) >> 21) & (DD_GRID_KEY_BUCKETS - 1); }
+
+static void dd_grid_clear(dd_spatial_index *grid) {
+  memset(grid->buckets, 0xff, sizeof(grid->buckets));
+  memset(grid->key_buckets, 0xff, sizeof(grid->key_buckets));
+  for (int i = 0; i < DD_MAX_SNAPSHOT_ITEMS; i++)
+    grid->entries[i].next = i + 1 < DD_MAX_SNAPSHOT_ITEMS ? i + 1 : -1;
+  grid->free_entry = 0;
+  grid->num_entries = 0;
+  grid->stale = false;
+}
+
+static int dd_grid_find(const dd_spatial_index *grid, int key) {
+  int e = grid->key_buckets[dd_grid_key_bucket(key)];
+  while (e >= 0 && grid->entries[e].key != key)
+    e = grid->entries[e].key_next;
+  return e;
+}
+
+static void dd_grid_link(dd_spatial_index *grid, int e) {
+  dd_grid_entry *entry = &grid->entries[e];
+  entry->prev = -1;
+  entry->next = grid->buckets[entry->bucket];
+  if (entry->next >= 0) grid->entries[entry->next].prev = e;
+  grid->buckets[entry->bucket] = e;
+}
+
+static void dd_grid_unlink(dd_spatial_index *grid, int e) {
+  dd_grid_entry *entry = &grid->entries[e];
+  if (entry->prev >= 0) grid->entries[entry->prev].next = entry->next;
+  else grid->buckets[entry->bucket] = entry->next;
+  if (entry->next >= 0) grid->entries[entry->next].prev = entry->prev;
+}
+
+static void dd_grid_remove(dd_spatial_index *grid, int key) {
+  int *link = &grid->key_buckets[dd_grid_key_bucket(key)];
+  while (*link >= 0 && grid->entries[*link].key != key)
+    link = &grid->entries[*link].key_next;
+  int e = *link;
+  if (e < 0) return;
+  *link = grid->entries[e].key_next;
+  dd_grid_unlink(grid, e);
+  grid->entries[e].next = grid->free_entry;
+  grid->free_entry = e;
+  grid->num_entries--;
+}
+
+/* Adds the item or moves it to its new bounds, items without a position are left out. */
+static void dd_grid_set(dd_spatial_index *grid, int key, int type, const int *data, int size) {
+  int bounds[4];
+  if (!dd_item_bounds(type, data, size, bounds)) return;
+  int bucket = dd_grid_item_bucket(bounds);
+  int e = dd_grid_find(grid, key);
+  if (e < 0) {
+    e = grid->free_entry;
+    if (e < 0) return; // can't happen, a snapshot has at most as many items
+    grid->free_entry = grid->entries[e].next;
+    int *key_bucket = &grid->key_buckets[dd_grid_key_bucket(key)];
+    grid->entries[e].key = key;
+    grid->entries[e].key_next = *key_bucket;
+    grid->entries[e].stamp = 0;
+    *key_bucket = e;
+    grid->num_entries++;
+  } else if (grid->entries[e].bucket != bucket) {
+    dd_grid_unlink(grid, e);
+  } else {
+    memcpy(grid->entries[e].bounds, bounds, sizeof(bounds));
+    return;
+  }
+  dd_grid_entry *entry = &grid->entries[e];
+  entry->type = type;
+  entry->bucket = bucket;
+  memcpy(entry->bounds, bounds, sizeof(bounds));
+  dd_grid_link(grid, e);
+}
+
+static void dd_grid_build(dd_spatial_index *grid, const dd_snapshot *snap) {
+  dd_grid_clear(grid);
+  for (int i = 0; i < snap->num_items; i++) {
+    const dd_snap_item *item = dd_snap_get_item(snap, i);
+    dd_grid_set(grid, item->type_and_id, demo_r_item_type(grid->dr, item), dd_snap_item_data(item), dd_snap_get_item_size(snap, i));
+  }
+}
+
+static void dd_grid_item_removed(void *user, int key, const int *old_data, const int *new_data, int size) {
+  (void)old_data, (void)new_data, (void)size;
+  dd_spatial_index *grid = (dd_spatial_index *)user;
+  if (!grid->stale) dd_grid_remove(grid, key);
+}
+
+static void dd_grid_item_changed(void *user, int key, const int *old_data, const int *new_data, int size) {
+  (void)old_data;
+  dd_spatial_index *grid = (dd_spatial_index *)user;
+  if (grid->stale || grid->dr->parsed_delta.ex_changed) {
+    grid->stale = true;
+    return;
+  }
+  dd_grid_set(grid, key, dd_reader_public_type(grid->dr, key >> 16), new_data, size);
+}
+
+static const dd_delta_visitor g_dd_grid_visitor = {dd_grid_item_removed, dd_grid_item_changed, dd_grid_item_changed};
+
+typedef struct {
+  int rect[4];
+  bool collect; // false: only stamp the entries within `rect`
+  const int *types;
+  int num_types;
+  bool round; // only hits within `radius` of (x, y)
+  int x;
+  int y;
+  int64_t radius_sq;
+  dd_spatial_hit *hits;
+  int max_hits;
+  int num_hits;
+} dd_grid_query;
+
+static bool dd_grid_query_matches(const dd_grid_query *q, const dd_grid_entry *entry) {
+  if (q->types) {
+    int t = 0;
+    while (t < q->num_types && q->types[t] != entry->type)
+      t++;
+    if (t == q->num_types) return false;
+  }
+  if (!q->round) return true;
+  // distance to the closest point of the bounds
+  int64_t dx = q->x < entry->bounds[0] ? (int64_t)entry->bounds[0] - q->x : q->x > entry->bounds[2] ? (int64_t)q->x - entry->bounds[2] : 0;
+  int64_t dy = q->y < entry->bounds[1] ? (int64_t)entry->bounds[1] - q->y : q->y > entry->bounds[3] ? (int64_t)q->y - entry->bounds[3] : 0;
+  return dx * dx + dy * dy <= q->radius_sq;
+}
+
+static void dd_grid_query_bucket(dd_spatial_index *grid, int bucket, dd_grid_query *q) {
+  const int *rect = q->rect;
+  for (int e = grid->buckets[bucket]; e >= 0; e = grid->entries[e].next) {
+    dd_grid_entry *entry = &grid->entries[e];
+    // cells sharing a bucket are told apart by the bounds test, the stamp skips entries seen through another cell
+    if (entry->stamp == grid->stamp || entry->bounds[0] > rect[2] || entry->bounds[2] < rect[0] || entry->bounds[1] > rect[3] ||
+        entry->bounds[3] < rect[1])
+      continue;
+    entry->stamp = grid->stamp;
+    if (!q->collect || !dd_grid_query_matches(q, entry)) continue;
+    if (q->num_hits < q->max_hits) {
+      dd_spatial_hit *hit = &q->hits[q->num_hits];
+      hit->type = entry->type;
+      hit->id = entry->key & 0xffff;
+      memcpy(hit->bounds, entry->bounds, sizeof(hit->bounds));
+    }
+    q->num_hits++;
+  }
+}
+
+/* Visits the entries intersecting the query rectangle, which end up with a new stamp that is returned. */
+static unsigned dd_grid_run_query(dd_spatial_index *grid, dd_grid_query *q) {
+  unsigned stamp = ++grid->stamp;
+  int64_t cell_x0 = ((int64_t)q->rect[0] - DD_GRID_CELL_SIZE) >> DD_GRID_CELL_SHIFT, cell_x1 = q->rect[2] >> DD_GRID_CELL_SHIFT;
+  int64_t cell_y0 = ((int64_t)q->rect[1] - DD_GRID_CELL_SIZE) >> DD_GRID_CELL_SHIFT, cell_y1 = q->rect[3] >> DD_GRID_CELL_SHIFT;
+  if (cell_x1 < cell_x0 || cell_y1 < cell_y0) return stamp;
+  if ((cell_x1 - cell_x0 + 1) * (cell_y1 - cell_y0 + 1) > DD_GRID_BUCKETS) {
+    // covers more cells than there are buckets, every bucket is looked at once
+    for (int b = 0; b <= DD_GRID_BUCKETS; b++)
+      dd_grid_query_bucket(grid, b, q);
+    return stamp;
+  }
+  dd_grid_query_bucket(grid, DD_GRID_BIG, q);
+  for (int64_t cy = cell_y0; cy <= cell_y1; cy++) {
+    for (int64_t cx = cell_x0; cx <= cell_x1; cx++)
+      dd_grid_query_bucket(grid, dd_grid_bucket((int)cx, (int)cy), q);
+  }
+  return stamp;
+}
+
+/* Stamps the entries intersecting `rect` (x0, y0, x1, y1, inclusive) with a new stamp and returns it. */
+static unsigned dd_grid_mark(dd_spatial_index *grid, const int rect[4]) {
+  dd_grid_query q;
+  memset(&q, 0, sizeof(q));
+  memcpy(q.rect, rect, sizeof(q.rect));
+  return dd_grid_run_query(grid, &q);
+}
+
+dd_spatial_index *demo_si_create(dd_demo_reader *dr) {
+  dd_spatial_index *si = (dd_spatial_index *)malloc(sizeof(dd_spatial_index));
+  if (!si) return NULL;
+  si->dr = dr;
+  si->stamp = 0;
+  dd_grid_clear(si);
+  return si;
+}
+
+void demo_si_destroy(dd_spatial_index **si_ptr) {
+  if (si_ptr && *si_ptr) {
+    free(*si_ptr);
+    *si_ptr = NULL;
+  }
+}
+
+void demo_si_build(dd_spatial_index *si, const dd_snapshot *snap) { dd_grid_build(si, snap); }
+
+int demo_si_unpack_delta(dd_spatial_index *si, const void *delta_data, int delta_size, void *unpacked_snap) {
+  int size = demo_r_visit_delta(si->dr, delta_data, delta_size, &g_dd_grid_visitor, si, unpacked_snap);
+  if (size < 0) return size;
+  if (si->stale) dd_grid_build(si, (const dd_snapshot *)si->dr->last_snapshot_data);
+  return size;
+}
+
+int demo_si_num_items(const dd_spatial_index *si) { return si->num_entries; }
+
+int demo_si_query_rect(dd_spatial_index *si, int x0, int y0, int x1, int y1, const int *types, int num_types, dd_spatial_hit *hits, int max_hits) {
+  dd_grid_query q;
+  memset(&q, 0, sizeof(q));
+  q.rect[0] = x0;
+  q.rect[1] = y0;
+  q.rect[2] = x1;
+  q.rect[3] = y1;
+  q.collect = true;
+  q.types = types;
+  q.num_types = num_types;
+  q.hits = hits;
+  q.max_hits = hits ? max_hits : 0;
+  dd_grid_run_query(si, &q);
+  return q.num_hits;
+}
+
+static int dd_clamp_int(int64_t value) { return value < INT32_MIN ? INT32_MIN : value > INT32_MAX ? INT32_MAX : (int)value; }
+
+int demo_si_query_radius(dd_spatial_index *si, int x, int y, int radius, const int *types, int num_types, dd_spatial_hit *hits, int max_hits) {
+  if (radius < 0) return 0;
+  dd_grid_query q;
+  memset(&q, 0, sizeof(q));
+  q.rect[0] = dd_clamp_int((int64_t)x - radius);
+  q.rect[1] = dd_clamp_int((int64_t)y - radius);
+  q.rect[2] = dd_clamp_int((int64_t)x + radius);
+  q.rect[3] = dd_clamp_int((int64_t)y + radius);
+  q.collect = true;
+  q.types = types;
+  q.num_types = num_types;
+  q.round = true;
+  q.x = x;
+  q.y = y;
+  q.radius_sq = (int64_t)radius * radius;
+  q.hits = hits;
+  q.max_hits = hits ? max_hits : 0;
+  dd_grid_run_query(si, &q);
+  return q.num_hits;
+}
+
+/******************************************************************************
+ *
+ * PLAYER DEMUXER
+ *
+ ******************************************************************************/
+
+typedef struct {
+  dd_demo_writer *dw;
+  int view_x;
+  int view_y;
+  bool has_view;
+} dd_demux_state;
+
+typedef struct {
+  int x[DD_MAX_CLIENTS];
+  int y[DD_MAX_CLIENTS];
+  int zoom[DD_MAX_CLIENTS]; // 1000: 1.0
+  bool has_character[DD_MAX_CLIENTS];
+} dd_demux_views;
+
+/* Collects the character positions and camera zooms of all clients in one scan. */
+static void dd_demux_find_views(dd_demo_reader *dr, const dd_snapshot *snap, dd_demux_views *views) {
+  for (int c = 0; c < DD_MAX_CLIENTS; c++) {
+    views->zoom[c] = 1000;
+    views->has_character[c] = false;
+  }
+  for (int i = 0; i < snap->num_items; i++) {
+    const dd_snap_item *item = dd_snap_get_item(snap, i);
+    int id = dd_snap_item_id(item);
+    int type = demo_r_item_type(dr, item);
+    if (id < 0 || id >= DD_MAX_CLIENTS) continue;
+    if (type == DD_NETOBJTYPE_CHARACTER && dd_snap_get_item_size(snap, i) >= (int)sizeof(dd_netobj_character_core)) {
+      const dd_netobj_character_core *core = (const dd_netobj_character_core *)dd_snap_item_data(item);
+      views->x[id] = core->m_X;
+      views->y[id] = core->m_Y;
+      views->has_character[id] = true;
+    } else if (type == DD_NETOBJTYPE_DDNETSPECTATORINFO && dd_snap_get_item_size(snap, i) >= (int)sizeof(dd_netobj_ddnet_spectator_info)) {
+      const dd_netobj_ddnet_spectator_info *info = (const dd_netobj_ddnet_spectator_info *)dd_snap_item_data(item);
+      if (info->m_HasCameraInfo && info->m_Zoom > 0) views->zoom[id] = info->m_Zoom;
+    }
+  }
+}
+
+/* Writes the part of `snap` the output's client sees. */
+static bool dd_demux_write_snap(dd_spatial_index *si, dd_snapshot_builder *sb, const dd_demux_output *output, dd_demux_state *state,
+                                const dd_demux_views *views, int tick, const dd_snapshot *snap, void *out) {
+  int client_id = output->client_id, zoom = 1000;
+  if (client_id >= 0 && client_id < DD_MAX_CLIENTS) {
+    if (views->has_character[client_id]) {
+      state->view_x = views->x[client_id];
+      state->view_y = views->y[client_id];
+      state->has_view = true;
+    }
+    zoom = views->zoom[client_id];
+  }
+
+  unsigned stamp = si->stamp + 1; // matches nothing without a view
+  if (state->has_view) {
+    int half_width = (int)((int64_t)DD_DEMUX_VIEW_WIDTH / 2 * zoom / 1000);
+    int half_height = (int)((int64_t)DD_DEMUX_VIEW_HEIGHT / 2 * zoom / 1000);
+    int rect[4] = {state->view_x - half_width, state->view_y - half_height, state->view_x + half_width, state->view_y + half_height};
+    stamp = dd_grid_mark(si, rect);
+  }
+
+  int local_key = (DD_NETOBJTYPE_PLAYERINFO << 16) | client_id;
+  demo_sb_clear_into(sb, out, snap->num_items);
+  for (int i = 0; i < snap->num_items; i++) {
+    const dd_snap_item *item = dd_snap_get_item(snap, i);
+    int e = dd_grid_find(si, item->type_and_id);
+    if (e >= 0 && si->entries[e].stamp != stamp) continue;
+    int size = dd_snap_get_item_size(snap, i);
+    void *obj = demo_sb_add_raw_item(sb, dd_snap_item_type(item), dd_snap_item_id(item), size);
+    if (!obj) return false;
+    memcpy(obj, dd_snap_item_data(item), size);
+    if (item->type_and_id == local_key && size >= (int)sizeof(dd_netobj_player_info)) ((dd_netobj_player_info *)obj)->m_Local = 1;
+  }
+  int size = demo_sb_finish(sb, NULL);
+  return size > 0 && demo_w_write_snap(state->dw, tick, out, size);
+}
+
+bool demo_demux_players(dd_demo_reader *dr, const dd_demux_output *outputs, int num_outputs) {
+  dd_spatial_index *si = demo_si_create(dr);
+  dd_demux_state *states = (dd_demux_state *)calloc(num_outputs > 0 ? num_outputs : 1, sizeof(dd_demux_state));
+  int *unpacked = (int *)malloc(DD_MAX_SNAPSHOT_SIZE);
+  int *out = (int *)malloc(DD_MAX_SNAPSHOT_SIZE);
+  dd_demux_views *views = (dd_demux_views *)malloc(sizeof(dd_demux_views));
+  dd_snapshot_builder *sb = demo_sb_create();
+  bool ok = si && states && views && unpacked && out && sb;
+  for (int o = 0; ok && o < num_outputs; o++) {
+    states[o].dw = demo_w_create();
+    ok = states[o].dw && demo_w_begin_from(states[o].dw, outputs[o].f, dr);
+  }
+
+  dd_demo_chunk chunk;
+  while (ok && demo_r_next_chunk(dr, &chunk)) {
+    const dd_snapshot *snap = NULL;
+    switch (chunk.type) {
+    case DD_CHUNK_SNAP:
+      snap = (const dd_snapshot *)chunk.data;
+      demo_si_build(si, snap);
+      break;
+    case DD_CHUNK_SNAP_DELTA:
+      if (demo_si_unpack_delta(si, chunk.data, chunk.size, unpacked) < 0) ok = false;
+      else snap = (const dd_snapshot *)unpacked;
+      break;
+    case DD_CHUNK_MSG:
+      for (int o = 0; ok && o < num_outputs; o++)
+        ok = demo_w_write_msg(states[o].dw, chunk.tick, chunk.data, chunk.size);
+      break;
+    }
+    if (!snap) continue;
+    dd_demux_find_views(dr, snap, views);
+    for (int o = 0; ok && o < num_outputs; o++)
+      ok = dd_demux_write_snap(si, sb, &outputs[o], &states[o], views, chunk.tick, snap, out);
+  }
+
+  for (int o = 0; states && o < num_outputs; o++) {
+    if (!states[o].dw) continue;
+    ok = demo_w_finish(states[o].dw) && ok;
+    demo_w_destroy(&states[o].dw);
+  }
+  demo_sb_destroy(&sb);
+  free(out);
+  free(unpacked);
+  free(views);
+  free(states);
+  demo_si_destroy(&si);
+  return ok;
+}
+
+/******************************************************************************
+ *
+ * HEATMAPS
+ *
+ ******************************************************************************/
+
+void demo_heatmap_init(dd_heatmap *hm) { memset(hm, 0, sizeof(*hm)); }
+
+void demo_heatmap_free(dd_heatmap *hm) {
+  for (int l = 0; l < DD_NUM_HEAT_LAYERS; l++)
+    free(hm->layers[l]);
+  memset(hm, 0, sizeof(*hm));
+}
+
+/* Grows the grid to at least width x height tiles, in steps so a run of growing positions doesn't copy every time. */
+static bool dd_heatmap_reserve(dd_heatmap *hm, int width, int height) {
+  if (width <= hm->width && height <= hm->height) return true;
+  int new_width = hm->width, new_height = hm->height;
+  if (width > new_width) new_width = width + width / 4 > DD_HEAT_MAX_TILES ? DD_HEAT_MAX_TILES : width + width / 4;
+  if (height > new_height) new_height = height + height / 4 > DD_HEAT_MAX_TILES ? DD_HEAT_MAX_TILES : height + height / 4;
+
+  uint32_t *layers[DD_NUM_HEAT_LAYERS];
+  for (int l = 0; l < DD_NUM_HEAT_LAYERS; l++) {
+    layers[l] = (uint32_t *)calloc((size_t)new_width * new_height, sizeof(uint32_t));
+    if (!layers[l]) {
+      while (l--)
+        free(layers[l]);
+      return false;
+    }
+  }
+  for (int l = 0; l < DD_NUM_HEAT_LAYERS; l++) {
+    for (int y = 0; y < hm->height; y++)
+      memcpy(layers[l] + (size_t)y * new_width, hm->layers[l] + (size_t)y * hm->width, hm->width * sizeof(uint32_t));
+    free(hm->layers[l]);
+    hm->layers[l] = layers[l];
+  }
+  hm->width = new_width;
+  hm->height = new_height;
+  return true;
+}
+
+static bool dd_heatmap_count(dd_heatmap *hm, int layer, int x, int y) {
+  if (x < 0 || y < 0) return true;
+  int tile_x = x / DD_HEAT_TILE_SIZE, tile_y = y / DD_HEAT_TILE_SIZE;
+  if (tile_x >= DD_HEAT_MAX_TILES || tile_y >= DD_HEAT_MAX_TILES) return true;
+  if (!dd_heatmap_reserve(hm, tile_x + 1, tile_y + 1)) return false;
+  hm->layers[layer][(size_t)tile_y * hm->width + tile_x]++;
+  return true;
+}
+
+/* The character positions of the snapshot, stalled ones are those at the same spot as in the previous snapshot. */
+static bool dd_heatmap_add_snapshot(dd_heatmap *hm, dd_demo_reader *dr, const dd_snapshot *snap, int (*last_pos)[2], bool *present) {
+  bool seen[DD_MAX_CLIENTS] = {false};
+  bool ok = true;
+  for (int i = 0; ok && i < snap->num_items; i++) {
+    const dd_snap_item *item = dd_snap_get_item(snap, i);
+    if (demo_r_item_type(dr, item) != DD_NETOBJTYPE_CHARACTER || dd_snap_get_item_size(snap, i) < (int)sizeof(dd_netobj_character_core))
+      continue;
+    const dd_netobj_character_core *core = (const dd_netobj_character_core *)dd_snap_item_data(item);
+    ok = dd_heatmap_count(hm, DD_HEAT_OCCUPANCY, core->m_X, core->m_Y);
+    int id = dd_snap_item_id(item);
+    if (id < 0 || id >= DD_MAX_CLIENTS) continue;
+    if (present[id] && last_pos[id][0] == core->m_X && last_pos[id][1] == core->m_Y)
+      ok = ok && dd_heatmap_count(hm, DD_HEAT_STALL, core->m_X, core->m_Y);
+    last_pos[id][0] = core->m_X;
+    last_pos[id][1] = core->m_Y;
+    seen[id] = true;
+  }
+  memcpy(present, seen, sizeof(seen));
+  return ok;
+}
+
+static bool dd_heatmap_add_event(dd_heatmap *hm, int type, const int *data) {
+  if (type == DD_NETEVENTTYPE_DEATH) return dd_heatmap_count(hm, DD_HEAT_DEATH, data[0], data[1]);
+  if (type == DD_NETEVENTTYPE_FINISH) return dd_heatmap_count(hm, DD_HEAT_FINISH, data[0], data[1]);
+  return true;
+}
+
+static void dd_heatmap_event_changed(void *user, int key, const int *old_data, const int *new_data, int size) {
+  // characters are read from the snapshot, everything else subscribed is an event
+  if ((key >> 16) != DD_NETOBJTYPE_CHARACTER) dd_event_item_changed(user, key, old_data, new_data, size);
+}
+
+bool demo_heatmap_add(dd_heatmap *hm, dd_demo_reader *dr) {
+  static const int types[] = {DD_NETOBJTYPE_CHARACTER, DD_NETEVENTTYPE_DEATH, DD_NETEVENTTYPE_FINISH};
+  demo_r_subscribe_types(dr, types, sizeof(types) / sizeof(types[0]));
+
+  dd_delta_visitor visitor = {NULL, dd_heatmap_event_changed, dd_heatmap_event_changed};
+  dd_event_items *items = (dd_event_items *)malloc(sizeof(dd_event_items));
+  int last_pos[DD_MAX_CLIENTS][2];
+  bool present[DD_MAX_CLIENTS] = {false};
+  bool ok = items != NULL;
+  dd_demo_chunk chunk;
+  while (ok && demo_r_next_chunk(dr, &chunk)) {
+    if (chunk.type == DD_CHUNK_SNAP) {
+      const dd_snapshot *snap = (const dd_snapshot *)chunk.data;
+      for (int i = 0; ok && i < snap->num_items; i++) {
+        const dd_snap_item *item = dd_snap_get_item(snap, i);
+        int data[2] = {0, 0};
+        int size = dd_snap_get_item_size(snap, i);
+        memcpy(data, dd_snap_item_data(item), size < (int)sizeof(data) ? size : (int)sizeof(data));
+        ok = dd_heatmap_add_event(hm, demo_r_item_type(dr, item), data);
+      }
+      ok = ok && dd_heatmap_add_snapshot(hm, dr, snap, last_pos, present);
+    } else if (chunk.type == DD_CHUNK_SNAP_DELTA) {
+      // events show up as added items, or as updates when their key was used by the previous tick's event
+      items->num_pending = 0;
+      ok = demo_r_visit_delta(dr, chunk.data, chunk.size, &visitor, items, NULL) >= 0;
+      for (int i = 0; ok && i < items->num_pending; i++)
+        ok = dd_heatmap_add_event(hm, dd_reader_public_type(dr, items->keys[i] >> 16), items->data[i]);
+      ok = ok && dd_heatmap_add_snapshot(hm, dr, (const dd_snapshot *)dr->last_snapshot_data, last_pos, present);
+    }
+  }
+  free(items);
+  return ok;
+}
+
+bool demo_heatmap_merge(dd_heatmap *dst, const dd_heatmap *src) {
+  if (!dd_heatmap_reserve(dst, src->width, src->height)) return false;
+  for (int l = 0; l < DD_NUM_HEAT_LAYERS; l++) {
+    for (int y = 0; y < src->height; y++) {
+      uint32_t *out = dst->layers[l] + (size_t)y * dst->width;
+      const uint32_t *in = src->layers[l] + (size_t)y * src->width;
+      for (int x = 0; x < src->width; x++)
+        out[x] += in[x];
+    }
+  }
+  return true;
+}
+
+/******************************************************************************
+ *
+ * MAP DATAFILES
+ *
+ ******************************************************************************/
+
+/* Inflater for the zlib streams of the data blocks (RFC 1950 / 1951). The inflated size is known up front. */
+#define DD_INFLATE_FAST_BITS 9
+
+typedef struct {
+  uint16_t fast[1 << DD_INFLATE_FAST_BITS]; // (symbol << 4) | length for codes of up to DD_INFLATE_FAST_BITS bits, else 0
+  uint16_t count[16];                       // number of codes per length
+  uint16_t symbols[288];                    // ordered by code
+} dd_inflate_table;
+
+typedef struct {
+  const uint8_t *in;
+  const uint8_t *in_end;
+  uint8_t *out;
+  size_t out_pos;
+  size_t out_size;
+  uint64_t bits;
+  int num_bits;
+  bool error;
+} dd_inflater;
+
+static const uint16_t DD_INFLATE_LENGTH_BASE[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                                    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t DD_INFLATE_LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DD_INFLATE_DIST_BASE[30] = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+                                                  193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DD_INFLATE_DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t DD_INFLATE_CODE_ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static void dd_inflate_refill(dd_inflater *inf) {
+  while (inf->num_bits <= 56 && inf->in < inf->in_end) {
+    inf->bits |= (uint64_t)*inf->in++ << inf->num_bits;
+    inf->num_bits += 8;
+  }
+}
+
+static uint32_t dd_inflate_bits(dd_inflater *inf, int n) {
+  dd_inflate_refill(inf);
+  if (inf->num_bits < n) {
+    inf->error = true;
+    return 0;
+  }
+  uint32_t value = (uint32_t)(inf->bits & ((1u << n) - 1));
+  inf->bits >>= n;
+  inf->num_bits -= n;
+  return value;
+}
+
+/* Builds the canonical code from code lengths. Incomplete codes are accepted (a single distance code), over-subscribed ones aren't. */
+static bool dd_inflate_build(dd_inflate_table *t, const uint8_t *lengths, int n) {
+  memset(t->fast, 0, sizeof(t->fast));
+  memset(t->count, 0, sizeof(t->count));
+  for (int s = 0; s < n; s++)
+    t->count[lengths[s]]++;
+  t->count[0] = 0;
+
+  uint16_t offsets[16], next_code[16];
+  int left = 1, code = 0;
+  offsets[1] = 0;
+  for (int len = 1; len < 16; len++) {
+    left = (left << 1) - t->count[len];
+    if (left < 0) return false;
+    if (len < 15) offsets[len + 1] = offsets[len] + t->count[len];
+    next_code[len] = code;
+    code = (code + t->count[len]) << 1;
+  }
+
+  for (int s = 0; s < n; s++) {
+    int len = lengths[s];
+    if (len == 0) continue;
+    t->symbols[offsets[len]++] = s;
+    // codes are sent starting with their highest bit, the bit buffer is read from the lowest
+    int c = next_code[len]++, reversed = 0;
+    for (int b = 0; b < len; b++)
+      reversed |= ((c >> b) & 1) << (len - 1 - b);
+    for (int i = reversed; len <= DD_INFLATE_FAST_BITS && i < 1 << DD_INFLATE_FAST_BITS; i += 1 << len)
+      t->fast[i] = (uint16_t)(s << 4 | len);
+  }
+  return true;
+}
+
+static int dd_inflate_symbol(dd_inflater *inf, const dd_inflate_table *t) {
+  dd_inflate_refill(inf);
+  int entry = t->fast[inf->bits & ((1 << DD_INFLATE_FAST_BITS) - 1)];
+  int symbol = entry >> 4, len = entry & 15;
+  if (!entry) {
+    // longer codes, one bit at a time
+    int code = 0, first = 0, index = 0;
+    symbol = -1;
+    for (len = 1; len < 16; len++) {
+      code |= (int)(inf->bits >> (len - 1)) & 1;
+      int count = t->count[len];
+      if (code - first < count) {
+        symbol = t->symbols[index + code - first];
+        break;
+      }
+      index += count;
+      first = (first + count) << 1;
+      code <<= 1;
+    }
+  }
+  if (symbol < 0 || len > inf->num_bits) {
+    inf->error = true;
+    return -1;
+  }
+  inf->bits >>= len;
+  inf->num_bits -= len;
+  return symbol;
+}
+
+static bool dd_inflate_codes(dd_inflater *inf, const dd_inflate_table *lit, const dd_inflate_table *dist) {
+  for (;;) {
+    int symbol = dd_inflate_symbol(inf, lit);
+    if (symbol < 0) return false;
+    if (symbol < 256) {
+      if (inf->out_pos == inf->out_size) return false;
+      inf->out[inf->out_pos++] = (uint8_t)symbol;
+      continue;
+    }
+    if (symbol == 256) return true;
+
+    symbol -= 257;
+    if (symbol >= 29) return false;
+    size_t length = DD_INFLATE_LENGTH_BASE[symbol] + dd_inflate_bits(inf, DD_INFLATE_LENGTH_EXTRA[symbol]);
+    int d = dd_inflate_symbol(inf, dist);
+    if (d < 0 || d >= 30) return false;
+    size_t distance = DD_INFLATE_DIST_BASE[d] + dd_inflate_bits(inf, DD_INFLATE_DIST_EXTRA[d]);
+    if (inf->error || distance > inf->out_pos || length > inf->out_size - inf->out_pos) return false;
+    // byte by byte, overlapping copies repeat the last `distance` bytes
+    uint8_t *dst = inf->out + inf->out_pos;
+    const uint8_t *src = dst - distance;
+    for (size_t i = 0; i < length; i++)
+      dst[i] = src[i];
+    inf->out_pos += length;
+  }
+}
+
+static bool dd_inflate_stored(dd_inflater *inf) {
+  // back to the byte boundary, the whole bytes still in the bit buffer go back to the input
+  inf->in -= inf->num_bits / 8;
+  inf->bits = 0;
+  inf->num_bits = 0;
+  if (inf->in_end - inf->in < 4) return false;
+  size_t len = inf->in[0] | inf->in[1] << 8, nlen = inf->in[2] | inf->in[3] << 8;
+  inf->in += 4;
+  if (len != (~nlen & 0xffff) || (size_t)(inf->in_end - inf->in) < len || len > inf->out_size - inf->out_pos) return false;
+  memcpy(inf->out + inf->out_pos, inf->in, len);
+  inf->in += len;
+  inf->out_pos += len;
+  return true;
+}
+
+static bool dd_inflate_fixed(dd_inflater *inf, dd_inflate_table *lit, dd_inflate_table *dist) {
+  uint8_t lengths[288];
+  for (int s = 0; s < 288; s++)
+    lengths[s] = s < 144 ? 8 : s < 256 ? 9 : s < 280 ? 7 : 8;
+  dd_inflate_build(lit, lengths, 288);
+  memset(lengths, 5, 30);
+  dd_inflate_build(dist, lengths, 30);
+  return dd_inflate_codes(inf, lit, dist);
+}
+
+static bool dd_inflate_dynamic(dd_inflater *inf, dd_inflate_table *lit, dd_inflate_table *dist) {
+  int num_lit = dd_inflate_bits(inf, 5) + 257, num_dist = dd_inflate_bits(inf, 5) + 1, num_code = dd_inflate_bits(inf, 4) + 4;
+  if (inf->error || num_lit > 286 || num_dist > 30) return false;
+
+  // the code lengths are coded themselves, `lit` holds that code until the real one is built
+  uint8_t lengths[286 + 30] = {0};
+  for (int i = 0; i < num_code; i++)
+    lengths[DD_INFLATE_CODE_ORDER[i]] = (uint8_t)dd_inflate_bits(inf, 3);
+  if (inf->error || !dd_inflate_build(lit, lengths, 19)) return false;
+  for (int i = 0; i < num_lit + num_dist;) {
+    int symbol = dd_inflate_symbol(inf, lit);
+    if (symbol < 0) return false;
+    if (symbol < 16) {
+      lengths[i++] = (uint8_t)symbol;
+      continue;
+    }
+    int value = 0, repeat;
+    if (symbol == 16) {
+      if (i == 0) return false;
+      value = lengths[i - 1];
+      repeat = 3 + dd_inflate_bits(inf, 2);
+    } else if (symbol == 17) {
+      repeat = 3 + dd_inflate_bits(inf, 3);
+    } else {
+      repeat = 11 + dd_inflate_bits(inf, 7);
+    }
+    if (inf->error || i + repeat > num_lit + num_dist) return false;
+    while (repeat--)
+      lengths[i++] = (uint8_t)value;
+  }
+  if (lengths[256] == 0 || !dd_inflate_build(lit, lengths, num_lit) || !dd_inflate_build(dist, lengths + num_lit, num_dist)) return false;
+  return dd_inflate_codes(inf, lit, dist);
+}
+
+/* Inflates the zlib stream `in` into exactly `out_size` bytes and checks its Adler-32. */
+static bool dd_zlib_inflate(const uint8_t *in, size_t in_size, uint8_t *out, size_t out_size) {
+  // deflate, a window of at most 32K, no preset dictionary
+  if (in_size < 6 || (in[0] & 0x0f) != 8 || (in[0] >> 4) > 7 || ((in[0] << 8) | in[1]) % 31 != 0 || (in[1] & 0x20)) return false;
+  dd_inflater inf;
+  memset(&inf, 0, sizeof(inf));
+  inf.in = in + 2;
+  inf.in_end = in + in_size;
+  inf.out = out;
+  inf.out_size = out_size;
+
+  dd_inflate_table lit, dist;
+  for (bool last = false; !last;) {
+    last = dd_inflate_bits(&inf, 1);
+    int type = dd_inflate_bits(&inf, 2);
+    if (inf.error) return false;
+    bool ok = false;
+    if (type == 0) ok = dd_inflate_stored(&inf);
+    else if (type == 1) ok = dd_inflate_fixed(&inf, &lit, &dist);
+    else if (type == 2) ok = dd_inflate_dynamic(&inf, &lit, &dist);
+    if (!ok || inf.error) return false;
+  }
+  inf.in -= inf.num_bits / 8;
+  if (inf.out_pos != out_size || inf.in_end - inf.in < 4) return false;
+
+  uint32_t a = 1, b = 0;
+  for (size_t i = 0; i < out_size;) {
+    // largest run before b could overflow
+    size_t n = out_size - i < 5552 ? out_size - i : 5552;
+    while (n--) {
+      a += out[i++];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+  }
+  return ((b << 16) | a) == dd_be_to_uint(inf.in);
+}
+
+/* Datafile header: "DATA", then version, size, swap length, item types, items, data blocks, item area and data area sizes. */
+#define DD_DATAFILE_HEADER_SIZE 36
+
+struct dd_map_file {
+  FILE *file; // NULL for maps in memory
+  const uint8_t *memory;
+  int64_t offset; // of the datafile in `file`
+  int64_t size;
+  int version;
+  int num_item_types;
+  int num_items;
+  int num_data;
+  int item_size;
+  int data_size;
+  int64_t data_start;
+  int index_state;           // 0 until the index is read, -1 if it is broken
+  int32_t *index;            // the index and the item area, in host byte order
+  const int32_t *item_types; // type, start, num per type
+  const int32_t *item_offsets;
+  const int32_t *data_offsets;
+  const int32_t *data_sizes; // inflated sizes, version 4 only
+  const int32_t *items;
+  void **data; // loaded blocks
+};
+
+static bool dd_map_read(dd_map_file *map, int64_t offset, void *dst, size_t size) {
+  if (offset < 0 || offset > map->size || (int64_t)size > map->size - offset) return false;
+  if (!map->file) {
+    memcpy(dst, map->memory + offset, size);
+    return true;
+  }
+  int64_t pos = dd_ftell(map->file);
+  if (pos < 0 || dd_fseek(map->file, map->offset + offset, SEEK_SET) != 0) return false;
+  bool ok = fread(dst, 1, size, map->file) == size;
+  return dd_fseek(map->file, pos, SEEK_SET) == 0 && ok;
+}
+
+static dd_map_file *dd_map_create(FILE *f, const uint8_t *memory, int64_t offset, int64_t size) {
+  dd_map_file *map = (dd_map_file *)calloc(1, sizeof(dd_map_file));
+  if (!map) return NULL;
+  map->file = f;
+  map->memory = memory;
+  map->offset = offset;
+  map->size = size;
+
+  uint8_t header[DD_DATAFILE_HEADER_SIZE];
+  if (!dd_map_read(map, 0, header, sizeof(header)) || (memcmp(header, "DATA", 4) != 0 && memcmp(header, "ATAD", 4) != 0)) {
+    free(map);
+    return NULL;
+  }
+  int fields[8];
+  for (int i = 0; i < 8; i++)
+    fields[i] = (int)dd_le_to_uint(header + 4 + i * 4);
+  map->version = fields[0];
+  map->num_item_types = fields[3];
+  map->num_items = fields[4];
+  map->num_data = fields[5];
+  map->item_size = fields[6];
+  map->data_size = fields[7];
+
+  bool ok = (map->version == 3 || map->version == 4) && map->num_item_types >= 0 && map->num_items >= 0 && map->num_data >= 0 &&
+            map->item_size >= 0 && map->item_size % 4 == 0 && map->data_size >= 0;
+  int64_t index_size = (int64_t)map->num_item_types * 12 + (int64_t)map->num_items * 4 + (int64_t)map->num_data * (map->version == 4 ? 8 : 4);
+  map->data_start = DD_DATAFILE_HEADER_SIZE + index_size + map->item_size;
+  if (!ok || map->data_start + map->data_size > size) {
+    free(map);
+    return NULL;
+  }
+  return map;
+}
+
+/* Reads the item types, offsets and the item area on first use. */
+static bool dd_map_load_index(dd_map_file *map) {
+  if (map->index_state) return map->index_state > 0;
+  map->index_state = -1;
+  size_t num_ints = (size_t)(map->data_start - DD_DATAFILE_HEADER_SIZE) / 4;
+  map->index = (int32_t *)malloc(num_ints ? num_ints * 4 : 1);
+  map->data = (void **)calloc(map->num_data ? map->num_data : 1, sizeof(void *));
+  if (!map->index || !map->data || !dd_map_read(map, DD_DATAFILE_HEADER_SIZE, map->index, num_ints * 4)) return false;
+  for (size_t i = 0; i < num_ints; i++)
+    map->index[i] = (int32_t)dd_le_to_uint((const uint8_t *)&map->index[i]);
+
+  map->item_types = map->index;
+  map->item_offsets = map->item_types + map->num_item_types * 3;
+  map->data_offsets = map->item_offsets + map->num_items;
+  map->data_sizes = map->version == 4 ? map->data_offsets + map->num_data : NULL;
+  map->items = map->data_offsets + map->num_data * (map->version == 4 ? 2 : 1);
+  for (int t = 0; t < map->num_item_types; t++) {
+    const int32_t *type = map->item_types + t * 3;
+    if (type[1] < 0 || type[2] < 0 || type[1] > map->num_items - type[2]) return false;
+  }
+  map->index_state = 1;
+  return true;
+}
+
+/* Size of a block as stored, -1 if its offsets are broken. */
+static int dd_map_raw_data_size(const dd_map_file *map, int index) {
+  int start = map->data_offsets[index], end = index + 1 < map->num_data ? map->data_offsets[index + 1] : map->data_size;
+  return start < 0 || end < start || end > map->data_size ? -1 : end - start;
+}
+
+dd_map_file *demo_map_open(FILE *f, int64_t offset, int64_t size) {
+  if (size < 0) {
+    int64_t pos = dd_ftell(f);
+    if (pos < 0 || dd_fseek(f, 0, SEEK_END) != 0) return NULL;
+    size = dd_ftell(f) - offset;
+    if (dd_fseek(f, pos, SEEK_SET) != 0) return NULL;
+  }
+  return dd_map_create(f, NULL, offset, size);
+}
+
+dd_map_file *demo_map_open_memory(const void *data, size_t size) { return dd_map_create(NULL, (const uint8_t *)data, 0, (int64_t)size); }
+
+dd_map_file *demo_r_open_map(dd_demo_reader *dr) {
+  if (dr->info.map_size == 0) return NULL;
+  return demo_map_open(dr->file, dr->chunks_start - dr->info.map_size, dr->info.map_size);
+}
+
+void demo_map_close(dd_map_file **map_ptr) {
+  dd_map_file *map = *map_ptr;
+  if (!map) return;
+  for (int i = 0; map->data && i < map->num_data; i++)
+    free(map->data[i]);
+  free(map->data);
+  free(map->index);
+  free(map);
+  *map_ptr = NULL;
+}
+
+int demo_map_num_items(dd_map_file *map) { return dd_map_load_index(map) ? map->num_items : 0; }
+
+bool demo_map_get_item(dd_map_file *map, int index, dd_map_item *item) {
+  if (!dd_map_load_index(map) || index < 0 || index >= map->num_items) return false;
+  int offset = map->item_offsets[index];
+  if (offset < 0 || offset % 4 != 0 || offset > map->item_size - 8) return false;
+  // type and id, size, then the item
+  const int32_t *header = map->items + offset / 4;
+  if (header[1] < 0 || header[1] > map->item_size - offset - 8) return false;
+  item->type = (header[0] >> 16) & 0xffff;
+  item->id = header[0] & 0xffff;
+  item->size = header[1];
+  item->data = header + 2;
+  return true;
+}
+
+void demo_map_get_type(dd_map_file *map, int type, int *start, int *num) {
+  *start = 0;
+  *num = 0;
+  for (int t = 0; dd_map_load_index(map) && t < map->num_item_types; t++) {
+    if (map->item_types[t * 3] != type) continue;
+    *start = map->item_types[t * 3 + 1];
+    *num = map->item_types[t * 3 + 2];
+    return;
+  }
+}
+
+bool demo_map_find_item(dd_map_file *map, int type, int id, dd_map_item *item) {
+  int start, num;
+  demo_map_get_type(map, type, &start, &num);
+  for (int i = start; i < start + num; i++) {
+    if (demo_map_get_item(map, i, item) && item->type == type && item->id == id) return true;
+  }
+  return false;
+}
+
+int demo_map_num_data(dd_map_file *map) { return dd_map_load_index(map) ? map->num_data : 0; }
+
+int demo_map_data_size(dd_map_file *map, int index) {
+  if (!dd_map_load_index(map) || index < 0 || index >= map->num_data) return -1;
+  if (map->version == 3) return dd_map_raw_data_size(map, index); // stored as is
+  return map->data_sizes[index] < 0 ? -1 : map->data_sizes[index];
+}
+
+const void *demo_map_get_data(dd_map_file *map, int index) {
+  int size = demo_map_data_size(map, index);
+  if (size < 0) return NULL;
+  if (map->data[index]) return map->data[index];
+  int raw_size = dd_map_raw_data_size(map, index);
+  int64_t raw_offset = map->data_start + map->data_offsets[index];
+  uint8_t *data = (uint8_t *)malloc(size ? size : 1);
+  if (raw_size < 0 || !data) {
+    free(data);
+    return NULL;
+  }
+
+  bool ok;
+  if (map->version == 3) {
+    ok = dd_map_read(map, raw_offset, data, size);
+  } else if (map->memory) {
+    ok = dd_zlib_inflate(map->memory + raw_offset, raw_size, data, size);
+  } else {
+    uint8_t *raw = (uint8_t *)malloc(raw_size ? raw_size : 1);
+    ok = raw && dd_map_read(map, raw_offset, raw, raw_size) && dd_zlib_inflate(raw, raw_size, data, size);
+    free(raw);
+  }
+  if (!ok) {
+    free(data);
+    return NULL;
+  }
+  map->data[index] = data;
+  return data;
+}
+
+void demo_map_unload_data(dd_map_file *map, int index) {
+  if (!dd_map_load_index(map) || index < 0 || index >= map->num_data) return;
+  free(map->data[index]);
+  map->data[index] = NULL;
+}
+
+const void *demo_map_get_tiles(dd_map_file *map, int layer_flag, int *width, int *height) {
+  // per layer flag: tile size and the tilemap field with the data index (m_Data, m_Tele, m_Speedup, m_Front, m_Switch, m_Tune)
+  static const int tile_sizes[6] = {4, 2, 6, 4, 4, 2};
+  static const int data_fields[6] = {14, 18, 19, 20, 21, 22};
+  int bit = 0;
+  while (bit < 6 && layer_flag != 1 << bit)
+    bit++;
+  if (bit == 6) return NULL;
+
+  int start, num;
+  demo_map_get_type(map, DD_MAPITEMTYPE_LAYER, &start, &num);
+  for (int i = start; i < start + num; i++) {
+    dd_map_item item;
+    // layer version, type (2: tiles), flags, then tilemap version, width, height, flags, ...
+    if (!demo_map_get_item(map, i, &item) || item.size < (data_fields[bit] + 1) * 4 || item.data[1] != 2 || !(item.data[6] & layer_flag)) continue;
+    int w = item.data[4], h = item.data[5], data_index = item.data[data_fields[bit]];
+    // tilemaps with skipped tiles (0.7 maps) don't have one tile per position
+    if (w <= 0 || h <= 0 || (int64_t)w * h * tile_sizes[bit] != demo_map_data_size(map, data_index)) return NULL;
+    *width = w;
+    *height = h;
+    return demo_map_get_data(map, data_index);
+  }
+  return NULL;
+}
+
 #endif /* DDNET_DEMO_IMPLEMENTATION */
@@ -67,10 +67,19 @@ int main(int argc, char **argv) {
                 printf("  -> failed to unpack delta\n");
             }
             break;
-        case DD_CHUNK_MSG:
+        case DD_CHUNK_MSG: {
             printf("Message at tick %d, size %d\n", chunk.tick, chunk.size);
+            dd_msg_unpacker unpacker;
+            demo_msg_unpack_init(&unpacker, chunk.data, chunk.size);
+            bool system;
+            int msg_id = demo_msg_get_header(&unpacker, &system);
+            dd_netmsg_sv_chat chat;
+            if (!system && msg_id == DD_NETMSGTYPE_SV_CHAT && demo_msg_decode_sv_chat(&unpacker, &chat)) {
+                printf("  Chat from %d (team %d): %s\n", chat.m_ClientId, chat.m_Team, chat.m_pMessage);
+            }
             break;
         }
+        }
     }
 
     demo_r_destroy(&dr);
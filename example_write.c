@@ -191,8 +191,8 @@ void send_chat_message(dd_demo_writer *writer, int tick, int client_id, int team
   dd_msg_packer packer;
   demo_msg_init(&packer, msg_buffer, sizeof(msg_buffer));
 
-  // pack the message Id and its data
-  demo_msg_add_int(&packer, DD_NETMSGTYPE_SV_CHAT);
+  // pack the message header ((Id << 1) | system flag) and its data
+  demo_msg_add_header(&packer, DD_NETMSGTYPE_SV_CHAT, false);
   demo_msg_add_int(&packer, team);
   demo_msg_add_int(&packer, client_id);
   demo_msg_add_string(&packer, message);
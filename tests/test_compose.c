@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DDNET_DEMO_IMPLEMENTATION
+#include "ddnet_demo.h"
+
+/*
+ * Delta composition: a run of deltas folded with demo_r_compose_add() and unpacked at once has to give the same
+ * snapshot, byte for byte, as unpacking the deltas one by one. Some items go away for a tick and come back with other
+ * data, so runs delete and re-add the same key, and with a subscription some of them are hidden extended items.
+ */
+
+#define NUM_TICKS 800
+
+/* Characters move every tick, pickups and extended items blink out and back in, finishes come and go. */
+static FILE *write_demo(void) {
+  FILE *f = tmpfile();
+  if (!f) return NULL;
+  dd_demo_writer *dw = demo_w_create();
+  dd_snapshot_builder *sb = demo_sb_create();
+  static int snap[DD_MAX_SNAPSHOT_SIZE / sizeof(int)];
+  uint8_t map[16] = {0};
+  bool ok = demo_w_begin(dw, f, "compose", 0, "DDNet") && demo_w_write_map(dw, NULL, map, sizeof(map));
+
+  srand(4);
+  for (int tick = 0; ok && tick < NUM_TICKS; tick++) {
+    demo_sb_clear(sb);
+    // the extended types swap indices now and then, with items of one size that is a plain update
+    bool swapped = rand() % 6 == 0;
+    for (int k = 0; k < 2; k++) {
+      int type = (k == 0) != swapped ? DD_NETOBJTYPE_DDNETCHARACTER : DD_NETOBJTYPE_DDNETPLAYER;
+      for (int id = 0; id < 4; id++) {
+        if (id == 3 && tick % 4 == 1) continue;
+        int *data = (int *)demo_sb_add_item(sb, type, id, 32);
+        data[0] = id == 3 ? tick : tick / 8;
+        data[7] = id ^ type;
+      }
+    }
+    if (rand() % 2 == 0) {
+      dd_netevent_finish *finish = (dd_netevent_finish *)demo_sb_add_item(sb, DD_NETEVENTTYPE_FINISH, 0, sizeof(dd_netevent_finish));
+      finish->common.m_X = tick;
+    }
+    for (int c = 0; c < 4; c++) {
+      dd_netobj_character *character = (dd_netobj_character *)demo_sb_add_item(sb, DD_NETOBJTYPE_CHARACTER, c, sizeof(*character));
+      character->core.m_X = tick * (c + 1);
+      character->core.m_Tick = tick;
+    }
+    for (int id = 0; id < 6; id++) {
+      if (id == 5 && tick % 4 == 1) continue;
+      dd_netobj_pickup *pickup = (dd_netobj_pickup *)demo_sb_add_item(sb, DD_NETOBJTYPE_PICKUP, id, sizeof(*pickup));
+      pickup->m_X = id == 5 ? tick : id * 32;
+      pickup->m_Type = id;
+    }
+    int size = demo_sb_finish(sb, snap);
+    ok = size > 0 && demo_w_write_snap(dw, tick, snap, size);
+  }
+  ok = demo_w_finish(dw) && ok;
+  demo_w_destroy(&dw);
+  demo_sb_destroy(&sb);
+  if (!ok) {
+    fclose(f);
+    return NULL;
+  }
+  return f;
+}
+
+/* A second copy of the demo, the two readers of a check keep their own file positions. */
+static FILE *copy_demo(FILE *f) {
+  FILE *copy = tmpfile();
+  if (!copy) return NULL;
+  uint8_t buffer[4096];
+  size_t n;
+  rewind(f);
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    fwrite(buffer, 1, n, copy);
+  rewind(f);
+  rewind(copy);
+  return copy;
+}
+
+/* Composes runs of `run` deltas and returns the number of runs whose result differs from sequential unpacking. */
+static int check_runs(FILE *f, const int *types, int num_types, int run, int *num_runs) {
+  static uint8_t sequential_snap[DD_MAX_SNAPSHOT_SIZE], composed_snap[DD_MAX_SNAPSHOT_SIZE];
+  static uint8_t composed_delta[DD_MAX_SNAPSHOT_SIZE * 2];
+  *num_runs = 0;
+  FILE *f2 = copy_demo(f);
+  if (!f2) return 1;
+  dd_demo_reader *sequential = demo_r_create(), *composed = demo_r_create();
+  demo_r_subscribe_types(sequential, types, num_types);
+  demo_r_subscribe_types(composed, types, num_types);
+  demo_r_open(sequential, f);
+  demo_r_open(composed, f2);
+
+  int failures = 0, pending = 0;
+  dd_demo_chunk chunk, composed_chunk;
+  while (demo_r_next_chunk(sequential, &chunk)) {
+    if (!demo_r_next_chunk(composed, &composed_chunk)) {
+      failures++;
+      break;
+    }
+    // a keyframe replaces the base of a pending run, both readers start over from it
+    if (chunk.type == DD_CHUNK_SNAP) pending = 0;
+    if (chunk.type != DD_CHUNK_SNAP_DELTA) continue;
+
+    int size = demo_r_unpack_delta(sequential, chunk.data, chunk.size, sequential_snap);
+    if (pending == 0) demo_r_compose_begin(composed);
+    if (!demo_r_compose_add(composed, composed_chunk.data, composed_chunk.size)) {
+      failures++;
+      break;
+    }
+    if (++pending < run) continue;
+
+    pending = 0;
+    (*num_runs)++;
+    int delta_size = demo_r_compose_finish(composed, composed_delta, sizeof(composed_delta));
+    int composed_size = delta_size > 0 ? demo_r_unpack_delta(composed, composed_delta, delta_size, composed_snap) : -1;
+    if (size <= 0 || composed_size != size || memcmp(composed_snap, sequential_snap, size) != 0) failures++;
+  }
+
+  demo_r_destroy(&sequential);
+  demo_r_destroy(&composed);
+  fclose(f2);
+  return failures;
+}
+
+int main(void) {
+  static const struct {
+    int types[4];
+    int num_types; // -1: no subscription
+  } subscriptions[] = {
+      {{0}, -1},
+      {{DD_NETOBJTYPE_CHARACTER, DD_NETOBJTYPE_PICKUP}, 2},
+      {{DD_NETOBJTYPE_CHARACTER, DD_NETOBJTYPE_DDNETCHARACTER}, 2},
+      {{DD_NETOBJTYPE_PICKUP, DD_NETOBJTYPE_DDNETPLAYER, DD_NETEVENTTYPE_FINISH}, 3},
+  };
+  static const int runs[] = {2, 4, 8};
+
+  FILE *f = write_demo();
+  if (!f) {
+    printf("Failed to write the test demo.\n");
+    return 1;
+  }
+
+  int failures = 0;
+  for (int s = 0; s < (int)(sizeof(subscriptions) / sizeof(subscriptions[0])); s++) {
+    const int *types = subscriptions[s].num_types >= 0 ? subscriptions[s].types : NULL;
+    for (int r = 0; r < (int)(sizeof(runs) / sizeof(runs[0])); r++) {
+      int num_runs;
+      int failed = check_runs(f, types, subscriptions[s].num_types, runs[r], &num_runs);
+      if (failed || num_runs == 0) printf("subscription %d, runs of %d: %d of %d composed snapshots differ\n", s, runs[r], failed, num_runs);
+      failures += failed + (num_runs == 0);
+    }
+  }
+
+  fclose(f);
+  if (failures == 0) printf("ok\n");
+  return failures != 0;
+}
@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DDNET_DEMO_IMPLEMENTATION
+#include "ddnet_demo.h"
+
+/*
+ * Selective projection with extended types whose indices are reassigned between ticks: the builder numbers extended
+ * types in the order they are added, so shuffling that order moves a type to another index and its items get updated
+ * in place, with a different UUID behind them. Every snapshot a subscribed reader hands out has to equal the full
+ * snapshot filtered by public type, whether deltas are unpacked or visited, after seeks and when stepping back. Runs of
+ * composed deltas have to give the same snapshots as unpacking them one by one, hidden items included.
+ */
+
+#define NUM_TICKS 600
+
+static const int g_extended[] = {DD_NETOBJTYPE_DDNETCHARACTER, DD_NETOBJTYPE_SWITCHSTATE, DD_NETEVENTTYPE_FINISH, DD_NETOBJTYPE_DDNETPLAYER,
+                                 DD_NETOBJTYPE_DDNETSPECTATORINFO};
+#define NUM_EXTENDED (int)(sizeof(g_extended) / sizeof(g_extended[0]))
+
+/* Same-sized extended items with shared ids, so a reassigned index turns one type's item into another's. */
+static FILE *write_demo(void) {
+  FILE *f = tmpfile();
+  if (!f) return NULL;
+  dd_demo_writer *dw = demo_w_create();
+  dd_snapshot_builder *sb = demo_sb_create();
+  static int snap[DD_MAX_SNAPSHOT_SIZE / sizeof(int)];
+  uint8_t map[16] = {0};
+  bool ok = demo_w_begin(dw, f, "reassign", 0, "DDNet") && demo_w_write_map(dw, NULL, map, sizeof(map));
+
+  srand(1);
+  for (int tick = 0; ok && tick < NUM_TICKS; tick++) {
+    int order[NUM_EXTENDED];
+    for (int i = 0; i < NUM_EXTENDED; i++)
+      order[i] = i;
+    if (rand() % 4 == 0) {
+      for (int i = NUM_EXTENDED - 1; i > 0; i--) {
+        int j = rand() % (i + 1), t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+      }
+    }
+
+    demo_sb_clear(sb);
+    for (int k = 0; k < NUM_EXTENDED; k++) {
+      int type = g_extended[order[k]];
+      if (type == DD_NETEVENTTYPE_FINISH && rand() % 3 != 0) continue;
+      if (type == DD_NETOBJTYPE_SWITCHSTATE && rand() % 5 == 0) continue;
+      for (int id = 0; id < 8; id++) {
+        int *data = (int *)demo_sb_add_item(sb, type, id, 32);
+        for (int i = 0; i < 8; i++)
+          data[i] = (id * 31 + i * 7 + (rand() % 8 == 0 ? tick : tick / 10)) ^ type;
+      }
+    }
+    for (int c = 0; c < 4; c++) {
+      dd_netobj_character *character = (dd_netobj_character *)demo_sb_add_item(sb, DD_NETOBJTYPE_CHARACTER, c, sizeof(*character));
+      character->core.m_X = tick * (c + 1);
+      character->core.m_Tick = tick;
+    }
+    int size = demo_sb_finish(sb, snap);
+    ok = size > 0 && demo_w_write_snap(dw, tick, snap, size);
+  }
+  ok = demo_w_finish(dw) && ok;
+  demo_w_destroy(&dw);
+  demo_sb_destroy(&sb);
+  if (!ok) {
+    fclose(f);
+    return NULL;
+  }
+  return f;
+}
+
+static bool subscribed(const int *types, int num_types, int type) {
+  for (int i = 0; i < num_types; i++) {
+    if (types[i] == type) return true;
+  }
+  return false;
+}
+
+/* Whether `projected` holds exactly the items of `full` (current snapshot of `full_reader`) of the subscribed types. */
+static bool matches(dd_demo_reader *full_reader, const dd_snapshot *full, const dd_snapshot *projected, const int *types, int num_types) {
+  if (!full || !projected) return false;
+  int num_expected = 0;
+  for (int i = 0; i < full->num_items; i++) {
+    const dd_snap_item *item = dd_snap_get_item(full, i);
+    if (dd_snap_item_type(item) != DD_NETOBJTYPE_EX && !subscribed(types, num_types, demo_r_item_type(full_reader, item))) continue;
+    num_expected++;
+    int index = dd_snap_find_index(projected, item->type_and_id, false);
+    int size = dd_snap_get_item_size(full, i);
+    if (index < 0 || dd_snap_get_item_size(projected, index) != size) return false;
+    if (memcmp(dd_snap_item_data(dd_snap_get_item(projected, index)), dd_snap_item_data(item), size) != 0) return false;
+  }
+  return projected->num_items == num_expected;
+}
+
+static void count_removed(void *user, int key, const int *old_data, const int *new_data, int size) {
+  (void)key;
+  (void)old_data;
+  (void)new_data;
+  (void)size;
+  (*(int *)user)++;
+}
+
+/* A second copy of the demo, the two readers of a check keep their own file positions. */
+static FILE *copy_demo(FILE *f) {
+  FILE *copy = tmpfile();
+  if (!copy) return NULL;
+  uint8_t buffer[4096];
+  size_t n;
+  rewind(f);
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    fwrite(buffer, 1, n, copy);
+  rewind(f);
+  rewind(copy);
+  return copy;
+}
+
+/* Reads the demo sequentially with a full and a subscribed reader, returns the number of mismatching snapshots. */
+static int check_sequential(FILE *f, const int *types, int num_types, bool visit) {
+  static uint8_t full_snap[DD_MAX_SNAPSHOT_SIZE], projected_snap[DD_MAX_SNAPSHOT_SIZE];
+  FILE *f2 = copy_demo(f);
+  if (!f2) return 1;
+  dd_demo_reader *full = demo_r_create(), *projected = demo_r_create();
+  demo_r_open(full, f);
+  demo_r_subscribe_types(projected, types, num_types);
+  demo_r_open(projected, f2);
+
+  int failures = 0, removed = 0;
+  dd_delta_visitor visitor = {NULL, NULL, count_removed};
+  dd_demo_chunk full_chunk, projected_chunk;
+  while (demo_r_next_chunk(full, &full_chunk)) {
+    if (!demo_r_next_chunk(projected, &projected_chunk)) {
+      failures++;
+      break;
+    }
+    const dd_snapshot *a = NULL, *b = NULL;
+    if (full_chunk.type == DD_CHUNK_SNAP) {
+      a = (const dd_snapshot *)full_chunk.data;
+      b = (const dd_snapshot *)projected_chunk.data;
+    } else if (full_chunk.type == DD_CHUNK_SNAP_DELTA) {
+      if (demo_r_unpack_delta(full, full_chunk.data, full_chunk.size, full_snap) > 0) a = (const dd_snapshot *)full_snap;
+      int size = visit ? demo_r_visit_delta(projected, projected_chunk.data, projected_chunk.size, &visitor, &removed, projected_snap)
+                       : demo_r_unpack_delta(projected, projected_chunk.data, projected_chunk.size, projected_snap);
+      if (size > 0) b = (const dd_snapshot *)projected_snap;
+    }
+    if ((a || b) && !matches(full, a, b, types, num_types)) failures++;
+  }
+
+  demo_r_destroy(&full);
+  demo_r_destroy(&projected);
+  fclose(f2);
+  return failures;
+}
+
+/* Folds runs of `run` deltas with the composer, returns the number of runs that differ from unpacking one by one. */
+static int check_composed(FILE *f, const int *types, int num_types, int run) {
+  static uint8_t sequential_snap[DD_MAX_SNAPSHOT_SIZE], composed_snap[DD_MAX_SNAPSHOT_SIZE];
+  static uint8_t composed_delta[DD_MAX_SNAPSHOT_SIZE * 2];
+  FILE *f2 = copy_demo(f);
+  if (!f2) return 1;
+  dd_demo_reader *sequential = demo_r_create(), *composed = demo_r_create();
+  demo_r_subscribe_types(sequential, types, num_types);
+  demo_r_subscribe_types(composed, types, num_types);
+  demo_r_open(sequential, f);
+  demo_r_open(composed, f2);
+
+  int failures = 0, pending = 0;
+  dd_demo_chunk chunk, composed_chunk;
+  while (demo_r_next_chunk(sequential, &chunk) && demo_r_next_chunk(composed, &composed_chunk)) {
+    if (chunk.type == DD_CHUNK_SNAP) pending = 0;
+    if (chunk.type != DD_CHUNK_SNAP_DELTA) continue;
+    int size = demo_r_unpack_delta(sequential, chunk.data, chunk.size, sequential_snap);
+    if (pending == 0) demo_r_compose_begin(composed);
+    if (!demo_r_compose_add(composed, composed_chunk.data, composed_chunk.size)) {
+      failures++;
+      break;
+    }
+    if (++pending < run) continue;
+    pending = 0;
+    int delta_size = demo_r_compose_finish(composed, composed_delta, sizeof(composed_delta));
+    int composed_size = delta_size > 0 ? demo_r_unpack_delta(composed, composed_delta, delta_size, composed_snap) : -1;
+    if (size <= 0 || composed_size != size || memcmp(composed_snap, sequential_snap, size) != 0) failures++;
+  }
+
+  demo_r_destroy(&sequential);
+  demo_r_destroy(&composed);
+  fclose(f2);
+  return failures;
+}
+
+/* Random seeks, each followed by a few steps back, against the same positions in a full reader. */
+static int check_seeking(FILE *f, const int *types, int num_types) {
+  FILE *f2 = copy_demo(f);
+  if (!f2) return 1;
+  dd_demo_reader *full = demo_r_create(), *projected = demo_r_create();
+  demo_r_open(full, f);
+  demo_r_subscribe_types(projected, types, num_types);
+  demo_r_open(projected, f2);
+  demo_r_set_snapshot_cache(full, 8, 17);
+  demo_r_set_snapshot_cache(projected, 8, 17);
+
+  int failures = 0;
+  srand(2);
+  for (int k = 0; k < 100; k++) {
+    int tick = rand() % NUM_TICKS;
+    const dd_snapshot *b = demo_r_get_snapshot_at(projected, tick);
+    if (!matches(full, demo_r_get_snapshot_at(full, tick), b, types, num_types)) failures++;
+    for (int step = 0; step < 3; step++) {
+      b = demo_r_prev_tick(projected);
+      const dd_snapshot *a = demo_r_prev_tick(full);
+      if (!a && !b) break;
+      if (!matches(full, a, b, types, num_types)) failures++;
+    }
+  }
+
+  demo_r_destroy(&full);
+  demo_r_destroy(&projected);
+  fclose(f2);
+  return failures;
+}
+
+int main(void) {
+  static const struct {
+    int types[NUM_EXTENDED + 1];
+    int num_types;
+  } subscriptions[] = {
+      {{DD_NETOBJTYPE_CHARACTER, DD_NETOBJTYPE_DDNETCHARACTER, DD_NETEVENTTYPE_FINISH}, 3},
+      {{DD_NETOBJTYPE_SWITCHSTATE}, 1},
+      {{DD_NETEVENTTYPE_FINISH, DD_NETOBJTYPE_DDNETPLAYER}, 2},
+      {{DD_NETOBJTYPE_CHARACTER, DD_NETOBJTYPE_DDNETSPECTATORINFO}, 2},
+      {{DD_NETOBJTYPE_PLAYERINPUT}, 1},
+  };
+
+  FILE *f = write_demo();
+  if (!f) {
+    printf("Failed to write the test demo.\n");
+    return 1;
+  }
+
+  int failures = 0;
+  for (int s = 0; s < (int)(sizeof(subscriptions) / sizeof(subscriptions[0])); s++) {
+    const int *types = subscriptions[s].types;
+    int num_types = subscriptions[s].num_types;
+    int unpacked = check_sequential(f, types, num_types, false);
+    int visited = check_sequential(f, types, num_types, true);
+    int seeked = check_seeking(f, types, num_types);
+    int composed = check_composed(f, types, num_types, 2) + check_composed(f, types, num_types, 4);
+    if (unpacked || visited || seeked || composed)
+      printf("subscription %d: %d unpacked, %d visited, %d seeked, %d composed snapshots differ\n", s, unpacked, visited, seeked, composed);
+    failures += unpacked + visited + seeked + composed;
+  }
+
+  fclose(f);
+  if (failures == 0) printf("ok\n");
+  return failures != 0;
+}
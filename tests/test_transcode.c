@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DDNET_DEMO_IMPLEMENTATION
+#include "ddnet_demo.h"
+
+/*
+ * Decimation keeps every event: the events of dropped ticks are merged into the next kept snapshot. Extended events
+ * have to keep their type there although the extended type indices are reassigned between ticks, and the kept
+ * snapshot may not announce their type at all. Counts the events of a demo by public type before and after
+ * transcoding it at lower rates.
+ */
+
+#define NUM_TICKS 1000
+
+static const int g_extended[] = {DD_NETOBJTYPE_DDNETCHARACTER, DD_NETEVENTTYPE_FINISH, DD_NETOBJTYPE_SWITCHSTATE};
+#define NUM_EXTENDED (int)(sizeof(g_extended) / sizeof(g_extended[0]))
+
+typedef struct {
+  int deaths;
+  int finishes;
+  int unresolved; // items of extended types no EX item names
+} event_counts;
+
+/* Deaths and finishes last one tick and carry their tick, so every one of them is a new item. */
+static FILE *write_demo(void) {
+  FILE *f = tmpfile();
+  if (!f) return NULL;
+  dd_demo_writer *dw = demo_w_create();
+  dd_snapshot_builder *sb = demo_sb_create();
+  static int snap[DD_MAX_SNAPSHOT_SIZE / sizeof(int)];
+  uint8_t map[16] = {0};
+  bool ok = demo_w_begin(dw, f, "events", 0, "DDNet") && demo_w_write_map(dw, NULL, map, sizeof(map));
+
+  srand(3);
+  for (int tick = 0; ok && tick < NUM_TICKS; tick++) {
+    int order[NUM_EXTENDED];
+    for (int i = 0; i < NUM_EXTENDED; i++)
+      order[i] = i;
+    for (int i = NUM_EXTENDED - 1; i > 0; i--) {
+      int j = rand() % (i + 1), t = order[i];
+      order[i] = order[j];
+      order[j] = t;
+    }
+
+    demo_sb_clear(sb);
+    for (int k = 0; k < NUM_EXTENDED; k++) {
+      int type = g_extended[order[k]];
+      int num = type == DD_NETEVENTTYPE_FINISH ? (rand() % 3 == 0) * (1 + rand() % 2) : 4;
+      for (int id = 0; id < num; id++) {
+        int size = dd_get_netobj_type(type)->size;
+        int *data = (int *)demo_sb_add_item(sb, type, id, size);
+        data[0] = tick;
+        data[size / (int)sizeof(int) - 1] = id;
+      }
+    }
+    for (int c = 0; c < 4; c++) {
+      dd_netobj_character *character = (dd_netobj_character *)demo_sb_add_item(sb, DD_NETOBJTYPE_CHARACTER, c, sizeof(*character));
+      character->core.m_X = tick * (c + 1);
+      character->core.m_Tick = tick;
+    }
+    for (int id = 0; id < rand() % 3; id++) {
+      dd_netevent_death *death = (dd_netevent_death *)demo_sb_add_item(sb, DD_NETEVENTTYPE_DEATH, id, sizeof(*death));
+      death->common.m_X = tick;
+      death->m_ClientId = id;
+    }
+    int size = demo_sb_finish(sb, snap);
+    ok = size > 0 && demo_w_write_snap(dw, tick, snap, size);
+  }
+  ok = demo_w_finish(dw) && ok;
+  demo_w_destroy(&dw);
+  demo_sb_destroy(&sb);
+  if (!ok) {
+    fclose(f);
+    return NULL;
+  }
+  return f;
+}
+
+/* An event counts when its type, id and payload weren't in the previous snapshot. */
+static bool count_events(FILE *f, event_counts *counts) {
+  static uint8_t snap_data[DD_MAX_SNAPSHOT_SIZE], prev_data[DD_MAX_SNAPSHOT_SIZE];
+  static int prev_types[DD_MAX_SNAPSHOT_ITEMS];
+  memset(counts, 0, sizeof(*counts));
+  rewind(f);
+  dd_demo_reader *dr = demo_r_create();
+  if (!demo_r_open(dr, f)) {
+    demo_r_destroy(&dr);
+    return false;
+  }
+
+  const dd_snapshot *prev = NULL;
+  dd_demo_chunk chunk;
+  while (demo_r_next_chunk(dr, &chunk)) {
+    const dd_snapshot *snap = NULL;
+    if (chunk.type == DD_CHUNK_SNAP) snap = (const dd_snapshot *)chunk.data;
+    else if (chunk.type == DD_CHUNK_SNAP_DELTA && demo_r_unpack_delta(dr, chunk.data, chunk.size, snap_data) > 0) snap = (const dd_snapshot *)snap_data;
+    if (!snap) continue;
+
+    int types[DD_MAX_SNAPSHOT_ITEMS];
+    for (int i = 0; i < snap->num_items; i++) {
+      const dd_snap_item *item = dd_snap_get_item(snap, i);
+      types[i] = demo_r_item_type(dr, item);
+      if (types[i] < 0) {
+        counts->unresolved++;
+        continue;
+      }
+      if (types[i] != DD_NETEVENTTYPE_DEATH && types[i] != DD_NETEVENTTYPE_FINISH) continue;
+
+      int size = dd_snap_get_item_size(snap, i);
+      bool seen = false;
+      for (int j = 0; prev && j < prev->num_items && !seen; j++) {
+        const dd_snap_item *prev_item = dd_snap_get_item(prev, j);
+        seen = prev_types[j] == types[i] && dd_snap_item_id(prev_item) == dd_snap_item_id(item) && dd_snap_get_item_size(prev, j) == size &&
+               memcmp(dd_snap_item_data(prev_item), dd_snap_item_data(item), size) == 0;
+      }
+      if (seen) continue;
+      if (types[i] == DD_NETEVENTTYPE_DEATH) counts->deaths++;
+      else counts->finishes++;
+    }
+    memmove(prev_data, snap, dd_snap_size(snap));
+    memcpy(prev_types, types, sizeof(int) * snap->num_items);
+    prev = (const dd_snapshot *)prev_data;
+  }
+  demo_r_destroy(&dr);
+  return true;
+}
+
+static FILE *transcode(FILE *f, int decimate, const int *strip_item_types, int num_strip_item_types) {
+  FILE *out = tmpfile();
+  if (!out) return NULL;
+  rewind(f);
+  dd_demo_reader *dr = demo_r_create();
+  dd_demo_writer *dw = demo_w_create();
+  dd_transcode_options options;
+  memset(&options, 0, sizeof(options));
+  options.decimate = decimate;
+  options.strip_item_types = strip_item_types;
+  options.num_strip_item_types = num_strip_item_types;
+  bool ok = demo_r_open(dr, f) && demo_w_begin_from(dw, out, dr) && demo_transcode(dr, dw, 0, -1, &options);
+  ok = demo_w_finish(dw) && ok;
+  demo_w_destroy(&dw);
+  demo_r_destroy(&dr);
+  if (!ok) {
+    fclose(out);
+    return NULL;
+  }
+  return out;
+}
+
+int main(void) {
+  FILE *f = write_demo();
+  event_counts source;
+  if (!f || !count_events(f, &source) || source.deaths == 0 || source.finishes == 0) {
+    printf("Failed to write the test demo.\n");
+    return 1;
+  }
+
+  static const int strip_finish[] = {DD_NETEVENTTYPE_FINISH};
+  static const struct {
+    int decimate;
+    bool strip_finish;
+  } cases[] = {{5, false}, {10, false}, {25, true}};
+
+  int failures = 0;
+  for (int c = 0; c < (int)(sizeof(cases) / sizeof(cases[0])); c++) {
+    FILE *out = transcode(f, cases[c].decimate, strip_finish, cases[c].strip_finish ? 1 : 0);
+    event_counts counts;
+    if (!out || !count_events(out, &counts)) {
+      printf("decimate %d: transcoding failed\n", cases[c].decimate);
+      failures++;
+      if (out) fclose(out);
+      continue;
+    }
+    int expected_finishes = cases[c].strip_finish ? 0 : source.finishes;
+    if (counts.deaths != source.deaths || counts.finishes != expected_finishes || counts.unresolved != 0) {
+      printf("decimate %d: %d/%d deaths, %d/%d finishes, %d items of unknown types\n", cases[c].decimate, counts.deaths, source.deaths, counts.finishes,
+             expected_finishes, counts.unresolved);
+      failures++;
+    }
+    fclose(out);
+  }
+
+  fclose(f);
+  if (failures == 0) printf("ok\n");
+  return failures != 0;
+}
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define DDNET_DEMO_IMPLEMENTATION
+#include "ddnet_demo.h"
+
+/*
+ * Exports the snapshots of a demo into columnar files, one per item type (see demo_export_columns()), or with --info
+ * prints the columns of such a file with their overall min / max. Files are mapped and read in place.
+ */
+
+static int export_demo(const char *input, const char *prefix, int rows_per_chunk) {
+  FILE *f = fopen(input, "rb");
+  if (!f) {
+    printf("Failed to open file: %s\n", input);
+    return 1;
+  }
+  dd_demo_reader *dr = demo_r_create();
+  if (!demo_r_open(dr, f)) {
+    printf("Failed to open demo file.\n");
+    demo_r_destroy(&dr);
+    fclose(f);
+    return 1;
+  }
+
+  int num_files = demo_export_columns(dr, prefix, rows_per_chunk);
+  if (num_files < 0) fprintf(stderr, "Export failed, the demo is broken or the output can't be written.\n");
+  else printf("Wrote %d files.\n", num_files);
+
+  demo_r_destroy(&dr);
+  fclose(f);
+  return num_files < 0;
+}
+
+static void print_info(const dd_column_file *cf) {
+  const dd_column_header *header = cf->header;
+  printf("%s (type %d): %lld rows in %d chunks\n", header->name, header->type, (long long)header->num_rows, header->num_chunks);
+  for (int c = 0; c < header->num_columns; c++) {
+    int min = 0, max = 0;
+    for (int i = 0; i < header->num_chunks; i++) {
+      const dd_column_stats *stats = demo_col_stats(cf, i, c);
+      if (i == 0 || stats->min < min) min = stats->min;
+      if (i == 0 || stats->max > max) max = stats->max;
+    }
+    printf("  %-24s min %d max %d\n", cf->column_names[c], min, max);
+  }
+}
+
+static int show_info(const char *path) {
+  dd_column_file cf;
+  bool ok = false;
+#ifndef _WIN32
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    printf("Failed to open file: %s\n", path);
+    if (fd >= 0) close(fd);
+    return 1;
+  }
+  void *data = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (data != MAP_FAILED) {
+    ok = demo_col_open(&cf, data, st.st_size);
+    if (ok) print_info(&cf);
+    munmap(data, st.st_size);
+  }
+#else
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    printf("Failed to open file: %s\n", path);
+    return 1;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  void *data = size > 0 ? malloc(size) : NULL;
+  if (data && fread(data, size, 1, f) == 1) {
+    ok = demo_col_open(&cf, data, size);
+    if (ok) print_info(&cf);
+  }
+  free(data);
+  fclose(f);
+#endif
+  if (!ok) printf("Not a column file: %s\n", path);
+  return !ok;
+}
+
+int main(int argc, char **argv) {
+  int rows_per_chunk = 0;
+  const char *input = NULL, *prefix = NULL;
+  bool info = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--rows") == 0 && i + 1 < argc) {
+      rows_per_chunk = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--info") == 0) {
+      info = true;
+    } else if (!input) {
+      input = argv[i];
+    } else if (!prefix) {
+      prefix = argv[i];
+    } else {
+      input = NULL;
+      break;
+    }
+  }
+  if (!input || (!info && !prefix)) {
+    printf("Usage: %s [--rows rows_per_chunk] <demo_file> <output_prefix>\n", argv[0]);
+    printf("       %s --info <column_file>\n", argv[0]);
+    return 1;
+  }
+
+  return info ? show_info(input) : export_demo(input, prefix, rows_per_chunk);
+}
@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DDNET_DEMO_IMPLEMENTATION
+#include "ddnet_demo.h"
+
+/*
+ * Joins consecutive demos of the same map into one. Compressed chunks are copied as they are, ticks of parts that
+ * overlap the previous one are moved behind it.
+ */
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    printf("Usage: %s <output_file> <demo_file>...\n", argv[0]);
+    return 1;
+  }
+
+  int num_parts = argc - 2;
+  FILE **files = (FILE **)calloc(num_parts, sizeof(FILE *));
+  dd_demo_reader **parts = (dd_demo_reader **)calloc(num_parts, sizeof(dd_demo_reader *));
+  if (!files || !parts) {
+    printf("Out of memory.\n");
+    return 1;
+  }
+
+  bool ok = true;
+  for (int i = 0; i < num_parts && ok; i++) {
+    files[i] = fopen(argv[i + 2], "rb");
+    if (!files[i]) {
+      printf("Failed to open file: %s\n", argv[i + 2]);
+      ok = false;
+      break;
+    }
+    parts[i] = demo_r_create();
+    if (!demo_r_open(parts[i], files[i])) {
+      printf("Failed to open demo file: %s\n", argv[i + 2]);
+      ok = false;
+    }
+  }
+
+  if (ok) {
+    FILE *out = fopen(argv[1], "wb");
+    if (!out) {
+      printf("Failed to open output file: %s\n", argv[1]);
+      ok = false;
+    } else {
+      ok = demo_concat(parts, num_parts, out);
+      if (!ok) fprintf(stderr, "Concatenation failed, the demos are of different maps or broken.\n");
+      fclose(out);
+    }
+  }
+
+  for (int i = 0; i < num_parts; i++) {
+    if (parts[i]) demo_r_destroy(&parts[i]);
+    if (files[i]) fclose(files[i]);
+  }
+  free(parts);
+  free(files);
+  return !ok;
+}
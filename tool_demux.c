@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DDNET_DEMO_IMPLEMENTATION
+#include "ddnet_demo.h"
+
+/*
+ * Cuts "my POV" demos out of a server demo: one demo per player with only what that player could see (see
+ * demo_demux_players()), all written in a single pass. Without client ids every player of the demo gets one.
+ */
+
+static bool open_demo(FILE *f, dd_demo_reader **dr_out) {
+  dd_demo_reader *dr = demo_r_create();
+  if (!demo_r_open(dr, f)) {
+    demo_r_destroy(&dr);
+    return false;
+  }
+  *dr_out = dr;
+  return true;
+}
+
+/* Finds the players of the demo from their player infos, reading nothing else. */
+static int find_players(dd_demo_reader *dr, int *client_ids) {
+  static const int types[] = {DD_NETOBJTYPE_PLAYERINFO};
+  demo_r_subscribe_types(dr, types, 1);
+  uint8_t *unpacked = (uint8_t *)malloc(DD_MAX_SNAPSHOT_SIZE);
+  bool seen[DD_MAX_CLIENTS] = {false};
+  dd_demo_chunk chunk;
+  while (unpacked && demo_r_next_chunk(dr, &chunk)) {
+    const dd_snapshot *snap = NULL;
+    if (chunk.type == DD_CHUNK_SNAP) snap = (const dd_snapshot *)chunk.data;
+    else if (chunk.type == DD_CHUNK_SNAP_DELTA && demo_r_unpack_delta(dr, chunk.data, chunk.size, unpacked) > 0) snap = (const dd_snapshot *)unpacked;
+    for (int i = 0; snap && i < snap->num_items; i++) {
+      int id = dd_snap_item_id(dd_snap_get_item(snap, i));
+      if (id >= 0 && id < DD_MAX_CLIENTS) seen[id] = true;
+    }
+  }
+  free(unpacked);
+
+  int num_players = 0;
+  for (int c = 0; c < DD_MAX_CLIENTS; c++) {
+    if (seen[c]) client_ids[num_players++] = c;
+  }
+  return num_players;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    printf("Usage: %s <demo_file> <output_prefix> [client_id...]\n", argv[0]);
+    return 1;
+  }
+  const char *input = argv[1], *prefix = argv[2];
+
+  FILE *f = fopen(input, "rb");
+  if (!f) {
+    printf("Failed to open file: %s\n", input);
+    return 1;
+  }
+  dd_demo_reader *dr;
+  if (!open_demo(f, &dr)) {
+    printf("Failed to open demo file.\n");
+    fclose(f);
+    return 1;
+  }
+
+  int client_ids[DD_MAX_CLIENTS], num_outputs = 0;
+  for (int i = 3; i < argc && num_outputs < DD_MAX_CLIENTS; i++)
+    client_ids[num_outputs++] = atoi(argv[i]);
+  if (num_outputs == 0) {
+    num_outputs = find_players(dr, client_ids);
+    demo_r_destroy(&dr);
+    fseek(f, 0, SEEK_SET);
+    if (!open_demo(f, &dr)) {
+      printf("Failed to open demo file.\n");
+      fclose(f);
+      return 1;
+    }
+  }
+
+  dd_demux_output outputs[DD_MAX_CLIENTS];
+  int num_open = 0;
+  bool ok = true;
+  for (int o = 0; o < num_outputs; o++) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s%d.demo", prefix, client_ids[o]);
+    outputs[o].client_id = client_ids[o];
+    outputs[o].f = fopen(path, "wb");
+    if (!outputs[o].f) {
+      printf("Failed to open output file: %s\n", path);
+      ok = false;
+      break;
+    }
+    num_open++;
+  }
+
+  if (ok) {
+    ok = demo_demux_players(dr, outputs, num_outputs);
+    if (ok) printf("Wrote %d player demos.\n", num_outputs);
+    else fprintf(stderr, "Demuxing failed, the demo is broken or an output can't be written.\n");
+  }
+
+  for (int o = 0; o < num_open; o++)
+    fclose(outputs[o].f);
+  demo_r_destroy(&dr);
+  fclose(f);
+  return !ok;
+}
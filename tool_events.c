@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DDNET_DEMO_IMPLEMENTATION
+#include "ddnet_demo.h"
+
+/*
+ * Extracts chat, kills, race finishes and death / finish events from a demo in one pass.
+ * Output is NDJSON (one object per line) or, with --binary, a flat log:
+ *   "DDEVLOG1", then per event 8 little endian int32 (tick, type, client_id, data[4], text_len) followed by the text.
+ */
+
+static const char *g_event_names[DD_NUM_EVENT_TYPES] = {"chat", "kill", "racefinish", "death", "finish"};
+
+typedef struct {
+  FILE *out;
+  bool binary;
+} output;
+
+static void write_json_string(FILE *out, const char *str, int len) {
+  fputc('"', out);
+  for (int i = 0; i < len; i++) {
+    unsigned char c = (unsigned char)str[i];
+    if (c == '"' || c == '\\') {
+      fputc('\\', out);
+      fputc(c, out);
+    } else if (c < 0x20) {
+      fprintf(out, "\\u%04x", c);
+    } else {
+      fputc(c, out);
+    }
+  }
+  fputc('"', out);
+}
+
+static void write_le32(FILE *out, int value) {
+  uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+  fwrite(bytes, sizeof(bytes), 1, out);
+}
+
+static void on_event(void *user, const dd_event *event) {
+  output *o = (output *)user;
+  if (o->binary) {
+    write_le32(o->out, event->tick);
+    write_le32(o->out, event->type);
+    write_le32(o->out, event->client_id);
+    for (int i = 0; i < 4; i++)
+      write_le32(o->out, event->data[i]);
+    write_le32(o->out, event->text_len);
+    fwrite(event->text, 1, event->text_len, o->out);
+    return;
+  }
+
+  fprintf(o->out, "{\"tick\":%d,\"type\":\"%s\",\"client_id\":%d", event->tick, g_event_names[event->type], event->client_id);
+  switch (event->type) {
+  case DD_EVENT_CHAT:
+    fprintf(o->out, ",\"team\":%d,\"text\":", event->data[0]);
+    write_json_string(o->out, event->text, event->text_len);
+    break;
+  case DD_EVENT_KILL:
+    fprintf(o->out, ",\"killer\":%d,\"weapon\":%d,\"mode_special\":%d", event->data[0], event->data[1], event->data[2]);
+    break;
+  case DD_EVENT_RACE_FINISH:
+    fprintf(o->out, ",\"time\":%d,\"diff\":%d,\"record_personal\":%d,\"record_server\":%d", event->data[0], event->data[1], event->data[2],
+            event->data[3]);
+    break;
+  default:
+    fprintf(o->out, ",\"x\":%d,\"y\":%d", event->data[0], event->data[1]);
+    break;
+  }
+  fputs("}\n", o->out);
+}
+
+static bool parse_types(const char *list, unsigned *mask) {
+  *mask = 0;
+  while (*list) {
+    size_t len = strcspn(list, ",");
+    int type = 0;
+    while (type < DD_NUM_EVENT_TYPES && (strlen(g_event_names[type]) != len || strncmp(g_event_names[type], list, len) != 0))
+      type++;
+    if (type == DD_NUM_EVENT_TYPES) return false;
+    *mask |= DD_EVENT_MASK(type);
+    list += len;
+    if (*list == ',') list++;
+  }
+  return *mask != 0;
+}
+
+int main(int argc, char **argv) {
+  output o = {stdout, false};
+  unsigned mask = DD_EVENT_MASK_ALL;
+  const char *input = NULL, *output_path = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--binary") == 0) {
+      o.binary = true;
+    } else if (strcmp(argv[i], "--types") == 0 && i + 1 < argc) {
+      if (!parse_types(argv[++i], &mask)) {
+        printf("Unknown event types: %s\n", argv[i]);
+        return 1;
+      }
+    } else if (!input) {
+      input = argv[i];
+    } else if (!output_path) {
+      output_path = argv[i];
+    } else {
+      input = NULL;
+      break;
+    }
+  }
+  if (!input) {
+    printf("Usage: %s [--binary] [--types chat,kill,racefinish,death,finish] <demo_file> [output_file]\n", argv[0]);
+    return 1;
+  }
+
+  FILE *f = fopen(input, "rb");
+  if (!f) {
+    printf("Failed to open file: %s\n", input);
+    return 1;
+  }
+  dd_demo_reader *dr = demo_r_create();
+  if (!demo_r_open(dr, f)) {
+    printf("Failed to open demo file.\n");
+    demo_r_destroy(&dr);
+    fclose(f);
+    return 1;
+  }
+
+  if (output_path) {
+    o.out = fopen(output_path, "wb");
+    if (!o.out) {
+      printf("Failed to open output file: %s\n", output_path);
+      demo_r_destroy(&dr);
+      fclose(f);
+      return 1;
+    }
+  }
+  if (o.binary) fwrite("DDEVLOG1", 8, 1, o.out);
+
+  int num_events = demo_extract_events(dr, mask, on_event, &o);
+  if (num_events < 0) fprintf(stderr, "Demo is truncated or corrupt, the event log stops there.\n");
+
+  if (o.out != stdout) fclose(o.out);
+  demo_r_destroy(&dr);
+  fclose(f);
+  return num_events < 0;
+}
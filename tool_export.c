@@ -0,0 +1,477 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define DDNET_DEMO_IMPLEMENTATION
+#include "ddnet_demo.h"
+
+/*
+ * Streams the snapshots and messages of a demo as NDJSON, one record per tick:
+ *   {"tick":50,"items":[{"type":"character","id":0,"Tick":50,"X":1024,...},...],"msgs":[{"id":3,"system":false,...}]}
+ * or, with --csv, one row per item of a single item type: tick,id,<fields>. Field names come from the library's item
+ * schemas (f0, f1, ... for types without one). With --threads the demo is cut at keyframes and the pieces are
+ * formatted in parallel into temporary files, which are copied to the output in order.
+ */
+
+#define MAX_TYPE_SLOTS (DD_MAX_NETOBJSIZES + MAX_EXTENDED_ITEM_TYPES)
+#define MAX_FIELDS 64
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+typedef struct {
+  const char *name;
+  int num_fields;
+  const char *fields[MAX_FIELDS];
+  int field_lens[MAX_FIELDS];
+} type_schema;
+
+typedef struct {
+  const char *input;
+  bool csv;
+  bool messages;
+  bool selected[MAX_TYPE_SLOTS];
+  type_schema schemas[MAX_TYPE_SLOTS];
+} options;
+
+typedef struct {
+  FILE *f;
+  char *data;
+  size_t size;
+  bool error;
+} output;
+
+static int type_slot(int type) {
+  if (type > 0 && type < DD_MAX_NETOBJSIZES) return type;
+  if (type >= OFFSET_UUID && type < OFFSET_UUID + MAX_EXTENDED_ITEM_TYPES) return DD_MAX_NETOBJSIZES + type - OFFSET_UUID;
+  return -1;
+}
+
+static void load_schemas(options *o) {
+  for (int slot = 0; slot < MAX_TYPE_SLOTS; slot++) {
+    int type = slot < DD_MAX_NETOBJSIZES ? slot : OFFSET_UUID + slot - DD_MAX_NETOBJSIZES;
+    type_schema *schema = &o->schemas[slot];
+    const char *fields;
+    schema->name = demo_item_schema(type, &fields);
+    if (!schema->name) continue;
+    while (*fields && schema->num_fields < MAX_FIELDS) {
+      int len = (int)strcspn(fields, " ");
+      schema->fields[schema->num_fields] = fields;
+      schema->field_lens[schema->num_fields++] = len;
+      fields += len;
+      while (*fields == ' ')
+        fields++;
+    }
+  }
+}
+
+static bool select_types(options *o, const char *list) {
+  while (*list) {
+    size_t len = strcspn(list, ",");
+    // "all" includes the types without a schema, their items are written with numeric type and field names
+    bool all = len == 3 && strncmp(list, "all", 3) == 0, found = all;
+    for (int slot = 0; slot < MAX_TYPE_SLOTS; slot++) {
+      const char *name = o->schemas[slot].name;
+      if (!all && (!name || strlen(name) != len || strncmp(name, list, len) != 0)) continue;
+      o->selected[slot] = true;
+      found = true;
+    }
+    if (!found) return false;
+    list += len;
+    if (*list == ',') list++;
+  }
+  return true;
+}
+
+static void out_flush(output *out) {
+  if (out->size && fwrite(out->data, out->size, 1, out->f) != 1) out->error = true;
+  out->size = 0;
+}
+
+static void out_write(output *out, const char *str, size_t len) {
+  if (out->size + len > OUTPUT_BUFFER_SIZE) out_flush(out);
+  if (len > OUTPUT_BUFFER_SIZE) {
+    if (fwrite(str, len, 1, out->f) != 1) out->error = true;
+    return;
+  }
+  memcpy(out->data + out->size, str, len);
+  out->size += len;
+}
+
+static void out_str(output *out, const char *str) { out_write(out, str, strlen(str)); }
+
+static void out_int(output *out, int value) {
+  char digits[12];
+  int pos = sizeof(digits);
+  unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+  do {
+    digits[--pos] = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude);
+  if (value < 0) digits[--pos] = '-';
+  out_write(out, digits + pos, sizeof(digits) - pos);
+}
+
+static void out_json_string(output *out, const char *str) {
+  static const char hex[] = "0123456789abcdef";
+  out_write(out, "\"", 1);
+  for (const char *start = str;; str++) {
+    unsigned char c = (unsigned char)*str;
+    if (c >= 0x20 && c != '"' && c != '\\') continue;
+    out_write(out, start, str - start);
+    if (!c) break;
+    if (c == '"' || c == '\\') {
+      char escaped[2] = {'\\', (char)c};
+      out_write(out, escaped, 2);
+    } else {
+      char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+      out_write(out, escaped, 6);
+    }
+    start = str + 1;
+  }
+  out_write(out, "\"", 1);
+}
+
+static void out_field_name(output *out, const type_schema *schema, int field) {
+  out_write(out, ",\"", 2);
+  if (field < schema->num_fields) {
+    out_write(out, schema->fields[field], schema->field_lens[field]);
+  } else {
+    out_write(out, "f", 1);
+    out_int(out, field);
+  }
+  out_write(out, "\":", 2);
+}
+
+static void write_item_json(output *out, const type_schema *schema, int type, const dd_snap_item *item, int size) {
+  out_str(out, "{\"type\":");
+  if (schema->name) {
+    out_write(out, "\"", 1);
+    out_str(out, schema->name);
+    out_write(out, "\"", 1);
+  } else {
+    out_int(out, type);
+  }
+  out_str(out, ",\"id\":");
+  out_int(out, dd_snap_item_id(item));
+  const int *data = dd_snap_item_data(item);
+  for (int i = 0; i < size / 4; i++) {
+    out_field_name(out, schema, i);
+    out_int(out, data[i]);
+  }
+  out_write(out, "}", 1);
+}
+
+static void write_message_json(output *out, const dd_demo_chunk *chunk) {
+  dd_msg_unpacker unpacker;
+  demo_msg_unpack_init(&unpacker, chunk->data, chunk->size);
+  bool system;
+  int msg_id = demo_msg_get_header(&unpacker, &system);
+  out_str(out, "{\"id\":");
+  out_int(out, msg_id);
+  out_str(out, system ? ",\"system\":true" : ",\"system\":false");
+  if (!system && msg_id == DD_NETMSGTYPE_SV_CHAT) {
+    dd_netmsg_sv_chat chat;
+    if (demo_msg_decode_sv_chat(&unpacker, &chat)) {
+      out_str(out, ",\"team\":");
+      out_int(out, chat.m_Team);
+      out_str(out, ",\"client_id\":");
+      out_int(out, chat.m_ClientId);
+      out_str(out, ",\"message\":");
+      out_json_string(out, chat.m_pMessage);
+    }
+  } else if (!system && msg_id == DD_NETMSGTYPE_SV_KILLMSG) {
+    dd_netmsg_sv_killmsg kill;
+    if (demo_msg_decode_sv_killmsg(&unpacker, &kill)) {
+      out_str(out, ",\"killer\":");
+      out_int(out, kill.m_Killer);
+      out_str(out, ",\"victim\":");
+      out_int(out, kill.m_Victim);
+      out_str(out, ",\"weapon\":");
+      out_int(out, kill.m_Weapon);
+    }
+  }
+  out_write(out, "}", 1);
+}
+
+/* Writes the record of `tick`: the selected items of `snap` (NULL before the first snapshot) and the tick's messages. */
+static void write_tick(const options *o, output *out, dd_demo_reader *dr, int tick, const dd_snapshot *snap, output *msgs) {
+  if (o->csv) {
+    for (int i = 0; snap && i < snap->num_items; i++) {
+      const dd_snap_item *item = dd_snap_get_item(snap, i);
+      int slot = type_slot(demo_r_item_type(dr, item));
+      if (slot < 0 || !o->selected[slot]) continue;
+      out_int(out, tick);
+      out_write(out, ",", 1);
+      out_int(out, dd_snap_item_id(item));
+      const int *data = dd_snap_item_data(item);
+      int num_fields = dd_snap_get_item_size(snap, i) / 4;
+      for (int f = 0; f < o->schemas[slot].num_fields; f++) {
+        out_write(out, ",", 1);
+        out_int(out, f < num_fields ? data[f] : 0);
+      }
+      out_write(out, "\n", 1);
+    }
+    return;
+  }
+
+  out_str(out, "{\"tick\":");
+  out_int(out, tick);
+  out_str(out, ",\"items\":[");
+  bool first = true;
+  for (int i = 0; snap && i < snap->num_items; i++) {
+    const dd_snap_item *item = dd_snap_get_item(snap, i);
+    int type = demo_r_item_type(dr, item);
+    int slot = type_slot(type);
+    if (slot < 0 || !o->selected[slot]) continue;
+    if (!first) out_write(out, ",", 1);
+    first = false;
+    write_item_json(out, &o->schemas[slot], type, item, dd_snap_get_item_size(snap, i));
+  }
+  out_write(out, "]", 1);
+  if (o->messages) {
+    out_str(out, ",\"msgs\":[");
+    out_write(out, msgs->data, msgs->size);
+    out_write(out, "]", 1);
+  }
+  out_write(out, "}\n", 2);
+  msgs->size = 0;
+}
+
+/* Formats the ticks [start_tick, end_tick] (end_tick -1: up to the end) of the demo into `out`. */
+static bool export_range(const options *o, int start_tick, int end_tick, output *out) {
+  FILE *f = fopen(o->input, "rb");
+  if (!f) return false;
+  dd_demo_reader *dr = demo_r_create();
+  uint8_t *snap = (uint8_t *)malloc(DD_MAX_SNAPSHOT_SIZE);
+  // a tick's messages come after its tick marker, its record is written at the next one
+  output msgs = {NULL, (char *)malloc(OUTPUT_BUFFER_SIZE), 0, false};
+  bool ok = dr && snap && msgs.data && demo_r_open(dr, f);
+  bool has_snap = false;
+
+  if (ok && start_tick > 0) {
+    const dd_snapshot *start = demo_r_get_snapshot_at(dr, start_tick - 1);
+    if (start) memcpy(snap, start, dd_snap_size(start));
+    has_snap = start != NULL;
+  }
+
+  int tick = -1;
+  dd_demo_chunk chunk;
+  while (ok && demo_r_next_chunk(dr, &chunk)) {
+    switch (chunk.type) {
+    case DD_CHUNK_TICK_MARKER:
+      if (end_tick >= 0 && chunk.tick > end_tick) goto done;
+      if (tick >= 0) write_tick(o, out, dr, tick, has_snap ? (const dd_snapshot *)snap : NULL, &msgs);
+      tick = chunk.tick;
+      break;
+    case DD_CHUNK_SNAP:
+      memcpy(snap, chunk.data, chunk.size);
+      has_snap = true;
+      break;
+    case DD_CHUNK_SNAP_DELTA:
+      ok = demo_r_unpack_delta(dr, chunk.data, chunk.size, snap) > 0;
+      has_snap = true;
+      break;
+    case DD_CHUNK_MSG:
+      if (!o->messages || o->csv || tick < 0) break;
+      // the buffer has no file, an overlong tick loses its last messages instead of the record
+      if (msgs.size + chunk.size * 6 + 128 > OUTPUT_BUFFER_SIZE) break;
+      if (msgs.size) out_write(&msgs, ",", 1);
+      write_message_json(&msgs, &chunk);
+      break;
+    }
+  }
+done:
+  if (ok && tick >= 0) write_tick(o, out, dr, tick, has_snap ? (const dd_snapshot *)snap : NULL, &msgs);
+
+  free(msgs.data);
+  free(snap);
+  demo_r_destroy(&dr);
+  fclose(f);
+  return ok;
+}
+
+typedef struct {
+  int start_tick;
+  int end_tick;
+  FILE *file;
+  bool ok;
+} segment;
+
+typedef struct {
+  const options *o;
+  segment *segments;
+  int num_segments;
+  int next_segment;
+#ifndef _WIN32
+  pthread_mutex_t lock;
+#endif
+} job;
+
+static void export_segment(const options *o, segment *seg) {
+  output out = {tmpfile(), (char *)malloc(OUTPUT_BUFFER_SIZE), 0, false};
+  seg->file = out.f;
+  seg->ok = out.f && out.data && export_range(o, seg->start_tick, seg->end_tick, &out);
+  if (out.f) out_flush(&out);
+  seg->ok = seg->ok && !out.error;
+  free(out.data);
+}
+
+#ifndef _WIN32
+static void *worker(void *user) {
+  job *j = (job *)user;
+  for (;;) {
+    pthread_mutex_lock(&j->lock);
+    int index = j->next_segment++;
+    pthread_mutex_unlock(&j->lock);
+    if (index >= j->num_segments) return NULL;
+    export_segment(j->o, &j->segments[index]);
+  }
+}
+#endif
+
+/* Cuts at keyframes into about `target` segments. */
+static int split_segments(const char *input, int target, segment *segments) {
+  FILE *f = fopen(input, "rb");
+  if (!f) return 0;
+  dd_demo_reader *dr = demo_r_create();
+  int num_segments = 0;
+  if (demo_r_open(dr, f) && demo_r_num_keyframes(dr) > 0) {
+    int num_keyframes = demo_r_num_keyframes(dr);
+    int first = demo_r_keyframe_tick(dr, 0), last = demo_r_keyframe_tick(dr, num_keyframes - 1);
+    int length = (last - first) / target;
+    segments[num_segments++].start_tick = first;
+    for (int i = 1; i < num_keyframes && num_segments < target; i++) {
+      int tick = demo_r_keyframe_tick(dr, i);
+      if (tick - segments[num_segments - 1].start_tick < length) continue;
+      segments[num_segments - 1].end_tick = tick - 1;
+      segments[num_segments++].start_tick = tick;
+    }
+    segments[num_segments - 1].end_tick = -1;
+  }
+  demo_r_destroy(&dr);
+  fclose(f);
+  return num_segments;
+}
+
+static bool export_parallel(const options *o, int num_threads, output *out) {
+  job j;
+  memset(&j, 0, sizeof(j));
+  j.o = o;
+  int target = num_threads * 4;
+  j.segments = (segment *)calloc(target, sizeof(segment));
+  if (!j.segments) return false;
+  j.num_segments = split_segments(o->input, target, j.segments);
+  // ticks before the first keyframe have no snapshot, the first segment still starts at the beginning
+  if (j.num_segments > 0) j.segments[0].start_tick = 0;
+
+#ifndef _WIN32
+  if (num_threads > j.num_segments) num_threads = j.num_segments;
+  pthread_t *threads = (pthread_t *)calloc(num_threads > 0 ? num_threads : 1, sizeof(pthread_t));
+  pthread_mutex_init(&j.lock, NULL);
+  int num_started = 0;
+  for (int i = 0; threads && i < num_threads; i++) {
+    if (pthread_create(&threads[i], NULL, worker, &j) != 0) break;
+    num_started++;
+  }
+  if (num_started == 0) worker(&j);
+  for (int i = 0; i < num_started; i++)
+    pthread_join(threads[i], NULL);
+  pthread_mutex_destroy(&j.lock);
+  free(threads);
+#else
+  for (int i = 0; i < j.num_segments; i++)
+    export_segment(o, &j.segments[i]);
+#endif
+
+  bool ok = j.num_segments > 0;
+  for (int i = 0; i < j.num_segments; i++) {
+    segment *seg = &j.segments[i];
+    ok = ok && seg->ok && fseek(seg->file, 0, SEEK_SET) == 0;
+    size_t read;
+    out_flush(out);
+    while (ok && (read = fread(out->data, 1, OUTPUT_BUFFER_SIZE, seg->file)) > 0) {
+      out->size = read;
+      out_flush(out);
+    }
+    if (seg->file) fclose(seg->file);
+  }
+  free(j.segments);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  static options o;
+  load_schemas(&o);
+  const char *output_path = NULL, *types = NULL;
+  int num_threads = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--csv") == 0) {
+      o.csv = true;
+    } else if (strcmp(argv[i], "--msgs") == 0) {
+      o.messages = true;
+    } else if (strcmp(argv[i], "--types") == 0 && i + 1 < argc) {
+      types = argv[++i];
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      num_threads = atoi(argv[++i]);
+#ifndef _WIN32
+      if (num_threads <= 0) num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+      if (num_threads < 1) num_threads = 1;
+    } else if (!o.input) {
+      o.input = argv[i];
+    } else if (!output_path) {
+      output_path = argv[i];
+    } else {
+      o.input = NULL;
+      break;
+    }
+  }
+  if (!o.input) {
+    printf("Usage: %s [--types all|character,ddnet_character,...] [--msgs] [--csv] [--threads n] <demo_file> [output_file]\n", argv[0]);
+    return 1;
+  }
+  if (!select_types(&o, types ? types : "all")) {
+    printf("Unknown item types: %s\n", types);
+    return 1;
+  }
+  int csv_slot = -1, num_selected = 0;
+  for (int slot = 0; slot < MAX_TYPE_SLOTS; slot++) {
+    if (!o.selected[slot]) continue;
+    csv_slot = slot;
+    num_selected++;
+  }
+  if (o.csv && num_selected != 1) {
+    printf("CSV export takes exactly one item type.\n");
+    return 1;
+  }
+
+  output out = {stdout, (char *)malloc(OUTPUT_BUFFER_SIZE), 0, false};
+  if (output_path) out.f = fopen(output_path, "wb");
+  if (!out.f || !out.data) {
+    printf("Failed to open output file: %s\n", output_path);
+    free(out.data);
+    return 1;
+  }
+  if (o.csv) {
+    const type_schema *schema = &o.schemas[csv_slot];
+    out_str(&out, "tick,id");
+    for (int f = 0; f < schema->num_fields; f++) {
+      out_write(&out, ",", 1);
+      out_write(&out, schema->fields[f], schema->field_lens[f]);
+    }
+    out_write(&out, "\n", 1);
+  }
+
+  bool ok = num_threads > 1 ? export_parallel(&o, num_threads, &out) : export_range(&o, 0, -1, &out);
+  out_flush(&out);
+  if (!ok || out.error) fprintf(stderr, "Export failed, the demo is broken or the output can't be written.\n");
+
+  if (out.f != stdout) fclose(out.f);
+  free(out.data);
+  return !ok || out.error;
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DDNET_DEMO_IMPLEMENTATION
+#include "ddnet_demo.h"
+
+/*
+ * Extracts the movement of all players from a demo in a single pass (see demo_extract_trajectories()) and writes a
+ * DDNet ghost file for every race finish, or with --csv the whole trajectory of every client as one CSV file each.
+ */
+
+static void sanitize_name(char *dst, const char *name, int size) {
+  int len = 0;
+  for (; name[len] && len < size - 1; len++) {
+    char c = name[len];
+    bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '.';
+    dst[len] = ok ? c : '_';
+  }
+  dst[len] = '\0';
+}
+
+static int write_ghosts(const dd_trajectories *trajectories, const dd_demo_info *info, const char *prefix) {
+  int num_written = 0;
+  for (int i = 0; i < demo_traj_num_runs(trajectories); i++) {
+    const dd_ghost_run *run = demo_traj_run(trajectories, i);
+    char name[16], path[512];
+    sanitize_name(name, run->name, sizeof(name));
+    snprintf(path, sizeof(path), "%s%s_%d.%03d.gho", prefix, name, run->time_ms / 1000, run->time_ms % 1000);
+    FILE *f = fopen(path, "wb");
+    if (!f || !demo_write_ghost(trajectories, i, info, f)) {
+      fprintf(stderr, "Failed to write ghost: %s\n", path);
+      if (f) fclose(f);
+      continue;
+    }
+    fclose(f);
+    printf("%s: client %d, ticks %d-%d\n", path, run->client_id, run->start_tick, run->finish_tick);
+    num_written++;
+  }
+  return num_written;
+}
+
+static int write_csv(const dd_trajectories *trajectories, const char *prefix) {
+  int num_written = 0;
+  dd_trajectory_sample *samples = NULL;
+  for (int c = 0; c < DD_MAX_CLIENTS; c++) {
+    int num_samples = demo_traj_num_samples(trajectories, c);
+    if (num_samples == 0) continue;
+    dd_trajectory_sample *tmp = (dd_trajectory_sample *)realloc(samples, num_samples * sizeof(dd_trajectory_sample));
+    if (!tmp) break;
+    samples = tmp;
+    num_samples = demo_traj_decode(trajectories, c, 0, 0x7fffffff, samples, num_samples);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s%d.csv", prefix, c);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+      fprintf(stderr, "Failed to write trajectory: %s\n", path);
+      continue;
+    }
+    fprintf(f, "tick,x,y,vel_x,vel_y,angle,direction,weapon,hook_state,hook_x,hook_y,attack_tick,core_tick\n");
+    for (int i = 0; i < num_samples; i++) {
+      const dd_ghost_character *ch = &samples[i].character;
+      fprintf(f, "%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n", samples[i].tick, ch->m_X, ch->m_Y, ch->m_VelX, ch->m_VelY, ch->m_Angle,
+              ch->m_Direction, ch->m_Weapon, ch->m_HookState, ch->m_HookX, ch->m_HookY, ch->m_AttackTick, ch->m_Tick);
+    }
+    fclose(f);
+    printf("%s: %d samples\n", path, num_samples);
+    num_written++;
+  }
+  free(samples);
+  return num_written;
+}
+
+int main(int argc, char **argv) {
+  bool csv = false;
+  const char *input = NULL, *prefix = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--csv") == 0) {
+      csv = true;
+    } else if (!input) {
+      input = argv[i];
+    } else if (!prefix) {
+      prefix = argv[i];
+    } else {
+      input = NULL;
+      break;
+    }
+  }
+  if (!input || !prefix) {
+    printf("Usage: %s [--csv] <demo_file> <output_prefix>\n", argv[0]);
+    return 1;
+  }
+
+  FILE *f = fopen(input, "rb");
+  if (!f) {
+    printf("Failed to open file: %s\n", input);
+    return 1;
+  }
+  dd_demo_reader *dr = demo_r_create();
+  if (!demo_r_open(dr, f)) {
+    printf("Failed to open demo file.\n");
+    demo_r_destroy(&dr);
+    fclose(f);
+    return 1;
+  }
+
+  dd_trajectories *trajectories = demo_extract_trajectories(dr);
+  if (!trajectories) {
+    fprintf(stderr, "Failed to read the demo.\n");
+    demo_r_destroy(&dr);
+    fclose(f);
+    return 1;
+  }
+
+  int num_files = csv ? write_csv(trajectories, prefix) : write_ghosts(trajectories, demo_r_get_info(dr), prefix);
+  printf("Wrote %d files.\n", num_files);
+
+  demo_traj_destroy(&trajectories);
+  demo_r_destroy(&dr);
+  fclose(f);
+  return 0;
+}
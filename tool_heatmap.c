@@ -0,0 +1,238 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define DDNET_DEMO_IMPLEMENTATION
+#include "ddnet_demo.h"
+
+/*
+ * Aggregates many demos of a map into tile heatmaps (see demo_heatmap_add()): where players are, where they stall,
+ * die and finish. The demos are handed out to threads one at a time, each thread fills its own heatmap and they are
+ * merged at the end. Writes `<prefix>heatmap.raw` with all layers and one 8 bit PGM image per layer, log scaled.
+ * The raw file is a header (magic "DDHEAT1", width, height, number of layers, tile size as int32) followed by the
+ * layers as width * height uint32 counters, row by row, in host byte order.
+ */
+
+static const char *g_layer_names[DD_NUM_HEAT_LAYERS] = {"occupancy", "stall", "death", "finish"};
+
+typedef struct {
+  char **paths;
+  int num_paths;
+  int next_path;
+  int num_failed;
+#ifndef _WIN32
+  pthread_mutex_t lock;
+#endif
+} job;
+
+typedef struct {
+  job *j;
+  dd_heatmap heatmap;
+} worker_state;
+
+static bool add_demo(dd_heatmap *hm, const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return false;
+  dd_demo_reader *dr = demo_r_create();
+  bool ok = demo_r_open(dr, f) && demo_heatmap_add(hm, dr);
+  demo_r_destroy(&dr);
+  fclose(f);
+  return ok;
+}
+
+static int next_demo(job *j) {
+#ifndef _WIN32
+  pthread_mutex_lock(&j->lock);
+#endif
+  int index = j->next_path++;
+#ifndef _WIN32
+  pthread_mutex_unlock(&j->lock);
+#endif
+  return index;
+}
+
+static void *worker(void *user) {
+  worker_state *state = (worker_state *)user;
+  job *j = state->j;
+  for (int index; (index = next_demo(j)) < j->num_paths;) {
+    if (add_demo(&state->heatmap, j->paths[index])) continue;
+    fprintf(stderr, "Failed to read demo: %s\n", j->paths[index]);
+#ifndef _WIN32
+    pthread_mutex_lock(&j->lock);
+#endif
+    j->num_failed++;
+#ifndef _WIN32
+    pthread_mutex_unlock(&j->lock);
+#endif
+  }
+  return NULL;
+}
+
+static bool add_path(job *j, int *capacity, const char *path) {
+  if (j->num_paths == *capacity) {
+    int new_capacity = *capacity ? *capacity * 2 : 1024;
+    char **paths = (char **)realloc(j->paths, new_capacity * sizeof(char *));
+    if (!paths) return false;
+    j->paths = paths;
+    *capacity = new_capacity;
+  }
+  char *copy = (char *)malloc(strlen(path) + 1);
+  if (!copy) return false;
+  strcpy(copy, path);
+  j->paths[j->num_paths++] = copy;
+  return true;
+}
+
+/* Adds the paths of a list file, one per line. */
+static bool read_list(job *j, int *capacity, const char *list_path) {
+  FILE *f = fopen(list_path, "r");
+  if (!f) return false;
+  char line[4096];
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), f)) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0]) ok = add_path(j, capacity, line);
+  }
+  fclose(f);
+  return ok;
+}
+
+static bool write_raw(const dd_heatmap *hm, int width, int height, const char *prefix) {
+  char path[512];
+  snprintf(path, sizeof(path), "%sheatmap.raw", prefix);
+  FILE *f = fopen(path, "wb");
+  if (!f) return false;
+  char magic[8] = "DDHEAT1";
+  int32_t header[4] = {width, height, DD_NUM_HEAT_LAYERS, DD_HEAT_TILE_SIZE};
+  bool ok = fwrite(magic, sizeof(magic), 1, f) == 1 && fwrite(header, sizeof(header), 1, f) == 1;
+  for (int l = 0; ok && l < DD_NUM_HEAT_LAYERS; l++) {
+    for (int y = 0; ok && y < height; y++)
+      ok = fwrite(hm->layers[l] + (size_t)y * hm->width, sizeof(uint32_t), width, f) == (size_t)width;
+  }
+  return fclose(f) == 0 && ok;
+}
+
+static bool write_pgm(const dd_heatmap *hm, int layer, int width, int height, const char *prefix) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s%s.pgm", prefix, g_layer_names[layer]);
+  FILE *f = fopen(path, "wb");
+  if (!f) return false;
+  uint32_t max = 0;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      uint32_t count = hm->layers[layer][(size_t)y * hm->width + x];
+      if (count > max) max = count;
+    }
+  }
+  // log scale, a few visits stay visible next to the spawn
+  double scale = max > 0 ? 255.0 / log1p((double)max) : 0.0;
+  unsigned char *row = (unsigned char *)malloc(width > 0 ? width : 1);
+  bool ok = row && fprintf(f, "P5\n%d %d\n255\n", width, height) > 0;
+  for (int y = 0; ok && y < height; y++) {
+    for (int x = 0; x < width; x++)
+      row[x] = (unsigned char)(log1p((double)hm->layers[layer][(size_t)y * hm->width + x]) * scale + 0.5);
+    ok = fwrite(row, 1, width, f) == (size_t)width;
+  }
+  free(row);
+  return fclose(f) == 0 && ok;
+}
+
+int main(int argc, char **argv) {
+  int num_threads = 1, capacity = 0;
+  const char *prefix = NULL;
+  job j;
+  memset(&j, 0, sizeof(j));
+  bool ok = true;
+
+  for (int i = 1; i < argc && ok; i++) {
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      num_threads = atoi(argv[++i]);
+#ifndef _WIN32
+      if (num_threads <= 0) num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+      if (num_threads < 1) num_threads = 1;
+    } else if (strcmp(argv[i], "--list") == 0 && i + 1 < argc) {
+      ok = read_list(&j, &capacity, argv[++i]);
+      if (!ok) printf("Failed to read list file: %s\n", argv[i]);
+    } else if (!prefix) {
+      prefix = argv[i];
+    } else {
+      ok = add_path(&j, &capacity, argv[i]);
+    }
+  }
+  if (!ok || !prefix || j.num_paths == 0) {
+    if (ok) printf("Usage: %s [--threads n] [--list demo_list_file] <output_prefix> [demo_file...]\n", argv[0]);
+    for (int i = 0; i < j.num_paths; i++)
+      free(j.paths[i]);
+    free(j.paths);
+    return 1;
+  }
+
+  if (num_threads > j.num_paths) num_threads = j.num_paths;
+  worker_state *states = (worker_state *)calloc(num_threads, sizeof(worker_state));
+  for (int i = 0; states && i < num_threads; i++) {
+    states[i].j = &j;
+    demo_heatmap_init(&states[i].heatmap);
+  }
+
+#ifndef _WIN32
+  dd_get_netobj_type(DD_NETOBJTYPE_CHARACTER); // sets up the type registry before the workers read it
+  pthread_t *threads = (pthread_t *)calloc(num_threads, sizeof(pthread_t));
+  pthread_mutex_init(&j.lock, NULL);
+  int num_started = 0;
+  for (int i = 0; states && threads && i < num_threads; i++) {
+    if (pthread_create(&threads[i], NULL, worker, &states[i]) != 0) break;
+    num_started++;
+  }
+  if (states && num_started == 0) {
+    worker(&states[0]);
+    num_started = 1;
+  }
+  for (int i = 0; threads && i < num_started; i++)
+    pthread_join(threads[i], NULL);
+  pthread_mutex_destroy(&j.lock);
+  free(threads);
+#else
+  int num_started = states ? 1 : 0;
+  if (states) worker(&states[0]);
+#endif
+
+  dd_heatmap heatmap;
+  demo_heatmap_init(&heatmap);
+  ok = states != NULL;
+  for (int i = 0; i < num_started; i++)
+    ok = ok && demo_heatmap_merge(&heatmap, &states[i].heatmap);
+  for (int i = 0; states && i < num_threads; i++)
+    demo_heatmap_free(&states[i].heatmap);
+  free(states);
+
+  // the grid grows in steps, only the part with counts is written
+  int width = 0, height = 0;
+  for (int l = 0; ok && l < DD_NUM_HEAT_LAYERS; l++) {
+    for (int y = 0; y < heatmap.height; y++) {
+      for (int x = 0; x < heatmap.width; x++) {
+        if (!heatmap.layers[l][(size_t)y * heatmap.width + x]) continue;
+        if (x >= width) width = x + 1;
+        if (y >= height) height = y + 1;
+      }
+    }
+  }
+
+  ok = ok && write_raw(&heatmap, width, height, prefix);
+  for (int l = 0; ok && l < DD_NUM_HEAT_LAYERS; l++)
+    ok = write_pgm(&heatmap, l, width, height, prefix);
+  if (ok) printf("Read %d of %d demos, heatmap of %dx%d tiles.\n", j.num_paths - j.num_failed, j.num_paths, width, height);
+  else fprintf(stderr, "Failed to build the heatmap or to write it.\n");
+
+  demo_heatmap_free(&heatmap);
+  for (int i = 0; i < j.num_paths; i++)
+    free(j.paths[i]);
+  free(j.paths);
+  return !ok;
+}
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DDNET_DEMO_IMPLEMENTATION
+#include "ddnet_demo.h"
+
+/*
+ * Reads the map embedded in a demo, or a map file, without extracting it (see demo_map_open()): lists its items and
+ * physics layers and optionally writes the game layer as an 8 bit PGM image, one pixel per tile. Only the index and
+ * the data blocks of the physics layers are read, images and sounds are left alone.
+ */
+
+static const char *g_layer_names[] = {"game", "tele", "speedup", "front", "switch", "tune"};
+
+/* Air stays black, solid, death and unhookable tiles get their own shades, everything else a dark grey. */
+static unsigned char tile_shade(int index) {
+  static const unsigned char shades[4] = {0, 255, 96, 192};
+  return index < 4 ? shades[index] : 48;
+}
+
+static bool write_pgm(const dd_map_tile *tiles, int width, int height, const char *path) {
+  FILE *f = fopen(path, "wb");
+  if (!f) return false;
+  unsigned char *row = (unsigned char *)malloc(width);
+  bool ok = row && fprintf(f, "P5\n%d %d\n255\n", width, height) > 0;
+  for (int y = 0; ok && y < height; y++) {
+    for (int x = 0; x < width; x++)
+      row[x] = tile_shade(tiles[(size_t)y * width + x].index);
+    ok = fwrite(row, 1, width, f) == (size_t)width;
+  }
+  free(row);
+  return fclose(f) == 0 && ok;
+}
+
+static void print_map(dd_map_file *map) {
+  printf("%d items, %d data blocks\n", demo_map_num_items(map), demo_map_num_data(map));
+  for (int type = DD_MAPITEMTYPE_VERSION; type <= DD_MAPITEMTYPE_SOUND; type++) {
+    static const char *names[] = {"version", "info", "image", "envelope", "group", "layer", "envpoints", "sound"};
+    int start, num;
+    demo_map_get_type(map, type, &start, &num);
+    if (num > 0) printf("  %-10s %d\n", names[type], num);
+  }
+  for (int l = 0; l < (int)(sizeof(g_layer_names) / sizeof(g_layer_names[0])); l++) {
+    int width, height;
+    if (demo_map_get_tiles(map, 1 << l, &width, &height)) printf("%s layer: %dx%d tiles\n", g_layer_names[l], width, height);
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    printf("Usage: %s <demo_or_map_file> [game_layer.pgm]\n", argv[0]);
+    return 1;
+  }
+
+  FILE *f = fopen(argv[1], "rb");
+  if (!f) {
+    printf("Failed to open file: %s\n", argv[1]);
+    return 1;
+  }
+  dd_demo_reader *dr = demo_r_create();
+  dd_map_file *map;
+  if (demo_r_open(dr, f)) {
+    map = demo_r_open_map(dr);
+  } else {
+    fseek(f, 0, SEEK_SET);
+    map = demo_map_open(f, 0, -1);
+  }
+  if (!map) {
+    printf("No map in file: %s\n", argv[1]);
+    demo_r_destroy(&dr);
+    fclose(f);
+    return 1;
+  }
+
+  print_map(map);
+  bool ok = true;
+  if (argc == 3) {
+    int width, height;
+    const dd_map_tile *tiles = (const dd_map_tile *)demo_map_get_tiles(map, DD_TILESLAYERFLAG_GAME, &width, &height);
+    ok = tiles && write_pgm(tiles, width, height, argv[2]);
+    if (!ok) fprintf(stderr, "Failed to read the game layer or to write it.\n");
+  }
+
+  demo_map_close(&map);
+  demo_r_destroy(&dr);
+  fclose(f);
+  return !ok;
+}
@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DDNET_DEMO_IMPLEMENTATION
+#include "ddnet_demo.h"
+
+/*
+ * Cuts the ticks [start_tick, end_tick] out of a demo. Compressed chunks are copied as they are, only the first
+ * snapshot is re-encoded when the cut doesn't start on a keyframe.
+ */
+
+int main(int argc, char **argv) {
+  if (argc != 5) {
+    printf("Usage: %s <demo_file> <output_file> <start_tick> <end_tick>\n", argv[0]);
+    return 1;
+  }
+  int start_tick = atoi(argv[3]);
+  int end_tick = atoi(argv[4]);
+
+  FILE *f = fopen(argv[1], "rb");
+  if (!f) {
+    printf("Failed to open file: %s\n", argv[1]);
+    return 1;
+  }
+  dd_demo_reader *dr = demo_r_create();
+  if (!demo_r_open(dr, f)) {
+    printf("Failed to open demo file.\n");
+    demo_r_destroy(&dr);
+    fclose(f);
+    return 1;
+  }
+
+  FILE *out = fopen(argv[2], "wb");
+  if (!out) {
+    printf("Failed to open output file: %s\n", argv[2]);
+    demo_r_destroy(&dr);
+    fclose(f);
+    return 1;
+  }
+
+  bool ok = demo_slice(dr, out, start_tick, end_tick);
+  if (!ok) fprintf(stderr, "Slicing failed, the demo is broken or the range is empty.\n");
+
+  fclose(out);
+  demo_r_destroy(&dr);
+  fclose(f);
+  return !ok;
+}
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define DDNET_DEMO_IMPLEMENTATION
+#include "ddnet_demo.h"
+
+/*
+ * Re-encodes a demo with another keyframe interval, optionally without messages, with sorted snapshots or at a lower
+ * tick rate (--rate 10 keeps every 5th tick, for light preview demos). --strip-items and --strip-msgs take comma
+ * separated public item types and message ids to leave out, e.g. "--strip-items 19,20 --strip-msgs 3" drops world
+ * sounds, damage indicators and chat.
+ * The demo is split into segments at its keyframes, which are encoded on a pool of threads (one after another on
+ * Windows) into temporary files and appended to the output in order.
+ */
+
+typedef struct {
+  int start_tick;
+  int end_tick; // -1 for the last segment
+  FILE *file;
+  dd_demo_writer *writer;
+  bool ok;
+} segment;
+
+#define MAX_STRIP_TYPES 64
+
+typedef struct {
+  const char *input;
+  int keyframe_interval;
+  dd_transcode_options options;
+  int strip_item_types[MAX_STRIP_TYPES];
+  int strip_msg_types[MAX_STRIP_TYPES];
+  segment *segments;
+  int num_segments;
+  int next_segment;
+#ifndef _WIN32
+  pthread_mutex_t lock;
+#endif
+} job;
+
+static void encode_segment(const job *j, segment *seg) {
+  seg->ok = false;
+  FILE *f = fopen(j->input, "rb");
+  if (!f) return;
+  dd_demo_reader *dr = demo_r_create();
+  seg->file = tmpfile();
+  seg->writer = demo_w_create();
+  if (dr && seg->file && seg->writer && demo_r_open(dr, f) && demo_w_begin_segment(seg->writer, seg->file)) {
+    demo_w_set_keyframe_interval(seg->writer, j->keyframe_interval);
+    seg->ok = demo_transcode(dr, seg->writer, seg->start_tick, seg->end_tick, &j->options);
+    seg->ok = demo_w_finish(seg->writer) && seg->ok;
+  }
+  demo_r_destroy(&dr);
+  fclose(f);
+}
+
+#ifndef _WIN32
+static void *worker(void *user) {
+  job *j = (job *)user;
+  for (;;) {
+    pthread_mutex_lock(&j->lock);
+    int index = j->next_segment++;
+    pthread_mutex_unlock(&j->lock);
+    if (index >= j->num_segments) return NULL;
+    encode_segment(j, &j->segments[index]);
+  }
+}
+#endif
+
+static bool parse_types(const char *list, int *types, int *num_types) {
+  *num_types = 0;
+  while (*list) {
+    char *end;
+    long type = strtol(list, &end, 10);
+    if (end == list || *num_types == MAX_STRIP_TYPES) return false;
+    types[(*num_types)++] = (int)type;
+    list = end;
+    if (*list == ',') list++;
+    else if (*list) return false;
+  }
+  return *num_types > 0;
+}
+
+/* Cuts at keyframes, into segments of at least `min_ticks` ticks and about `target` segments. When decimating, a
+ * segment ends on a kept tick instead, so the events of the dropped ticks before the cut aren't left behind. */
+static int split_segments(dd_demo_reader *dr, int target, int min_ticks, int decimate, segment *segments) {
+  int num_keyframes = demo_r_num_keyframes(dr);
+  if (num_keyframes == 0) return 0;
+  int first = demo_r_keyframe_tick(dr, 0), last = demo_r_keyframe_tick(dr, num_keyframes - 1);
+  int length = (last - first) / target;
+  if (length < min_ticks) length = min_ticks;
+
+  int num_segments = 0;
+  segments[num_segments++].start_tick = first;
+  for (int i = 1; i < num_keyframes && num_segments < target; i++) {
+    int tick = demo_r_keyframe_tick(dr, i);
+    if (decimate > 1) tick = (tick - 1 + decimate - 1) / decimate * decimate + 1;
+    if (tick - segments[num_segments - 1].start_tick < length) continue;
+    segments[num_segments - 1].end_tick = tick - 1;
+    segments[num_segments++].start_tick = tick;
+  }
+  segments[num_segments - 1].end_tick = -1;
+  return num_segments;
+}
+
+int main(int argc, char **argv) {
+  job j;
+  memset(&j, 0, sizeof(j));
+  j.keyframe_interval = DD_SERVER_TICK_SPEED * 5;
+  int num_threads = 4;
+#ifndef _WIN32
+  long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (num_cpus > 0) num_threads = (int)num_cpus;
+#endif
+  const char *output = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--keyframe-interval") == 0 && i + 1 < argc) {
+      j.keyframe_interval = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      num_threads = atoi(argv[++i]);
+      if (num_threads < 1) num_threads = 1;
+    } else if (strcmp(argv[i], "--strip-messages") == 0) {
+      j.options.strip_chunks |= 1u << DD_CHUNK_MSG;
+    } else if (strcmp(argv[i], "--strip-snapshots") == 0) {
+      j.options.strip_chunks |= (1u << DD_CHUNK_SNAP) | (1u << DD_CHUNK_SNAP_DELTA);
+    } else if (strcmp(argv[i], "--sort") == 0) {
+      j.options.sort_snapshots = true;
+    } else if ((strcmp(argv[i], "--strip-items") == 0 || strcmp(argv[i], "--strip-msgs") == 0) && i + 1 < argc) {
+      bool items = strcmp(argv[i], "--strip-items") == 0;
+      int *types = items ? j.strip_item_types : j.strip_msg_types;
+      int *num_types = items ? &j.options.num_strip_item_types : &j.options.num_strip_msg_types;
+      if (!parse_types(argv[++i], types, num_types)) {
+        printf("Invalid type list: %s\n", argv[i]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+      int rate = atoi(argv[++i]);
+      j.options.decimate = rate > 0 ? DD_SERVER_TICK_SPEED / rate : 0;
+    } else if (!j.input) {
+      j.input = argv[i];
+    } else if (!output) {
+      output = argv[i];
+    } else {
+      j.input = NULL;
+      break;
+    }
+  }
+  if (!j.input || !output) {
+    printf("Usage: %s [--keyframe-interval ticks] [--strip-messages] [--strip-snapshots] [--strip-items types] [--strip-msgs ids] [--sort] [--rate hz] "
+           "[--threads n] <demo_file> <output_file>\n",
+           argv[0]);
+    return 1;
+  }
+
+  j.options.strip_item_types = j.strip_item_types;
+  j.options.strip_msg_types = j.strip_msg_types;
+
+  FILE *f = fopen(j.input, "rb");
+  if (!f) {
+    printf("Failed to open file: %s\n", j.input);
+    return 1;
+  }
+  dd_demo_reader *dr = demo_r_create();
+  if (!demo_r_open(dr, f)) {
+    printf("Failed to open demo file.\n");
+    demo_r_destroy(&dr);
+    fclose(f);
+    return 1;
+  }
+
+  // with keyframes only at the start there is nowhere to split without adding some
+  int target = j.keyframe_interval > 0 ? num_threads * 4 : 1;
+  j.segments = (segment *)calloc(target, sizeof(segment));
+  if (!j.segments) {
+    printf("Out of memory.\n");
+    demo_r_destroy(&dr);
+    fclose(f);
+    return 1;
+  }
+  j.num_segments = split_segments(dr, target, j.keyframe_interval, j.options.decimate, j.segments);
+
+#ifndef _WIN32
+  if (num_threads > j.num_segments) num_threads = j.num_segments;
+  pthread_t *threads = (pthread_t *)calloc(num_threads > 0 ? num_threads : 1, sizeof(pthread_t));
+  pthread_mutex_init(&j.lock, NULL);
+  int num_started = 0;
+  for (int i = 0; threads && i < num_threads; i++) {
+    if (pthread_create(&threads[i], NULL, worker, &j) != 0) break;
+    num_started++;
+  }
+  if (num_started == 0) worker(&j);
+  for (int i = 0; i < num_started; i++)
+    pthread_join(threads[i], NULL);
+  pthread_mutex_destroy(&j.lock);
+  free(threads);
+#else
+  for (int i = 0; i < j.num_segments; i++)
+    encode_segment(&j, &j.segments[i]);
+#endif
+
+  bool ok = true;
+  FILE *out = fopen(output, "wb");
+  if (!out) {
+    printf("Failed to open output file: %s\n", output);
+    ok = false;
+  } else {
+    dd_demo_writer *dw = demo_w_create();
+    ok = demo_w_begin_from(dw, out, dr);
+    for (int i = 0; i < j.num_segments && ok; i++) {
+      ok = j.segments[i].ok && demo_w_append_segment(dw, j.segments[i].writer, j.segments[i].file);
+    }
+    const dd_demo_info *info = demo_r_get_info(dr);
+    for (int i = 0; i < info->num_markers; i++)
+      demo_w_add_marker(dw, info->markers[i]);
+    ok = demo_w_finish(dw) && ok;
+    demo_w_destroy(&dw);
+    fclose(out);
+    if (!ok) fprintf(stderr, "Transcoding failed, the demo is broken.\n");
+  }
+
+  for (int i = 0; i < j.num_segments; i++) {
+    demo_w_destroy(&j.segments[i].writer);
+    if (j.segments[i].file) fclose(j.segments[i].file);
+  }
+  free(j.segments);
+  demo_r_destroy(&dr);
+  fclose(f);
+  return !ok;
+}